@@ -0,0 +1,338 @@
+#include "archetypes.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// One value in a section: exactly one of i and f is set.
+template <typename A>
+struct Field {
+    const char *key;
+    int A::*i;
+    float A::*f;
+};
+
+static const Field<UnitArchetype> UNIT_FIELDS[] = {
+    { "hp",           &UnitArchetype::hp,     nullptr },
+    { "fire_rate",    nullptr,                &UnitArchetype::fireRate },
+    { "range",        nullptr,                &UnitArchetype::range },
+    { "damage",       &UnitArchetype::damage, nullptr },
+    { "speed",        &UnitArchetype::speed,  nullptr },
+    { "heal_rate",    nullptr,                &UnitArchetype::healRate },
+    { "crowd_radius", nullptr,                &UnitArchetype::crowdRadius },
+    { "crowd_weight", nullptr,                &UnitArchetype::crowdWeight },
+};
+
+static const Field<EnemyArchetype> ENEMY_FIELDS[] = {
+    { "move_speed",         nullptr,                     &EnemyArchetype::moveSpeed },
+    { "attack_range",       nullptr,                     &EnemyArchetype::attackRange },
+    { "attack_damage",      nullptr,                     &EnemyArchetype::attackDamage },
+    { "attack_cooldown",    nullptr,                     &EnemyArchetype::attackCooldown },
+    { "hp",                 &EnemyArchetype::hp,         nullptr },
+    { "hp_per_wave",        &EnemyArchetype::hpPerWave,  nullptr },
+    { "detection_range",    nullptr,                     &EnemyArchetype::detectionRange },
+    { "detection_per_wave", nullptr,                     &EnemyArchetype::detectionPerWave },
+    { "avoid_units_range",  nullptr,                     &EnemyArchetype::avoidUnitsRange },
+    { "crowd_radius",       nullptr,                     &EnemyArchetype::crowdRadius },
+    { "crowd_weight",       nullptr,                     &EnemyArchetype::crowdWeight },
+    { "spawn_weight",       &EnemyArchetype::spawnWeight, nullptr },
+};
+
+static const Field<Tuning> TUNING_FIELDS[] = {
+    { "attack_range_hyst",       nullptr,                         &Tuning::attackRangeHyst },
+    { "bullet_speed",            nullptr,                         &Tuning::bulletSpeed },
+    { "medic_search",            nullptr,                         &Tuning::medicSearch },
+    { "intermission_duration",   nullptr,                         &Tuning::intermissionDuration },
+    { "wave_base_count",         &Tuning::waveBaseCount,          nullptr },
+    { "wave_count_per_wave",     &Tuning::waveCountPerWave,       nullptr },
+    { "casual_count_scale",      nullptr,                         &Tuning::casualCountScale },
+    { "casual_stat_scale",       nullptr,                         &Tuning::casualStatScale },
+    { "normal_count_scale",      nullptr,                         &Tuning::normalCountScale },
+    { "normal_stat_scale",       nullptr,                         &Tuning::normalStatScale },
+    { "hard_count_scale",        nullptr,                         &Tuning::hardCountScale },
+    { "hard_stat_scale",         nullptr,                         &Tuning::hardStatScale },
+    { "hull_cost",               &Tuning::hullCost,               nullptr },
+    { "shielding_cost",          &Tuning::shieldingCost,          nullptr },
+    { "engines_cost",            &Tuning::enginesCost,            nullptr },
+    { "life_support_cost",       &Tuning::lifeSupportCost,        nullptr },
+    { "start_rocks",             &Tuning::startRocks,             nullptr },
+    { "start_rock_scrap_min",    &Tuning::startRockScrapMin,      nullptr },
+    { "start_rock_scrap_max",    &Tuning::startRockScrapMax,      nullptr },
+    { "wave_rocks",              &Tuning::waveRocks,              nullptr },
+    { "wave_rock_scrap_min",     &Tuning::waveRockScrapMin,       nullptr },
+    { "wave_rock_scrap_max",     &Tuning::waveRockScrapMax,       nullptr },
+    { "rock_hp_min",             &Tuning::rockHpMin,              nullptr },
+    { "rock_hp_max",             &Tuning::rockHpMax,              nullptr },
+    { "alien_scrap_min",         &Tuning::alienScrapMin,          nullptr },
+    { "alien_scrap_max",         &Tuning::alienScrapMax,          nullptr },
+    { "wave_unit_heal",          nullptr,                         &Tuning::waveUnitHeal },
+    { "wave_ship_heal",          nullptr,                         &Tuning::waveShipHeal },
+    { "reward_base",             &Tuning::rewardBase,             nullptr },
+    { "reward_per_wave",         &Tuning::rewardPerWave,          nullptr },
+    { "casual_reward_scale",     nullptr,                         &Tuning::casualRewardScale },
+    { "normal_reward_scale",     nullptr,                         &Tuning::normalRewardScale },
+    { "hard_reward_scale",       nullptr,                         &Tuning::hardRewardScale },
+};
+
+// Tables in a balance file: the tuning, then one per unit type, then one per
+// alien type. BalanceReloader's changed bits are in this order.
+const int TABLE_TUNING = 0;
+const int TABLE_UNITS = 1;
+const int TABLE_ENEMIES = TABLE_UNITS + UNIT_TYPE_COUNT;
+const int TABLE_COUNT = TABLE_ENEMIES + ENEMY_TYPE_COUNT;
+
+template <typename A, int N>
+static const Field<A> *findField(const Field<A> (&fields)[N], const char *key) {
+    for (const Field<A> &fd : fields) if (strcmp(fd.key, key) == 0) return &fd;
+    return nullptr;
+}
+
+// Parses value into the field. Every value in a balance file is a count, a
+// distance, a rate or a time, so none may be negative.
+template <typename A>
+static bool setField(A &a, const Field<A> &fd, const char *value) {
+    char *end = nullptr;
+    errno = 0;
+    if (fd.i) {
+        long v = strtol(value, &end, 10);
+        if (end == value || *end || errno || v < 0 || v > 1000000) return false;
+        a.*fd.i = (int)v;
+    } else {
+        float v = strtof(value, &end);
+        if (end == value || *end || errno || !std::isfinite(v) || v < 0.0f) return false;
+        a.*fd.f = v;
+    }
+    return true;
+}
+
+static char *trim(char *s) {
+    while (*s == ' ' || *s == '\t') ++s;
+    char *e = s + strlen(s);
+    while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r' || e[-1] == '\n')) --e;
+    *e = 0;
+    return s;
+}
+
+template <typename T, int N>
+static int typeNamed(const T (&traits)[N], const char *name) {
+    for (int t = 0; t < N; ++t) if (strcmp(traits[t].name, name) == 0) return t;
+    return -1;
+}
+
+// A "key = value" line, with its line number for errors.
+struct BalanceLine {
+    int line;
+    std::string key, value;
+};
+
+// Reads path into one list of lines per table. Every section for a table
+// adds to its list, in file order; present says which tables had one.
+static bool readTables(const char *path, std::vector<BalanceLine> (&tables)[TABLE_COUNT], bool (&present)[TABLE_COUNT],
+                       std::string &error) {
+    FILE *f = fopen(path, "r");
+    if (!f) { error = "cannot open file"; return false; }
+    for (int t = 0; t < TABLE_COUNT; ++t) { tables[t].clear(); present[t] = false; }
+    int table = -1;
+    char buf[256];
+    int line = 0;
+    auto fail = [&](const char *what) {
+        error = "line " + std::to_string(line) + ": " + what;
+        fclose(f);
+        return false;
+    };
+    while (fgets(buf, sizeof(buf), f)) {
+        ++line;
+        if (char *hash = strchr(buf, '#')) *hash = 0;
+        char *s = trim(buf);
+        if (!*s) continue;
+        if (*s == '[') {
+            char kind[16], name[32], close = 0;
+            if (strcmp(s, "[game]") == 0) {
+                table = TABLE_TUNING;
+            } else if (sscanf(s, "[%15s %31[^] \t]%c", kind, name, &close) != 3 || close != ']') {
+                return fail("bad section header");
+            } else if (strcmp(kind, "unit") == 0) {
+                int t = typeNamed(UNIT_TRAITS, name);
+                if (t < 0) return fail("unknown unit type");
+                table = TABLE_UNITS + t;
+            } else if (strcmp(kind, "enemy") == 0) {
+                int t = typeNamed(ENEMY_TRAITS, name);
+                if (t < 0) return fail("unknown enemy type");
+                table = TABLE_ENEMIES + t;
+            } else {
+                return fail("section is not game, unit or enemy");
+            }
+            present[table] = true;
+            continue;
+        }
+        char *eq = strchr(s, '=');
+        if (!eq) return fail("expected key = value");
+        if (table < 0) return fail("value outside a section");
+        *eq = 0;
+        tables[table].push_back(BalanceLine{ line, trim(s), trim(eq + 1) });
+    }
+    fclose(f);
+    return true;
+}
+
+template <typename A, int N>
+static bool applyLines(A &a, const Field<A> (&fields)[N], const std::vector<BalanceLine> &lines, const char *what,
+                       std::string &error) {
+    for (const BalanceLine &l : lines) {
+        const Field<A> *fd = findField(fields, l.key.c_str());
+        if (!fd) { error = "line " + std::to_string(l.line) + ": unknown " + what + " key"; return false; }
+        if (!setField(a, *fd, l.value.c_str())) { error = "line " + std::to_string(l.line) + ": bad value"; return false; }
+    }
+    return true;
+}
+
+static bool applyTable(Archetypes &a, int table, const std::vector<BalanceLine> &lines, std::string &error) {
+    if (table == TABLE_TUNING) return applyLines(a.tuning, TUNING_FIELDS, lines, "game", error);
+    if (table < TABLE_ENEMIES) return applyLines(a.units[table - TABLE_UNITS], UNIT_FIELDS, lines, "unit", error);
+    return applyLines(a.enemies[table - TABLE_ENEMIES], ENEMY_FIELDS, lines, "enemy", error);
+}
+
+// Things the simulation divides by or draws from, for one table. Alien types
+// are checked together, since the spawn weights only matter summed.
+static bool checkTable(const Archetypes &a, int table, std::string &error) {
+    if (table == TABLE_TUNING) {
+        const Tuning &t = a.tuning;
+        if (t.bulletSpeed <= 0.0f) { error = "bullet_speed must be above 0"; return false; }
+        if (t.casualStatScale <= 0.0f || t.normalStatScale <= 0.0f || t.hardStatScale <= 0.0f) {
+            error = "every stat scale must be above 0";
+            return false;
+        }
+        if (t.startRockScrapMin > t.startRockScrapMax || t.waveRockScrapMin > t.waveRockScrapMax) {
+            error = "rock scrap min is above its max";
+            return false;
+        }
+        if (t.rockHpMin <= 0 || t.rockHpMin > t.rockHpMax) { error = "rock_hp_min must be above 0 and at most rock_hp_max"; return false; }
+        if (t.alienScrapMin > t.alienScrapMax) { error = "alien_scrap_min is above alien_scrap_max"; return false; }
+        if (t.waveUnitHeal > 1.0f || t.waveShipHeal > 1.0f) { error = "wave heals are shares of max hp, at most 1"; return false; }
+        if (t.startRocks > 1000 || t.waveRocks > 1000) { error = "at most 1000 rocks at a time"; return false; }
+    } else if (table < TABLE_ENEMIES) {
+        int u = table - TABLE_UNITS;
+        const UnitArchetype &ua = a.units[u];
+        // Healing falls off over range, so a zero range would divide by it.
+        if (ua.fireRate <= 0.0f || ua.hp <= 0 || ua.range <= 0.0f) {
+            error = std::string("unit ") + UNIT_TRAITS[u].name + " needs hp, fire_rate and range above 0";
+            return false;
+        }
+        if (ua.healRate < 0.0f || ua.speed < 0) {
+            error = std::string("unit ") + UNIT_TRAITS[u].name + " has a negative heal_rate or speed";
+            return false;
+        }
+    } else {
+        int spawnTotal = 0;
+        for (int t = 0; t < ENEMY_TYPE_COUNT; ++t) {
+            if (a.enemies[t].spawnWeight < 0) {
+                error = std::string("enemy ") + ENEMY_TRAITS[t].name + " has a negative spawn_weight";
+                return false;
+            }
+            spawnTotal += a.enemies[t].spawnWeight;
+        }
+        if (spawnTotal <= 0) { error = "every spawn_weight is 0"; return false; }
+    }
+    return true;
+}
+
+bool loadArchetypes(const char *path, Archetypes &out, std::string &error) {
+    std::vector<BalanceLine> tables[TABLE_COUNT];
+    bool present[TABLE_COUNT];
+    if (!readTables(path, tables, present, error)) return false;
+    Archetypes a = out;
+    for (int t = 0; t < TABLE_COUNT; ++t) {
+        if (!applyTable(a, t, tables[t], error)) return false;
+    }
+    for (int t = 0; t < TABLE_COUNT; ++t) {
+        if (!checkTable(a, t, error)) return false;
+    }
+    out = a;
+    return true;
+}
+
+static uint64_t hashLines(const std::vector<BalanceLine> &lines) {
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&](const std::string &s) {
+        for (char c : s) { h ^= (uint8_t)c; h *= 1099511628211ULL; }
+        h ^= 0xff; h *= 1099511628211ULL;
+    };
+    for (const BalanceLine &l : lines) { mix(l.key); mix(l.value); }
+    return h | 1;   // 0 is kept for a table with no section
+}
+
+bool BalanceReloader::reload(const char *path, Archetypes &out, uint32_t &changed, std::string &error) {
+    std::vector<BalanceLine> tables[TABLE_COUNT];
+    bool present[TABLE_COUNT];
+    if (!readTables(path, tables, present, error)) return false;
+    uint64_t hash[TABLE_COUNT];
+    Archetypes a = out;
+    changed = 0;
+    for (int t = 0; t < TABLE_COUNT; ++t) {
+        hash[t] = present[t] ? hashLines(tables[t]) : 0;
+        if (hash[t] == tableHash[t]) continue;
+        changed |= 1u << t;
+        // From the defaults, so a key taken out of the file goes back to its default.
+        if (t == TABLE_TUNING) a.tuning = DEFAULT_ARCHETYPES.tuning;
+        else if (t < TABLE_ENEMIES) a.units[t - TABLE_UNITS] = DEFAULT_ARCHETYPES.units[t - TABLE_UNITS];
+        else a.enemies[t - TABLE_ENEMIES] = DEFAULT_ARCHETYPES.enemies[t - TABLE_ENEMIES];
+        if (!applyTable(a, t, tables[t], error)) return false;
+    }
+    bool enemiesChecked = false;
+    for (int t = 0; t < TABLE_COUNT; ++t) {
+        if (!(changed & (1u << t)) || (t >= TABLE_ENEMIES && enemiesChecked)) continue;
+        if (!checkTable(a, t, error)) return false;
+        enemiesChecked |= t >= TABLE_ENEMIES;
+    }
+    for (int t = 0; t < TABLE_COUNT; ++t) tableHash[t] = hash[t];
+    out = a;
+    return true;
+}
+
+template <typename A, int N>
+static void writeFields(FILE *f, const A &a, const Field<A> (&fields)[N]) {
+    for (const Field<A> &fd : fields) {
+        if (fd.i) fprintf(f, "%s = %d\n", fd.key, a.*fd.i);
+        else fprintf(f, "%s = %.9g\n", fd.key, a.*fd.f);
+    }
+}
+
+bool saveArchetypes(const char *path, const Archetypes &a) {
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "[game]\n");
+    writeFields(f, a.tuning, TUNING_FIELDS);
+    fprintf(f, "\n");
+    for (int t = 0; t < UNIT_TYPE_COUNT; ++t) {
+        fprintf(f, "[unit %s]\n", UNIT_TRAITS[t].name);
+        writeFields(f, a.units[t], UNIT_FIELDS);
+        fprintf(f, "\n");
+    }
+    for (int t = 0; t < ENEMY_TYPE_COUNT; ++t) {
+        fprintf(f, "[enemy %s]\n", ENEMY_TRAITS[t].name);
+        writeFields(f, a.enemies[t], ENEMY_FIELDS);
+        if (t + 1 < ENEMY_TYPE_COUNT) fprintf(f, "\n");
+    }
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+template <typename A, int N>
+static void hashFields(uint64_t &h, const A &a, const Field<A> (&fields)[N]) {
+    for (const Field<A> &fd : fields) {
+        uint32_t bits;
+        if (fd.i) bits = (uint32_t)(a.*fd.i);
+        else memcpy(&bits, &(a.*fd.f), 4);
+        for (int k = 0; k < 4; ++k) { h ^= (bits >> (8 * k)) & 0xff; h *= 1099511628211ULL; }
+    }
+}
+
+uint64_t archetypesHash(const Archetypes &a) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const UnitArchetype &u : a.units) hashFields(h, u, UNIT_FIELDS);
+    for (const EnemyArchetype &e : a.enemies) hashFields(h, e, ENEMY_FIELDS);
+    hashFields(h, a.tuning, TUNING_FIELDS);
+    return h;
+}
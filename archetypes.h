@@ -0,0 +1,190 @@
+#ifndef ARCHETYPES_H
+#define ARCHETYPES_H
+
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+enum UnitType {
+    UNIT_RIFLE,
+    UNIT_SHOTGUN,
+    UNIT_SNIPER,
+    UNIT_HEAVY,
+    UNIT_ROCKET,
+    UNIT_HEALER,
+    UNIT_TYPE_COUNT
+};
+
+enum EnemyType {
+    ENEMY_GRUNT,
+    ENEMY_FAST,
+    ENEMY_TANK,
+    ENEMY_SHOOTER,
+    ENEMY_SIEGE,
+    ENEMY_TYPE_COUNT
+};
+
+// How a type behaves, as opposed to how strong it is. Fixed at compile time:
+// the hot loops are built once per type with these folded in, so a branch on
+// one costs nothing, and a balance file cannot change them.
+struct UnitTraits {
+    const char *name;
+    bool heals;             // seeks out and heals the wounded instead of shooting or mining
+};
+
+struct EnemyTraits {
+    const char *name;
+    bool prioritizeShip;    // ignores units and goes for the ship
+    bool avoidsUnits;       // backs off from units inside its avoidUnitsRange
+};
+
+constexpr UnitTraits UNIT_TRAITS[UNIT_TYPE_COUNT] = {
+    { "rifle",   false },
+    { "shotgun", false },
+    { "sniper",  false },
+    { "heavy",   false },
+    { "rocket",  false },
+    { "healer",  true  },
+};
+
+constexpr EnemyTraits ENEMY_TRAITS[ENEMY_TYPE_COUNT] = {
+    { "grunt",   false, false },
+    { "fast",    false, false },
+    { "tank",    false, false },
+    { "shooter", false, false },
+    { "siege",   true,  true  },
+};
+
+// Numbers a new unit of the type starts with.
+struct UnitArchetype {
+    int hp;
+    float fireRate;         // shots per second
+    float range;
+    int damage;
+    int speed;
+    float healRate;         // hp per second at point blank, for types that heal
+    float crowdRadius, crowdWeight;
+};
+
+// Numbers a new alien of the type spawns with. hp and detectionRange grow by
+// the per-wave amount every wave; hp is then scaled by difficulty.
+struct EnemyArchetype {
+    float moveSpeed;
+    float attackRange;
+    float attackDamage;
+    float attackCooldown;
+    int hp, hpPerWave;
+    float detectionRange, detectionPerWave;
+    float avoidUnitsRange;  // only read by types that avoid units
+    float crowdRadius, crowdWeight;
+    int spawnWeight;        // share of a wave's spawns, out of the total over all types
+};
+
+// Numbers that belong to no one type: waves, difficulty, rewards, the shop and rocks.
+// Read where they are used, so a change shows up the next time it comes up
+// (the next wave, the next rocks spawned), except for shop prices, which
+// applyArchetypes (game.h) also writes into the running shop.
+struct Tuning {
+    float attackRangeHyst;          // how far past its range a unit keeps shooting before it closes in
+    float bulletSpeed;
+    float medicSearch;              // how far a medic looks for a hurt ally
+    float intermissionDuration;     // seconds between waves
+    int waveBaseCount, waveCountPerWave;        // aliens in wave w: base + w * perWave, times the difficulty's count scale
+    float casualCountScale, casualStatScale;    // stat scale multiplies a new alien's hp
+    float normalCountScale, normalStatScale;
+    float hardCountScale, hardStatScale;
+    int hullCost, shieldingCost, enginesCost, lifeSupportCost;
+    int startRocks, startRockScrapMin, startRockScrapMax;
+    int waveRocks, waveRockScrapMin, waveRockScrapMax;      // spawned at every new wave
+    int rockHpMin, rockHpMax;
+    int alienScrapMin, alienScrapMax;                       // dropped by each alien killed
+    float waveUnitHeal, waveShipHeal;                       // share of max hp restored when a wave is cleared
+    int rewardBase, rewardPerWave;                          // scrap for clearing wave w: base + w * perWave, times the reward scale
+    float casualRewardScale, normalRewardScale, hardRewardScale;
+};
+
+// Everything a balance file sets: per-type stats and the tuning above.
+struct Archetypes {
+    UnitArchetype units[UNIT_TYPE_COUNT];
+    EnemyArchetype enemies[ENEMY_TYPE_COUNT];
+    Tuning tuning;
+};
+
+constexpr Archetypes DEFAULT_ARCHETYPES = {
+    {   //  hp  fire   range  dmg speed  heal  crowd r/w
+        { 200, 2.0f, 120.0f, 15, 200,  0.0f, 30.0f, 20.0f },   // rifle
+        { 240, 1.5f,  80.0f, 25, 250,  0.0f, 30.0f, 20.0f },   // shotgun
+        { 160, 0.8f, 200.0f, 40, 200,  0.0f, 30.0f, 20.0f },   // sniper
+        { 300, 4.0f, 140.0f,  8, 150,  0.0f, 30.0f, 10.0f },   // heavy
+        { 180, 0.5f, 160.0f, 60, 200,  0.0f, 30.0f, 20.0f },   // rocket
+        { 220, 1.0f, 100.0f,  5, 200, 20.0f, 30.0f, 30.0f },   // healer
+    },
+    {   // speed  range  dmg  cooldown  hp  /wave  detect /wave  avoid  crowd r/w  spawn
+        { 110.0f,  65.0f, 10.0f, 1.8f,  70,  4, 380.0f, 10.0f,   0.0f, 18.0f, 24.0f, 50 },  // grunt
+        { 180.0f,  45.0f,  7.0f, 1.4f,  50,  3, 380.0f, 10.0f,   0.0f, 16.0f, 30.0f, 28 },  // fast
+        {  75.0f,  80.0f, 18.0f, 2.4f, 160, 10, 380.0f, 10.0f,   0.0f, 22.0f, 12.0f, 14 },  // tank
+        { 100.0f, 260.0f,  8.0f, 1.9f,  60,  5, 380.0f, 10.0f,   0.0f, 18.0f, 24.0f,  6 },  // shooter
+        {  65.0f, 380.0f, 10.0f, 3.0f,  55,  5, 380.0f, 10.0f, 200.0f, 20.0f, 16.0f,  2 },  // siege
+    },
+    {
+        12.0f, 500.0f, 1000.0f, 20.0f,      // range hysteresis, bullet speed, medic search, intermission
+        8, 2,                               // aliens per wave
+        0.75f, 0.85f, 1.0f, 1.0f, 1.35f, 1.25f,     // casual, normal, hard: count and stat scale
+        10, 15, 20, 25,                     // hull, shielding, engines, life support
+        10, 6, 14,                          // rocks at the start and their scrap
+        4, 10, 20,                          // rocks every wave and their scrap
+        160, 260,                           // rock hp
+        2, 5,                               // scrap per alien
+        0.4f, 0.25f,                        // units and ship healed after a wave
+        12, 2,                              // scrap for clearing a wave
+        1.15f, 1.0f, 0.85f,                 // casual, normal, hard: reward scale
+    },
+};
+
+// Calls f(std::integral_constant<int, T>()) for every T in [0, N) in order. f
+// is compiled once per T, so it can read UNIT_TRAITS[T] or ENEMY_TRAITS[T] as
+// constants; a new type gets its own copy without touching the caller.
+template <typename F, int... T>
+inline void forEachType(F &&f, std::integer_sequence<int, T...>) {
+    int expand[] = { 0, (f(std::integral_constant<int, T>()), 0)... };
+    (void)expand;
+}
+template <int N, typename F>
+inline void forEachType(F &&f) { forEachType(std::forward<F>(f), std::make_integer_sequence<int, N>()); }
+
+// Balance file: "[unit rifle]" or "[enemy grunt]" opens a type's section and
+// "[game]" the tuning's, and every line under it is "key = value", with the
+// keys saveArchetypes writes. '#' starts a comment. Keys left out keep the
+// value out already had, so a file only needs what it changes. On an error out
+// is left untouched and error names the line.
+bool loadArchetypes(const char *path, Archetypes &out, std::string &error);
+// Writes every value, in the format loadArchetypes reads.
+bool saveArchetypes(const char *path, const Archetypes &a);
+// Hash of every value, so a recording can tell it is replayed under other stats.
+uint64_t archetypesHash(const Archetypes &a);
+
+// Reads the same balance file again after it changes. Each table (the tuning,
+// a unit type, an alien type) is re-parsed and re-checked only when the text
+// of its section changed; a table whose section is gone goes back to its
+// defaults. The file is still read and split into sections every time, but
+// that is a few hundred short lines; only changed sections get their values
+// parsed and checked.
+struct BalanceReloader {
+    // Reads path into out, which must be what the last successful call gave
+    // (DEFAULT_ARCHETYPES the first time). Returns false with error set, and
+    // out untouched, if the file cannot be read or a changed table is invalid;
+    // otherwise changed says which tables moved (see BALANCE_TABLE_*), 0 if
+    // none did.
+    bool reload(const char *path, Archetypes &out, uint32_t &changed, std::string &error);
+
+private:
+    uint64_t tableHash[1 + UNIT_TYPE_COUNT + ENEMY_TYPE_COUNT] = {};   // 0: section absent
+};
+
+// Bits of BalanceReloader::reload's changed mask.
+const uint32_t BALANCE_TABLE_TUNING = 1u;
+inline uint32_t balanceUnitTable(int type) { return 1u << (1 + type); }
+inline uint32_t balanceEnemyTable(int type) { return 1u << (1 + UNIT_TYPE_COUNT + type); }
+
+#endif
@@ -0,0 +1,78 @@
+#include "atlas.h"
+#include <rlgl.h>
+#include <algorithm>
+#include "profiler.h"
+
+static const char *spriteFiles[SPRITE_COUNT] = { "unit.png", "alien.png", nullptr };
+const int ATLAS_PAD = 2;        // keeps neighbours from bleeding into each other under filtering
+const int WHITE_BLOCK = 4;
+
+// CPU only: decodes every sprite file and lays them out in one row, white block last.
+static Image packSprites(Rectangle (&rects)[SPRITE_COUNT]) {
+    Image images[SPRITE_COUNT] = {};
+    int width = ATLAS_PAD, height = WHITE_BLOCK + 2*ATLAS_PAD;
+    for (int i = 0; i < SPRITE_COUNT; ++i) {
+        if (!spriteFiles[i]) continue;
+        images[i] = LoadImage(spriteFiles[i]);
+        width += images[i].width + ATLAS_PAD;
+        height = std::max(height, images[i].height + 2*ATLAS_PAD);
+    }
+    width += WHITE_BLOCK + ATLAS_PAD;
+
+    Image sheet = GenImageColor(width, height, BLANK);
+    int x = ATLAS_PAD;
+    for (int i = 0; i < SPRITE_COUNT; ++i) {
+        if (!spriteFiles[i]) continue;
+        Rectangle src{ 0, 0, (float)images[i].width, (float)images[i].height };
+        rects[i] = Rectangle{ (float)x, (float)ATLAS_PAD, src.width, src.height };
+        ImageDraw(&sheet, images[i], src, rects[i], WHITE);
+        x += images[i].width + ATLAS_PAD;
+        UnloadImage(images[i]);
+    }
+    ImageDrawRectangle(&sheet, x, ATLAS_PAD, WHITE_BLOCK, WHITE_BLOCK, WHITE);
+    // Sample the middle of the block so filtering never reaches its edge.
+    rects[SPRITE_WHITE] = Rectangle{ (float)(x + 1), (float)(ATLAS_PAD + 1), (float)(WHITE_BLOCK - 2), (float)(WHITE_BLOCK - 2) };
+    return sheet;
+}
+
+void startSpriteAtlas(SpriteAtlas &atlas) {
+    if (atlas.worker.joinable() || atlas.ready()) return;
+    atlas.decoded = false;
+    // The worker only writes rects, sheet and the decode times, and the main
+    // thread reads none of them until decoded is set.
+    atlas.worker = std::thread([&atlas]() {
+        atlas.decodeStartNs = profilerNowNs();
+        atlas.sheet = packSprites(atlas.rects);
+        atlas.decodeEndNs = profilerNowNs();
+        atlas.decoded.store(true, std::memory_order_release);
+    });
+}
+
+bool finishSpriteAtlas(SpriteAtlas &atlas, bool wait) {
+    if (atlas.ready()) return true;
+    if (!atlas.worker.joinable()) return false;
+    if (!wait && !atlas.decoded.load(std::memory_order_acquire)) return false;
+    atlas.worker.join();
+
+    atlas.uploadStartNs = profilerNowNs();
+    atlas.texture = LoadTextureFromImage(atlas.sheet);
+    UnloadImage(atlas.sheet);
+    atlas.sheet = Image{};
+    SetTextureFilter(atlas.texture, TEXTURE_FILTER_POINT);
+    SetShapesTexture(atlas.texture, atlas.rects[SPRITE_WHITE]);
+    atlas.uploadEndNs = profilerNowNs();
+    return true;
+}
+
+void unloadSpriteAtlas(SpriteAtlas &atlas) {
+    if (atlas.worker.joinable()) {
+        atlas.worker.join();
+        UnloadImage(atlas.sheet);
+        atlas.sheet = Image{};
+    }
+    if (!atlas.ready()) return;
+    // Back to raylib's own 1x1 white texture.
+    SetShapesTexture(Texture2D{ rlGetTextureIdDefault(), 1, 1, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 }, Rectangle{ 0, 0, 1, 1 });
+    UnloadTexture(atlas.texture);
+    atlas.texture = Texture2D{};
+}
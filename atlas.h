@@ -0,0 +1,57 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <raylib.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+enum SpriteId {
+    SPRITE_UNIT = 0,
+    SPRITE_ALIEN,
+    SPRITE_WHITE,       // solid block raylib's shape functions sample from
+    SPRITE_COUNT
+};
+
+// Every world sprite packed into one texture. The shapes texture is pointed at
+// the white block too, so sprites, rectangles and circles all draw from the
+// same texture and the world pass stays in one batch instead of flushing on
+// every texture switch. Entities name their sprite by SpriteId, never by
+// texture, so the atlas can be rebuilt or arrive late without touching them.
+struct SpriteAtlas {
+    Texture2D texture{};
+    Rectangle rects[SPRITE_COUNT] = {};
+
+    const Rectangle &operator[](SpriteId id) const { return rects[id]; }
+    bool ready() const { return texture.id != 0; }
+
+    // When the worker decoded and packed the images, and how long the upload
+    // took, for the startup timeline (profilerNowNs() times).
+    uint64_t decodeStartNs = 0, decodeEndNs = 0;
+    uint64_t uploadStartNs = 0, uploadEndNs = 0;
+
+    SpriteAtlas() = default;
+    SpriteAtlas(const SpriteAtlas &) = delete;
+    SpriteAtlas &operator=(const SpriteAtlas &) = delete;
+    ~SpriteAtlas() { if (worker.joinable()) worker.join(); }
+
+private:
+    friend void startSpriteAtlas(SpriteAtlas &);
+    friend bool finishSpriteAtlas(SpriteAtlas &, bool);
+    friend void unloadSpriteAtlas(SpriteAtlas &);
+    std::thread worker;
+    std::atomic<bool> decoded{false};
+    Image sheet{};      // the packed images, from the worker to the upload
+};
+
+// Loading is split at the GPU: startSpriteAtlas decodes the image files and
+// packs them into one sheet on a worker thread, and needs no window, so it can
+// run while the window opens. finishSpriteAtlas uploads the sheet on the
+// calling thread, which must own the GL context, once the worker is done; with
+// wait it blocks until then, otherwise it returns false while the worker is
+// still going. Once it returns true the atlas is also raylib's shapes texture.
+void startSpriteAtlas(SpriteAtlas &atlas);
+bool finishSpriteAtlas(SpriteAtlas &atlas, bool wait);
+void unloadSpriteAtlas(SpriteAtlas &atlas);
+
+#endif
@@ -0,0 +1,88 @@
+#include "background.h"
+#include "game.h"
+#include <algorithm>
+
+// Half a texel per world unit keeps the whole starfield around 20 MB of tiles;
+// the content is soft enough that bilinear filtering hides it even at max zoom.
+const float BG_TEXELS_PER_UNIT = 0.5f;
+const int BG_TILE_TEXELS = 2048;
+const float BG_MARGIN = 512.0f;     // stars reach 500 px past the map edge
+
+static const Color SKY_TOP = Color{10, 10, 40, 255};
+static const Color SKY_BOTTOM = Color{40, 20, 80, 255};
+
+static inline bool overlaps(const Rectangle &a, const Rectangle &b) {
+    return a.x < b.x + b.width && a.x + a.width > b.x && a.y < b.y + b.height && a.y + a.height > b.y;
+}
+
+// The scene being baked, in world coordinates.
+static void drawSky(float minStarRadius) {
+    DrawRectangleGradientV(-2000, -2000, (int)MAP_WIDTH + 4000, (int)MAP_HEIGHT + 4000, SKY_TOP, SKY_BOTTOM);
+
+    for (int i = 0; i < 300; i++) {
+        int x = (i * 137 + 200) % (int)(MAP_WIDTH + 1000) - 500;
+        int y = (i * 181 + 300) % (int)(MAP_HEIGHT + 1000) - 500;
+        Color starColor = (Color){255, 255, 255, (unsigned char)(80 + (i * 13) % 120)};
+        DrawCircle(x, y, std::max(((i % 3) + 1) * 0.7f, minStarRadius), starColor);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        int x = (i * 89 + 100) % (int)(MAP_WIDTH + 800) - 400;
+        int y = (i * 73 + 150) % (int)(MAP_HEIGHT + 800) - 400;
+        Color cloudColor;
+        if (i % 3 == 0) cloudColor = (Color){80, 30, 120, 25};
+        else if (i % 3 == 1) cloudColor = (Color){30, 80, 120, 20};
+        else cloudColor = (Color){120, 30, 80, 18};
+        DrawCircle(x, y, 80 + (i % 60), cloudColor);
+    }
+}
+
+void bakeBackground(Background &bg) {
+    unloadBackground(bg);
+    bg.world = Rectangle{ -BG_MARGIN, -BG_MARGIN, MAP_WIDTH + 2*BG_MARGIN, MAP_HEIGHT + 2*BG_MARGIN };
+    const float tileWorld = BG_TILE_TEXELS / BG_TEXELS_PER_UNIT;
+
+    for (float ty = bg.world.y; ty < bg.world.y + bg.world.height; ty += tileWorld) {
+        for (float tx = bg.world.x; tx < bg.world.x + bg.world.width; tx += tileWorld) {
+            BackgroundTile tile;
+            tile.world = Rectangle{ tx, ty, std::min(tileWorld, bg.world.x + bg.world.width - tx),
+                                    std::min(tileWorld, bg.world.y + bg.world.height - ty) };
+            tile.target = LoadRenderTexture((int)(tile.world.width * BG_TEXELS_PER_UNIT + 0.5f),
+                                            (int)(tile.world.height * BG_TEXELS_PER_UNIT + 0.5f));
+            SetTextureFilter(tile.target.texture, TEXTURE_FILTER_BILINEAR);
+
+            Camera2D cam{};
+            cam.target = Vector2{ tx, ty };
+            cam.zoom = BG_TEXELS_PER_UNIT;
+            BeginTextureMode(tile.target);
+            ClearBackground(SKY_TOP);
+            BeginMode2D(cam);
+            // Smaller stars would fall between texels and vanish.
+            drawSky(1.0f / BG_TEXELS_PER_UNIT);
+            EndMode2D();
+            EndTextureMode();
+            bg.tiles.push_back(tile);
+        }
+    }
+}
+
+void drawBackground(const Background &bg, const Rectangle &view) {
+    // Only zoomed far out does the view leave the baked area; the bare gradient
+    // covers the rest there.
+    bool inside = view.x >= bg.world.x && view.y >= bg.world.y &&
+                  view.x + view.width <= bg.world.x + bg.world.width &&
+                  view.y + view.height <= bg.world.y + bg.world.height;
+    if (!inside) DrawRectangleGradientV(-2000, -2000, (int)MAP_WIDTH + 4000, (int)MAP_HEIGHT + 4000, SKY_TOP, SKY_BOTTOM);
+
+    for (const BackgroundTile &tile : bg.tiles) {
+        if (!overlaps(tile.world, view)) continue;
+        // Render textures come out upside down.
+        Rectangle src{ 0, 0, (float)tile.target.texture.width, -(float)tile.target.texture.height };
+        DrawTexturePro(tile.target.texture, src, tile.world, Vector2{0, 0}, 0.0f, WHITE);
+    }
+}
+
+void unloadBackground(Background &bg) {
+    for (const BackgroundTile &tile : bg.tiles) UnloadRenderTexture(tile.target);
+    bg.tiles.clear();
+}
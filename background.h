@@ -0,0 +1,25 @@
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+#include <raylib.h>
+#include <vector>
+
+struct BackgroundTile {
+    RenderTexture2D target;
+    Rectangle world;        // area of the map this tile covers
+};
+
+// The sky gradient, stars and nebulae never change, so they are rendered once
+// into world-space tiles and each frame only draws the tiles the camera sees.
+struct Background {
+    std::vector<BackgroundTile> tiles;
+    Rectangle world{};      // union of the tiles
+};
+
+// Needs a window (GL context).
+void bakeBackground(Background &bg);
+// Call inside BeginMode2D with the camera's world-space view.
+void drawBackground(const Background &bg, const Rectangle &view);
+void unloadBackground(Background &bg);
+
+#endif
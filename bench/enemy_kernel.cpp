@@ -0,0 +1,152 @@
+// Enemy update microbenchmark: the old array-of-structs loop from game.cpp
+// against the EnemyStore kernel, over the same swarm, units and ship.
+//
+//   make bench && ./bench/enemy_kernel [enemies...]
+
+#include "../enemies.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+// The enemy record and loop as they were before the SoA split, minus damage.
+struct OldEnemy {
+    int x, y;
+    int width = 32, height = 32;
+    float fx, fy;
+    int hp = 1, maxHp = 1;
+    float moveSpeed, detectionRange, attackRange, shipDetectionRange;
+    float attackDamage, attackCooldown, timeSinceLastAttack = 0.0f;
+    EnemyType type;
+    bool alive = true, showHp = false, prioritizeShip;
+    float avoidUnitsRange;
+};
+
+int oldUpdate(std::vector<OldEnemy> &enemies, const float *unitCX, const float *unitCY, int unitCount,
+              float shipCX, float shipCY, float dt) {
+    int attacks = 0;
+    for (int i = 0; i < (int)enemies.size(); ++i) {
+        OldEnemy &enemy = enemies[i];
+        if (!enemy.alive) continue;
+        enemy.timeSinceLastAttack += dt;
+        float closestDist = 1e9f;
+        int closestUnit = -1;
+        float enemyCX = enemy.fx, enemyCY = enemy.fy;
+        for (int j = 0; j < unitCount; ++j) {
+            float dx = unitCX[j] - enemyCX, dy = unitCY[j] - enemyCY;
+            float dist = sqrtf(dx*dx + dy*dy);
+            if (dist < closestDist) { closestDist = dist; closestUnit = j; }
+        }
+        float dxs = shipCX - enemyCX, dys = shipCY - enemyCY;
+        float distToShip = sqrtf(dxs*dxs + dys*dys);
+        bool shipClose = distToShip <= enemy.attackRange + 10.0f;
+        bool engagingUnit = !shipClose && !enemy.prioritizeShip && (closestUnit >= 0 && closestDist <= enemy.detectionRange);
+        bool engagingShip = shipClose || enemy.prioritizeShip || (!engagingUnit && distToShip <= enemy.shipDetectionRange);
+        if (!engagingUnit && !engagingShip) continue;
+        float tx = engagingUnit ? unitCX[closestUnit] : shipCX;
+        float ty = engagingUnit ? unitCY[closestUnit] : shipCY;
+        float distToTarget = engagingUnit ? closestDist : distToShip;
+        float dx = 0.0f, dy = 0.0f;
+        if (enemy.avoidUnitsRange > 0.0f && closestUnit >= 0 && closestDist < enemy.avoidUnitsRange) {
+            dx = enemyCX - unitCX[closestUnit]; dy = enemyCY - unitCY[closestUnit];
+        } else if (distToTarget > enemy.attackRange) {
+            dx = tx - enemyCX; dy = ty - enemyCY;
+        }
+        float len = sqrtf(dx*dx + dy*dy);
+        if (len > 0.001f) {
+            float step = enemy.moveSpeed * dt;
+            enemy.fx += dx / len * step;
+            enemy.fy += dy / len * step;
+            enemy.x = (int)lroundf(enemy.fx);
+            enemy.y = (int)lroundf(enemy.fy);
+        }
+        if (distToTarget <= enemy.attackRange && enemy.timeSinceLastAttack >= enemy.attackCooldown) {
+            enemy.timeSinceLastAttack = 0.0f;
+            attacks++;
+        }
+    }
+    return attacks;
+}
+
+float frand(unsigned &s, float lo, float hi) {
+    s = s * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(s >> 8) / 16777216.0f;
+}
+
+EnemyNPC makeEnemy(unsigned &s) {
+    EnemyNPC e{};
+    e.x = frand(s, 0.0f, 3500.0f);
+    e.y = frand(s, 0.0f, 3500.0f);
+    e.type = (EnemyType)((s >> 4) % 5);
+    e.moveSpeed = frand(s, 60.0f, 200.0f);
+    e.detectionRange = frand(s, 380.0f, 800.0f);
+    e.attackRange = e.type == ENEMY_SHOOTER ? 320.0f : 100.0f;
+    e.shipDetectionRange = 12000.0f;
+    e.attackDamage = 10.0f;
+    e.attackCooldown = frand(s, 0.8f, 3.5f);
+    e.avoidUnitsRange = ENEMY_TRAITS[e.type].avoidsUnits ? 140.0f : 0.0f;
+    e.crowdWeight = 0.0f;   // the old loop has no separation; this keeps the paths the same
+    return e;
+}
+
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> counts;
+    for (int i = 1; i < argc; ++i) counts.push_back(atoi(argv[i]));
+    if (counts.empty()) counts = { 1000, 10000, 50000 };
+
+    const int unitCount = 6;
+    const float unitCX[unitCount] = { 1700, 1750, 1800, 1700, 1750, 1800 };
+    const float unitCY[unitCount] = { 1650, 1650, 1650, 1700, 1700, 1700 };
+    const float shipX = 1750.0f, shipY = 1750.0f;
+    const float dt = 1.0f / 60.0f;
+    const int ticks = 300;
+
+    printf("%8s %14s %14s %8s\n", "enemies", "aos upd/ms", "soa upd/ms", "speedup");
+    for (int n : counts) {
+        unsigned seed = 12345u;
+        std::vector<OldEnemy> oldEnemies;
+        EnemyStore store;
+        store.reserve(n);
+        // Sorted by type, the way the game spawns them; both loops see the same order.
+        std::vector<EnemyNPC> spawned;
+        for (int i = 0; i < n; ++i) spawned.push_back(makeEnemy(seed));
+        std::stable_sort(spawned.begin(), spawned.end(), [](const EnemyNPC &a, const EnemyNPC &b) { return a.type < b.type; });
+        for (const EnemyNPC &e : spawned) {
+            OldEnemy o;
+            o.fx = e.x; o.fy = e.y;
+            o.x = (int)lroundf(e.x); o.y = (int)lroundf(e.y);
+            o.moveSpeed = e.moveSpeed; o.detectionRange = e.detectionRange;
+            o.attackRange = e.attackRange; o.shipDetectionRange = e.shipDetectionRange;
+            o.attackDamage = e.attackDamage; o.attackCooldown = e.attackCooldown;
+            o.type = e.type; o.prioritizeShip = ENEMY_TRAITS[e.type].prioritizeShip; o.avoidUnitsRange = e.avoidUnitsRange;
+            oldEnemies.push_back(o);
+            store.add(e);
+        }
+
+        using Clock = std::chrono::steady_clock;
+        long oldAttacks = 0, newAttacks = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int t = 0; t < ticks; ++t) oldAttacks += oldUpdate(oldEnemies, unitCX, unitCY, unitCount, shipX, shipY, dt);
+        Clock::time_point t1 = Clock::now();
+        std::vector<EnemyAttack> attacks;
+        for (int t = 0; t < ticks; ++t) {
+            attacks.clear();
+            updateEnemyKernel(store, unitCX, unitCY, unitCount, shipX, shipY, nullptr, dt, attacks);
+            newAttacks += (long)attacks.size();
+        }
+        Clock::time_point t2 = Clock::now();
+
+        double oldMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double newMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        double updates = (double)n * ticks;
+        printf("%8d %14.0f %14.0f %7.2fx\n", n, updates / oldMs, updates / newMs, oldMs / newMs);
+        if (oldAttacks != newAttacks) printf("  note: attack counts differ (%ld vs %ld)\n", oldAttacks, newAttacks);
+    }
+    return 0;
+}
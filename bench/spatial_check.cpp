@@ -0,0 +1,122 @@
+// PointGrid queries against a linear scan over the same points: nearest,
+// queryRadius and queryRect, on uniform, clustered, stacked and collinear
+// point sets, at several cell sizes, from query points inside and outside the
+// points' bounds. Prints the first few mismatches and exits non-zero on any.
+//
+//   make bench && ./bench/spatial_check [rounds]
+
+#include "../spatial.h"
+#include "../rng.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+enum Layout { LAYOUT_UNIFORM, LAYOUT_CLUSTERED, LAYOUT_STACKED, LAYOUT_LINE, LAYOUT_COUNT };
+const char *LAYOUT_NAMES[LAYOUT_COUNT] = { "uniform", "clustered", "stacked", "line" };
+
+int failures = 0;
+
+void fail(const char *query, Layout layout, int count, float cell, float x, float y) {
+    if (failures++ < 10) {
+        fprintf(stderr, "mismatch: %s on %d %s points, cell %.0f, at (%.1f, %.1f)\n",
+                query, count, LAYOUT_NAMES[layout], cell, x, y);
+    }
+}
+
+void makePoints(Rng &rng, Layout layout, int count, std::vector<float> &xs, std::vector<float> &ys) {
+    xs.resize(count); ys.resize(count);
+    for (int i = 0; i < count; ++i) {
+        switch (layout) {
+            case LAYOUT_UNIFORM:
+                xs[i] = rng.range(0.0f, 3500.0f); ys[i] = rng.range(0.0f, 3500.0f);
+                break;
+            case LAYOUT_CLUSTERED: {
+                int c = rng.range(0, 3);
+                xs[i] = 400.0f + c * 800.0f + rng.range(-60.0f, 60.0f);
+                ys[i] = 1750.0f + rng.range(-60.0f, 60.0f);
+                break;
+            }
+            case LAYOUT_STACKED:
+                // Whole-number coordinates on a small patch, so distances tie.
+                xs[i] = (float)rng.range(100, 104); ys[i] = (float)rng.range(100, 104);
+                break;
+            default:
+                xs[i] = rng.range(0.0f, 3500.0f); ys[i] = 900.0f;
+                break;
+        }
+    }
+}
+
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    const int COUNTS[] = { 0, 1, 5, 64, 1000 };
+    const float CELLS[] = { 16.0f, 64.0f, 256.0f };
+    Rng rng;
+    rng.seed(18, 1);
+    PointGrid grid;
+    std::vector<float> xs, ys;
+    std::vector<int> got, want;
+    long long queries = 0;
+
+    for (int layout = 0; layout < LAYOUT_COUNT; ++layout) {
+        for (int count : COUNTS) {
+            for (float cell : CELLS) {
+                makePoints(rng, (Layout)layout, count, xs, ys);
+                grid.init(cell);
+                grid.build(xs.data(), ys.data(), count);
+                for (int q = 0; q < rounds; ++q) {
+                    // Some queries start well outside the points' bounds.
+                    float x = rng.range(-500.0f, 4000.0f), y = rng.range(-500.0f, 4000.0f);
+                    if (q % 4 == 0 && count > 0) { int i = rng.range(0, count - 1); x = xs[i]; y = ys[i]; }
+                    float r = q % 8 == 0 ? 0.0f : rng.range(0.0f, q % 3 == 0 ? 5000.0f : 300.0f);
+                    queries += 3;
+
+                    // nearest: strict < over ids in order, within r inclusive.
+                    int bestId = -1;
+                    float best = r * r;
+                    for (int i = 0; i < count; ++i) {
+                        float dx = xs[i] - x, dy = ys[i] - y, d2 = dx*dx + dy*dy;
+                        if (d2 < best || (d2 == best && bestId < 0)) { best = d2; bestId = i; }
+                    }
+                    float gotD2 = 0.0f;
+                    int gotId = grid.nearest(x, y, r, &gotD2);
+                    if (gotId != bestId || (gotId >= 0 && gotD2 != best)) fail("nearest", (Layout)layout, count, cell, x, y);
+
+                    // queryRadius: every point within r, each once, with its d2.
+                    want.clear(); got.clear();
+                    for (int i = 0; i < count; ++i) {
+                        float dx = xs[i] - x, dy = ys[i] - y;
+                        if (dx*dx + dy*dy <= r * r) want.push_back(i);
+                    }
+                    bool d2Ok = true;
+                    grid.queryRadius(x, y, r, [&](int id, float d2) {
+                        float dx = xs[id] - x, dy = ys[id] - y;
+                        if (d2 != dx*dx + dy*dy) d2Ok = false;
+                        got.push_back(id);
+                    });
+                    std::sort(got.begin(), got.end());
+                    if (got != want || !d2Ok) fail("queryRadius", (Layout)layout, count, cell, x, y);
+
+                    // queryRect: every point inside, edges included, each once.
+                    Rectangle rect{ x, y, rng.range(0.0f, 600.0f), rng.range(0.0f, 600.0f) };
+                    want.clear(); got.clear();
+                    for (int i = 0; i < count; ++i) {
+                        if (xs[i] >= rect.x && xs[i] <= rect.x + rect.width && ys[i] >= rect.y && ys[i] <= rect.y + rect.height)
+                            want.push_back(i);
+                    }
+                    grid.queryRect(rect, [&](int id) { got.push_back(id); });
+                    std::sort(got.begin(), got.end());
+                    if (got != want) fail("queryRect", (Layout)layout, count, cell, x, y);
+                }
+            }
+        }
+    }
+
+    printf("%lld queries, %d mismatches\n", queries, failures);
+    return failures ? 1 : 0;
+}
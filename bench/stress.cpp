@@ -0,0 +1,254 @@
+// Stress scenarios: builds a crowded world directly (no menu, no waves), runs a
+// fixed number of ticks and reports per-tick timings as JSON.
+//
+//   make bench && ./bench/stress [--ticks N] [--threads N] [--scenario NAME] [--out FILE]
+//   ./bench/stress --snapshot FILE     runs a saved game (--save-snapshot, F5) instead
+
+#include "../game.h"
+#include "../jobs.h"
+#include "../snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+struct EnemyMix {
+    EnemyType type;
+    int count;
+};
+
+struct Scenario {
+    const char *name;
+    const char *description;
+    int wave;                   // for enemy stats
+    std::vector<EnemyMix> enemies;
+    float ringMin, ringMax;     // spawn distance from the ship
+    int bullets;                // in flight at tick 0
+    int rocks;
+    bool heavyCluster;          // pack the enemies in front of the Heavy instead of a ring
+    int army = UNIT_COUNT;
+};
+
+const float TAU = 6.28318530718f;
+
+std::vector<Scenario> scenarios() {
+    return {
+        { "fast_swarm", "late-wave swarm of ENEMY_FAST closing on the ship from every side", 40,
+          { { ENEMY_FAST, 2000 } }, 500.0f, 1600.0f, 300, 20, false },
+        { "siege_ring", "ring of ENEMY_SIEGE kiting the squad at avoidUnitsRange while shelling the ship", 30,
+          { { ENEMY_SIEGE, 400 } }, 260.0f, 420.0f, 100, 10, false },
+        { "heavy_spray", "Heavy unit spraying into a dense mixed cluster with bullets already in flight", 25,
+          { { ENEMY_GRUNT, 900 }, { ENEMY_TANK, 300 } }, 0.0f, 160.0f, 1500, 10, true },
+        { "mixed_wave", "wave-40 style mix of every enemy type across the whole map", 40,
+          { { ENEMY_GRUNT, 600 }, { ENEMY_FAST, 330 }, { ENEMY_TANK, 170 }, { ENEMY_SHOOTER, 70 }, { ENEMY_SIEGE, 30 } },
+          300.0f, 1700.0f, 200, 20, false },
+        { "big_army", "full-size army on rings round the ship against a mixed wave", 30,
+          { { ENEMY_GRUNT, 600 }, { ENEMY_FAST, 300 }, { ENEMY_SHOOTER, 60 }, { ENEMY_SIEGE, 40 } },
+          700.0f, 1700.0f, 200, 20, false, MAX_ARMY_SIZE },
+    };
+}
+
+void buildScenario(Game &game, const Scenario &sc, uint64_t seed) {
+    game.difficulty = DIFF_NORMAL;
+    game.seed = seed;
+    game.armySize = sc.army;
+    startNewGame(game);
+    game.shipInvulnerable = true;
+    game.currentWave = sc.wave;
+    Rng rng;
+    rng.seed(seed, 99);
+
+    const Ship &ship = game.playerShip;
+    Vector2 center{ ship.x, ship.y };
+    if (sc.heavyCluster) {
+        // Heavy stands off to the right of the ship, the cluster just inside its range.
+        Unit &heavy = game.units[UNIT_HEAVY];
+        heavy.fx = ship.x + 300.0f; heavy.fy = ship.y;
+        heavy.x = (int)heavy.fx; heavy.y = (int)heavy.fy;
+        heavy.prevFx = heavy.fx; heavy.prevFy = heavy.fy;
+        game.unitPointsDirty = true;
+        center = Vector2{ heavy.fx + heavy.width/2.0f + 260.0f, heavy.fy + heavy.height/2.0f };
+    }
+
+    game.enemies.clear();
+    for (const EnemyMix &mix : sc.enemies) {
+        for (int i = 0; i < mix.count; ++i) {
+            EnemyNPC e = makeEnemy(game.archetypes, mix.type, sc.wave, 1.0f);
+            float a = rng.range(0.0f, TAU);
+            float d = rng.range(sc.ringMin, sc.ringMax);
+            e.x = ClampVal(center.x + cosf(a) * d, 20.0f, MAP_WIDTH - 20.0f);
+            e.y = ClampVal(center.y + sinf(a) * d, 20.0f, MAP_HEIGHT - 20.0f);
+            game.enemies.add(e);
+        }
+    }
+    game.enemiesAlive = game.enemies.size();
+    game.enemyPointsDirty = true;
+
+    game.rocks.clear();
+    for (int i = 0; i < sc.rocks; ++i) {
+        Rock r{};
+        r.width = 48; r.height = 48;
+        r.x = rng.range(200, (int)MAP_WIDTH - 200);
+        r.y = rng.range(200, (int)MAP_HEIGHT - 200);
+        r.hp = r.maxHp = rng.range(160, 260);
+        game.rocks.add(r);
+    }
+    game.rockGridDirty = true;
+    game.shipFlowDirty = true;
+    game.rockAssign.rocksSpawned();
+
+    game.bullets.clear();
+    for (int i = 0; i < sc.bullets; ++i) {
+        Bullet b{};
+        float a = rng.range(0.0f, TAU);
+        float d = rng.range(0.0f, 200.0f);
+        // Fired from around the squad toward the enemies' spawn center.
+        b.x = ship.x + cosf(a) * d; b.y = ship.y + sinf(a) * d;
+        if (sc.heavyCluster) { b.x = game.units[UNIT_HEAVY].fx + rng.range(0.0f, 40.0f); b.y = game.units[UNIT_HEAVY].fy + rng.range(0.0f, 60.0f); }
+        float tx = center.x + rng.range(-sc.ringMax, sc.ringMax), ty = center.y + rng.range(-sc.ringMax, sc.ringMax);
+        float dx = tx - b.x, dy = ty - b.y, len = sqrtf(dx*dx + dy*dy);
+        if (len < 1.0f) { dx = 1.0f; dy = 0.0f; len = 1.0f; }
+        b.speed = game.archetypes.tuning.bulletSpeed;
+        b.vx = dx / len * b.speed; b.vy = dy / len * b.speed;
+        b.prevX = b.x; b.prevY = b.y;
+        b.damage = 8;
+        b.unitIndex = UNIT_HEAVY;
+        b.active = true;
+        game.bullets.add(b);
+    }
+}
+
+long peakRssKb() {
+#if !defined(_WIN32)
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+#if defined(__APPLE__)
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+// s as a quoted JSON string. Snapshot paths may hold quotes or backslashes
+// (Windows separators), and anything below 0x20 has to be escaped too.
+void writeJsonString(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+double percentile(std::vector<double> sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t idx = (size_t)std::min<double>((double)sorted.size() - 1, std::floor(p * (sorted.size() - 1) + 0.5));
+    return sorted[idx];
+}
+
+}
+
+int main(int argc, char **argv) {
+    int ticks = 3000;
+    int threads = 1;
+    uint64_t seed = 1;
+    const char *only = nullptr;
+    const char *outPath = nullptr;
+    const char *snapshotPath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--ticks") == 0 && hasValue) ticks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue) seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--scenario") == 0 && hasValue) only = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && hasValue) outPath = argv[++i];
+        else if (strcmp(argv[i], "--snapshot") == 0 && hasValue) snapshotPath = argv[++i];
+        else if (strcmp(argv[i], "--list") == 0) {
+            for (const Scenario &sc : scenarios()) printf("%-12s %s\n", sc.name, sc.description);
+            return 0;
+        } else {
+            fprintf(stderr, "usage: %s [--ticks N] [--threads N] [--seed N] [--scenario NAME | --snapshot FILE] [--out FILE] [--list]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (ticks < 1) ticks = 1;
+    if (threads < 1) threads = 1;
+    gJobs.start(threads - 1);
+
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) { fprintf(stderr, "cannot open %s\n", outPath); return 1; }
+
+    const float dt = 1.0f / (float)SIM_TICK_RATE;
+    fprintf(out, "{\n  \"tick_rate\": %d,\n  \"ticks\": %d,\n  \"threads\": %d,\n  \"seed\": %llu,\n  \"scenarios\": [",
+            SIM_TICK_RATE, ticks, gJobs.threadCount(), (unsigned long long)seed);
+    bool first = true;
+    auto run = [&](Game &game, const char *name) {
+        int startEnemies = game.enemies.size(), startBullets = game.bullets.size(), startRocks = game.rocks.size();
+
+        std::vector<double> tickNs;
+        tickNs.reserve(ticks);
+        using Clock = std::chrono::steady_clock;
+        Clock::time_point t0 = Clock::now();
+        for (int t = 0; t < ticks; ++t) {
+            Clock::time_point a = Clock::now();
+            updateGame(game, dt);
+            Clock::time_point b = Clock::now();
+            tickNs.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count());
+        }
+        double totalNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+        std::sort(tickNs.begin(), tickNs.end());
+
+        int aliveEnd = game.enemies.size();
+
+        fprintf(out, "%s\n    {\n", first ? "" : ",");
+        fprintf(out, "      \"name\": ");
+        writeJsonString(out, name);
+        fprintf(out, ",\n      \"wave\": %d,\n", game.currentWave);
+        fprintf(out, "      \"enemies\": %d,\n      \"bullets\": %d,\n      \"rocks\": %d,\n", startEnemies, startBullets, startRocks);
+        fprintf(out, "      \"ns_per_tick\": %.0f,\n", totalNs / ticks);
+        fprintf(out, "      \"p50_ns\": %.0f,\n", percentile(tickNs, 0.50));
+        fprintf(out, "      \"p99_ns\": %.0f,\n", percentile(tickNs, 0.99));
+        fprintf(out, "      \"max_ns\": %.0f,\n", tickNs.back());
+        fprintf(out, "      \"enemies_alive_at_end\": %d,\n", aliveEnd);
+        // Process-wide high-water mark; run one --scenario at a time for a clean figure.
+        fprintf(out, "      \"peak_rss_kb\": %ld\n    }", peakRssKb());
+        first = false;
+    };
+    bool found = false;
+    if (snapshotPath) {
+        Game game;
+        std::string error;
+        if (!loadSnapshot(snapshotPath, game, error)) {
+            fprintf(stderr, "failed to load snapshot %s: %s\n", snapshotPath, error.c_str());
+            return 1;
+        }
+        run(game, snapshotPath);
+        found = true;
+    } else {
+        for (const Scenario &sc : scenarios()) {
+            if (only && strcmp(only, sc.name) != 0) continue;
+            found = true;
+            Game game;
+            buildScenario(game, sc, seed);
+            run(game, sc.name);
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (outPath) fclose(out);
+    if (!found) { fprintf(stderr, "unknown scenario %s (see --list)\n", only); return 1; }
+    return 0;
+}
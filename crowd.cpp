@@ -0,0 +1,115 @@
+#include "crowd.h"
+#include <algorithm>
+#include <cmath>
+
+// Agents on the same spot have no direction between them. They split along a
+// fixed angle picked by the lower index, opposite ways, so the result does not
+// depend on which of the two is asking.
+static const float GOLDEN_ANGLE = 2.39996323f;
+static const float MIN_SPLIT = 0.0001f;
+void CrowdGrid::build(const CrowdAgents &a) {
+    maxRadius = 0.0f;
+    bool yields = false;
+    for (int i = 0; i < a.count; ++i) { maxRadius = std::max(maxRadius, a.radius[i]); yields |= a.weight[i] > 0.0f; }
+    if (!yields) { grid.clear(); radius.clear(); return; }
+    float cell = std::max(2.0f * maxRadius, 1.0f);
+    if (grid.cellSize != cell) grid.init(cell);
+    grid.build(a.x, a.y, a.count);
+    radius.resize(a.count + POINT_GRID_PAD);
+    for (int k = 0; k < a.count; ++k) radius[k] = a.radius[grid.ids[k]];
+    std::fill(radius.begin() + a.count, radius.end(), 0.0f);
+}
+
+// Adds the push from packed neighbor k onto agent i, which sits at (x, y) and
+// is heading along the unit vector (hx, hy): the push itself in (sx, sy), and
+// in block how much of it comes from neighbors ahead, against the heading.
+static inline void pushFrom(const CrowdGrid &g, int i, float x, float y, float r, float hx, float hy, int k,
+                            float &sx, float &sy, float &block) {
+    float dx = x - g.grid.px[k], dy = y - g.grid.py[k], d2 = dx*dx + dy*dy, reach = r + g.radius[k];
+    if (d2 >= reach * reach) return;
+    float d = sqrtf(d2);
+    if (d > MIN_SPLIT) {
+        float f = 0.5f * (reach - d) / d;
+        sx += dx * f; sy += dy * f;
+        block += f * std::max(0.0f, -(dx * hx + dy * hy));
+        return;
+    }
+    int j = g.grid.ids[k];
+    if (j == i) return;
+    float overlap = 0.5f * (reach - d), angle = GOLDEN_ANGLE * (float)std::min(i, j), side = i < j ? 1.0f : -1.0f;
+    sx += cosf(angle) * side * overlap;
+    sy += sinf(angle) * side * overlap;
+}
+
+void crowdSeparation(const CrowdGrid &g, const CrowdAgents &a, int begin, int end, int phase, float dt,
+                     float *pushX, float *pushY, float *blocked) {
+    const PointGrid &grid = g.grid;
+    const int *cellStart = grid.cellStart.data(), *ids = grid.ids.data();
+#ifdef SPATIAL_SSE2
+    const float *gx = grid.px.data(), *gy = grid.py.data(), *gr = g.radius.data();
+    const __m128 half = _mm_set1_ps(0.5f), minSplit = _mm_set1_ps(MIN_SPLIT), zero = _mm_setzero_ps();
+    const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+#endif
+    // Walking the agents in grid order keeps neighboring searches on the same
+    // stretch of the packed arrays.
+    for (int p = begin; p < end; ++p) {
+        int i = ids[p];
+        if (i % CROWD_SLICES != phase) continue;
+        pushX[i] = 0.0f; pushY[i] = 0.0f; blocked[i] = 0.0f;
+        float w = a.weight[i], r = g.radius[p];
+        if (w <= 0.0f) continue;
+        float x = grid.px[p], y = grid.py[p], sx = 0.0f, sy = 0.0f, block = 0.0f, search = r + g.maxRadius;
+        float mx = a.moveX ? a.moveX[i] : 0.0f, my = a.moveY ? a.moveY[i] : 0.0f, step = sqrtf(mx*mx + my*my);
+        float hx = step > 0.0f ? mx / step : 0.0f, hy = step > 0.0f ? my / step : 0.0f;
+        int x0 = grid.colOf(x - search), x1 = grid.colOf(x + search);
+        int y0 = grid.rowOf(y - search), y1 = grid.rowOf(y + search);
+#ifdef SPATIAL_SSE2
+        const __m128 qx = _mm_set1_ps(x), qy = _mm_set1_ps(y), qr = _mm_set1_ps(r);
+        const __m128 nhx = _mm_set1_ps(-hx), nhy = _mm_set1_ps(-hy);
+        __m128 vx = zero, vy = zero, vb = zero;
+#endif
+        for (int cy = y0; cy <= y1; ++cy) {
+            // A row's cells are back to back in the packed arrays.
+            int k = cellStart[cy * grid.cols + x0], stop = cellStart[cy * grid.cols + x1 + 1];
+#ifdef SPATIAL_SSE2
+            for (; k < stop; k += 4) {
+                __m128 dx = _mm_sub_ps(qx, _mm_loadu_ps(gx + k)), dy = _mm_sub_ps(qy, _mm_loadu_ps(gy + k));
+                __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+                __m128 reach = _mm_add_ps(qr, _mm_loadu_ps(gr + k));
+                __m128 inRow = _mm_castsi128_ps(_mm_cmplt_epi32(lanes, _mm_set1_epi32(stop - k)));
+                __m128 hit = _mm_and_ps(inRow, _mm_cmplt_ps(d2, _mm_mul_ps(reach, reach)));
+                int mask = _mm_movemask_ps(hit);
+                if (!mask) continue;
+                __m128 d = _mm_sqrt_ps(d2);
+                __m128 apart = _mm_and_ps(hit, _mm_cmpgt_ps(d, minSplit));
+                __m128 f = _mm_and_ps(apart, _mm_div_ps(_mm_mul_ps(half, _mm_sub_ps(reach, d)), _mm_max_ps(d, minSplit)));
+                vx = _mm_add_ps(vx, _mm_mul_ps(dx, f));
+                vy = _mm_add_ps(vy, _mm_mul_ps(dy, f));
+                __m128 ahead = _mm_add_ps(_mm_mul_ps(dx, nhx), _mm_mul_ps(dy, nhy));
+                vb = _mm_add_ps(vb, _mm_mul_ps(f, _mm_max_ps(ahead, zero)));
+                // The agent itself and anything right on top of it.
+                int same = mask & ~_mm_movemask_ps(apart);
+                for (int l = 0; l < 4; ++l) if (same & (1 << l)) pushFrom(g, i, x, y, r, hx, hy, k + l, sx, sy, block);
+            }
+#else
+            for (; k < stop; ++k) pushFrom(g, i, x, y, r, hx, hy, k, sx, sy, block);
+#endif
+        }
+#ifdef SPATIAL_SSE2
+        float lx[4], ly[4], lb[4];
+        _mm_storeu_ps(lx, vx); _mm_storeu_ps(ly, vy); _mm_storeu_ps(lb, vb);
+        sx += (lx[0] + lx[1]) + (lx[2] + lx[3]);
+        sy += (ly[0] + ly[1]) + (ly[2] + ly[3]);
+        block += (lb[0] + lb[1]) + (lb[2] + lb[3]);
+#endif
+        // Capped at the radius before the weight, so a deep pile-up spreads over
+        // a few ticks instead of flinging agents across the map. The weight
+        // covers the ticks until the slice comes round again, spread evenly.
+        float k = std::min(1.0f, w * dt * CROWD_SLICES) / CROWD_SLICES, len2 = sx*sx + sy*sy;
+        if (len2 > r * r) { float s = r / sqrtf(len2); sx *= s; sy *= s; }
+        pushX[i] = sx * k; pushY[i] = sy * k;
+        // Overlap with whoever is ahead takes back as much of the step, so the
+        // agent waits behind them rather than pressing into the crowd.
+        blocked[i] = step > 0.0f ? std::min(1.0f, block / step) : 0.0f;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef CROWD_H
+#define CROWD_H
+
+#include <vector>
+#include "spatial.h"
+
+// Separation steering for one side of the fight. Every agent has a radius (the
+// room it wants around its center) and a weight (how fast it gives way, as the
+// share of an overlap it clears per second). Two agents closer than the sum of
+// their radii each move away from the other by half the overlap, scaled by
+// their own weight. An agent overlapping neighbors ahead of the step it just
+// took gives up as much of the step, so the ones behind a blocked front wait
+// instead of squeezing it. Neighbors come from a grid of the same centers, so
+// a pass costs O(agents * neighbors) rather than O(agents^2).
+//
+// Only one slice of the agents looks at its neighbors each tick, by index mod
+// CROWD_SLICES; the push and block it finds are kept per agent and applied on
+// every tick until its slice comes round again.
+const int CROWD_SLICES = 4;
+
+struct CrowdAgents {
+    const float *x, *y;
+    const float *moveX, *moveY; // this tick's step already taken, or null
+    const float *radius;
+    const float *weight;        // per second; 0 never moves
+    int count;
+};
+
+// Agent centers with their radii packed alongside, so the pass reads
+// neighbors straight out of the grid's arrays. Cells are at least as wide as
+// the biggest pair's reach, so a search never spans more than 3 rows.
+struct CrowdGrid {
+    PointGrid grid;
+    std::vector<float> radius;  // packed and padded like grid.px
+    float maxRadius = 0.0f;
+
+    // Left empty when no agent ever gives way.
+    void build(const CrowdAgents &agents);
+};
+
+// For the agents in slice phase among those packed at [begin, end) of the
+// grid (all of them for 0, grid.grid.size()), writes the push to apply on
+// each tick (pushX/pushY) and the share of each tick's step to give up
+// (block); the others keep theirs. The grid must be built from the same
+// agents. Reads only the agents and the grid, so ranges can run on any thread
+// in any order with the same result.
+void crowdSeparation(const CrowdGrid &grid, const CrowdAgents &agents, int begin, int end, int phase, float dt,
+                     float *pushX, float *pushY, float *block);
+
+#endif
@@ -0,0 +1,345 @@
+#include "enemies.h"
+#include "jobs.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ENEMY_KERNEL_SSE2 1
+#endif
+
+void EnemyStore::clear() {
+    x.clear(); y.clear();
+    moveSpeed.clear(); timeSinceLastAttack.clear(); attackCooldown.clear();
+    attackRange.clear(); detectionRange.clear(); shipDetectionRange.clear(); avoidUnitsRange.clear();
+    crowdRadius.clear(); crowdWeight.clear();
+    crowdPushX.clear(); crowdPushY.clear(); crowdBlock.clear();
+    alive.clear(); type.clear();
+    hp.clear(); maxHp.clear(); showHp.clear(); attackDamage.clear();
+    prevX.clear(); prevY.clear();
+    slots.clear();
+    crowdPhase = 0;
+}
+
+void EnemyStore::reserve(int n) {
+    x.reserve(n); y.reserve(n);
+    moveSpeed.reserve(n); timeSinceLastAttack.reserve(n); attackCooldown.reserve(n);
+    attackRange.reserve(n); detectionRange.reserve(n); shipDetectionRange.reserve(n); avoidUnitsRange.reserve(n);
+    crowdRadius.reserve(n); crowdWeight.reserve(n);
+    crowdPushX.reserve(n); crowdPushY.reserve(n); crowdBlock.reserve(n);
+    alive.reserve(n); type.reserve(n);
+    hp.reserve(n); maxHp.reserve(n); showHp.reserve(n); attackDamage.reserve(n);
+    prevX.reserve(n); prevY.reserve(n);
+    slots.reserve(n);
+}
+
+EntityId EnemyStore::add(const EnemyNPC &e) {
+    x.push_back(e.x); y.push_back(e.y);
+    moveSpeed.push_back(e.moveSpeed);
+    timeSinceLastAttack.push_back(0.0f);
+    attackCooldown.push_back(e.attackCooldown);
+    attackRange.push_back(e.attackRange);
+    detectionRange.push_back(e.detectionRange);
+    shipDetectionRange.push_back(e.shipDetectionRange);
+    avoidUnitsRange.push_back(e.avoidUnitsRange);
+    crowdRadius.push_back(e.crowdRadius); crowdWeight.push_back(e.crowdWeight);
+    crowdPushX.push_back(0.0f); crowdPushY.push_back(0.0f); crowdBlock.push_back(0.0f);
+    alive.push_back(1);
+    type.push_back((uint8_t)e.type);
+    hp.push_back(e.hp); maxHp.push_back(e.maxHp);
+    showHp.push_back(0);
+    attackDamage.push_back(e.attackDamage);
+    prevX.push_back(e.x); prevY.push_back(e.y);
+    return slots.insert();
+}
+
+void EnemyStore::compact() {
+    int n = slots.compact(size(), [&](int i) { return !alive[i]; }, [&](int from, int to) {
+        x[to] = x[from]; y[to] = y[from];
+        moveSpeed[to] = moveSpeed[from]; timeSinceLastAttack[to] = timeSinceLastAttack[from];
+        attackCooldown[to] = attackCooldown[from]; attackRange[to] = attackRange[from];
+        detectionRange[to] = detectionRange[from]; shipDetectionRange[to] = shipDetectionRange[from];
+        avoidUnitsRange[to] = avoidUnitsRange[from];
+        crowdRadius[to] = crowdRadius[from]; crowdWeight[to] = crowdWeight[from];
+        crowdPushX[to] = crowdPushX[from]; crowdPushY[to] = crowdPushY[from]; crowdBlock[to] = crowdBlock[from];
+        alive[to] = alive[from]; type[to] = type[from];
+        hp[to] = hp[from]; maxHp[to] = maxHp[from]; showHp[to] = showHp[from];
+        attackDamage[to] = attackDamage[from];
+        prevX[to] = prevX[from]; prevY[to] = prevY[from];
+    });
+    x.resize(n); y.resize(n);
+    moveSpeed.resize(n); timeSinceLastAttack.resize(n); attackCooldown.resize(n);
+    attackRange.resize(n); detectionRange.resize(n); shipDetectionRange.resize(n); avoidUnitsRange.resize(n);
+    crowdRadius.resize(n); crowdWeight.resize(n);
+    crowdPushX.resize(n); crowdPushY.resize(n); crowdBlock.resize(n);
+    alive.resize(n); type.resize(n);
+    hp.resize(n); maxHp.resize(n); showHp.resize(n); attackDamage.resize(n);
+    prevX.resize(n); prevY.resize(n);
+}
+
+// Up to this many units one SSE2 scan over all of them beats a grid lookup per enemy.
+static const int UNIT_SCAN_MAX = 32;
+
+// Pass 1 for a single enemy: nearest unit center by squared distance.
+static inline void nearestUnitScalar(EnemyStore &es, int i, const float *unitCX, const float *unitCY, int unitCount) {
+    float ex = es.x[i], ey = es.y[i];
+    float best = FLT_MAX, bx = 0.0f, by = 0.0f;
+    int bestJ = -1;
+    for (int j = 0; j < unitCount; ++j) {
+        float dx = unitCX[j] - ex, dy = unitCY[j] - ey;
+        float d2 = dx*dx + dy*dy;
+        if (d2 < best) { best = d2; bestJ = j; bx = unitCX[j]; by = unitCY[j]; }
+    }
+    es.nearestD2[i] = best; es.nearestUnit[i] = bestJ;
+    es.nearestUX[i] = bx; es.nearestUY[i] = by;
+}
+
+// How far away the nearest unit can still change what an enemy of the type
+// does: its detection range unless it only goes for the ship, and its avoid
+// range if it backs off from units.
+template <int T>
+static inline float unitReach(const EnemyStore &es, int i) {
+    constexpr EnemyTraits traits = ENEMY_TRAITS[T];
+    float detect = traits.prioritizeShip ? 0.0f : es.detectionRange[i];
+    return traits.avoidsUnits ? std::max(detect, es.avoidUnitsRange[i]) : detect;
+}
+
+// Pass 1 for a single enemy with a big army: the unit grid. Past unitReach the
+// nearest unit changes nothing, so the search stops there (with a little slack
+// for the sqrt in pass 2) and finding nothing reads as no unit.
+template <int T>
+static inline void nearestUnitIndexed(EnemyStore &es, int i, const float *unitCX, const float *unitCY) {
+    float reach = unitReach<T>(es, i) * 1.001f + 1.0f;
+    float d2 = FLT_MAX;
+    int j = es.unitIndex.nearest(es.x[i], es.y[i], reach, &d2);
+    es.nearestD2[i] = j >= 0 ? d2 : FLT_MAX; es.nearestUnit[i] = j;
+    es.nearestUX[i] = j >= 0 ? unitCX[j] : 0.0f; es.nearestUY[i] = j >= 0 ? unitCY[j] : 0.0f;
+}
+
+// Pass 2 for a single enemy of type T. Written as straight-line selects so it
+// matches the SSE2 lanes below bit for bit. Heading for the ship follows the
+// flow field where its cell has a direction and goes straight where the ship is
+// in sight.
+template <int T>
+static inline void stepEnemyScalar(EnemyStore &es, int i, float shipX, float shipY, const FlowField *flow, float dt) {
+    constexpr EnemyTraits traits = ENEMY_TRAITS[T];
+    float ex = es.x[i], ey = es.y[i];
+    float tsla = es.timeSinceLastAttack[i] + dt;
+    float closestDist = sqrtf(es.nearestD2[i]);
+    int closest = es.nearestUnit[i];
+    float ux = es.nearestUX[i], uy = es.nearestUY[i];
+    float dxs = shipX - ex, dys = shipY - ey;
+    float distToShip = sqrtf(dxs*dxs + dys*dys);
+    float range = es.attackRange[i];
+    float fx = 0.0f, fy = 0.0f;
+    if (flow) { int c = flow->cellAt(ex, ey); fx = flow->dirX[c]; fy = flow->dirY[c]; }
+    bool onFlow = fx != 0.0f || fy != 0.0f;
+    float shipSX = onFlow ? fx * distToShip : dxs;
+    float shipSY = onFlow ? fy * distToShip : dys;
+
+    bool hasUnit = closest >= 0;
+    bool shipClose = distToShip <= range + 10.0f;
+    bool engagingUnit = !traits.prioritizeShip && !shipClose && hasUnit && closestDist <= es.detectionRange[i];
+    bool engagingShip = traits.prioritizeShip || shipClose || (!engagingUnit && distToShip <= es.shipDetectionRange[i]);
+    bool active = engagingUnit || engagingShip;
+    float distToTarget = engagingUnit ? closestDist : distToShip;
+
+    bool avoid = traits.avoidsUnits && hasUnit && closestDist < es.avoidUnitsRange[i];
+    float sx = avoid ? (ex - ux) : (engagingUnit ? (ux - ex) : shipSX);
+    float sy = avoid ? (ey - uy) : (engagingUnit ? (uy - ey) : shipSY);
+    float len = avoid ? closestDist : distToTarget;
+    bool moves = active && (avoid || distToTarget > range) && len > 0.001f;
+    float k = moves ? (es.moveSpeed[i] * dt) / len : 0.0f;
+    es.moveX[i] = sx * k; es.moveY[i] = sy * k;
+    es.x[i] = ex + es.moveX[i];
+    es.y[i] = ey + es.moveY[i];
+
+    bool attacks = active && distToTarget <= range && tsla >= es.attackCooldown[i];
+    es.attackTarget[i] = attacks ? (engagingUnit ? closest : ENEMY_TARGET_SHIP) : -1;
+    es.timeSinceLastAttack[i] = attacks ? 0.0f : tsla;
+}
+
+#ifdef ENEMY_KERNEL_SSE2
+static inline __m128 sel(__m128 m, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+static inline __m128i seli(__m128 m, __m128i a, __m128i b) {
+    __m128i mi = _mm_castps_si128(m);
+    return _mm_or_si128(_mm_and_si128(mi, a), _mm_andnot_si128(mi, b));
+}
+
+static void nearestUnit4(EnemyStore &es, int i, const float *unitCX, const float *unitCY, int unitCount) {
+    __m128 ex = _mm_loadu_ps(&es.x[i]), ey = _mm_loadu_ps(&es.y[i]);
+    __m128 best = _mm_set1_ps(FLT_MAX), bx = _mm_setzero_ps(), by = _mm_setzero_ps();
+    __m128i bestJ = _mm_set1_epi32(-1);
+    for (int j = 0; j < unitCount; ++j) {
+        __m128 ux = _mm_set1_ps(unitCX[j]), uy = _mm_set1_ps(unitCY[j]);
+        __m128 dx = _mm_sub_ps(ux, ex), dy = _mm_sub_ps(uy, ey);
+        __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 closer = _mm_cmplt_ps(d2, best);
+        best = sel(closer, d2, best);
+        bestJ = seli(closer, _mm_set1_epi32(j), bestJ);
+        bx = sel(closer, ux, bx);
+        by = sel(closer, uy, by);
+    }
+    _mm_storeu_ps(&es.nearestD2[i], best);
+    _mm_storeu_si128((__m128i *)&es.nearestUnit[i], bestJ);
+    _mm_storeu_ps(&es.nearestUX[i], bx);
+    _mm_storeu_ps(&es.nearestUY[i], by);
+}
+
+template <int T>
+static void stepEnemy4(EnemyStore &es, int i, float shipX, float shipY, const FlowField *flow, float dt) {
+    constexpr EnemyTraits traits = ENEMY_TRAITS[T];
+    const __m128 zero = _mm_setzero_ps();
+    __m128 vdt = _mm_set1_ps(dt);
+    __m128 ex = _mm_loadu_ps(&es.x[i]), ey = _mm_loadu_ps(&es.y[i]);
+    __m128 tsla = _mm_add_ps(_mm_loadu_ps(&es.timeSinceLastAttack[i]), vdt);
+    __m128 closestDist = _mm_sqrt_ps(_mm_loadu_ps(&es.nearestD2[i]));
+    __m128i closest = _mm_loadu_si128((const __m128i *)&es.nearestUnit[i]);
+    __m128 ux = _mm_loadu_ps(&es.nearestUX[i]), uy = _mm_loadu_ps(&es.nearestUY[i]);
+    __m128 dxs = _mm_sub_ps(_mm_set1_ps(shipX), ex), dys = _mm_sub_ps(_mm_set1_ps(shipY), ey);
+    __m128 distToShip = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dxs, dxs), _mm_mul_ps(dys, dys)));
+    __m128 range = _mm_loadu_ps(&es.attackRange[i]);
+    __m128 fx = _mm_setzero_ps(), fy = _mm_setzero_ps();
+    if (flow) {
+        int c0 = flow->cellAt(es.x[i], es.y[i]), c1 = flow->cellAt(es.x[i+1], es.y[i+1]);
+        int c2 = flow->cellAt(es.x[i+2], es.y[i+2]), c3 = flow->cellAt(es.x[i+3], es.y[i+3]);
+        fx = _mm_setr_ps(flow->dirX[c0], flow->dirX[c1], flow->dirX[c2], flow->dirX[c3]);
+        fy = _mm_setr_ps(flow->dirY[c0], flow->dirY[c1], flow->dirY[c2], flow->dirY[c3]);
+    }
+    __m128 onFlow = _mm_or_ps(_mm_cmpneq_ps(fx, _mm_setzero_ps()), _mm_cmpneq_ps(fy, _mm_setzero_ps()));
+    __m128 shipSX = sel(onFlow, _mm_mul_ps(fx, distToShip), dxs);
+    __m128 shipSY = sel(onFlow, _mm_mul_ps(fy, distToShip), dys);
+
+    __m128 hasUnit = _mm_castsi128_ps(_mm_cmpgt_epi32(closest, _mm_set1_epi32(-1)));
+    __m128 shipClose = _mm_cmple_ps(distToShip, _mm_add_ps(range, _mm_set1_ps(10.0f)));
+    __m128 allSet = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128 engagingUnit = traits.prioritizeShip ? zero : _mm_andnot_ps(shipClose,
+                          _mm_and_ps(hasUnit, _mm_cmple_ps(closestDist, _mm_loadu_ps(&es.detectionRange[i]))));
+    __m128 engagingShip = traits.prioritizeShip ? allSet : _mm_or_ps(shipClose,
+                          _mm_andnot_ps(engagingUnit, _mm_cmple_ps(distToShip, _mm_loadu_ps(&es.shipDetectionRange[i]))));
+    __m128 active = _mm_or_ps(engagingUnit, engagingShip);
+    __m128 distToTarget = sel(engagingUnit, closestDist, distToShip);
+
+    __m128 avoid = traits.avoidsUnits ? _mm_and_ps(hasUnit, _mm_cmplt_ps(closestDist, _mm_loadu_ps(&es.avoidUnitsRange[i])))
+                                      : zero;
+    __m128 sx = sel(avoid, _mm_sub_ps(ex, ux), sel(engagingUnit, _mm_sub_ps(ux, ex), shipSX));
+    __m128 sy = sel(avoid, _mm_sub_ps(ey, uy), sel(engagingUnit, _mm_sub_ps(uy, ey), shipSY));
+    __m128 len = sel(avoid, closestDist, distToTarget);
+    __m128 moves = _mm_and_ps(active, _mm_and_ps(_mm_or_ps(avoid, _mm_cmpgt_ps(distToTarget, range)),
+                                                 _mm_cmpgt_ps(len, _mm_set1_ps(0.001f))));
+    __m128 k = _mm_and_ps(moves, _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(&es.moveSpeed[i]), vdt), len));
+    __m128 mx = _mm_mul_ps(sx, k), my = _mm_mul_ps(sy, k);
+    _mm_storeu_ps(&es.moveX[i], mx); _mm_storeu_ps(&es.moveY[i], my);
+    _mm_storeu_ps(&es.x[i], _mm_add_ps(ex, mx));
+    _mm_storeu_ps(&es.y[i], _mm_add_ps(ey, my));
+
+    __m128 attacks = _mm_and_ps(active, _mm_and_ps(_mm_cmple_ps(distToTarget, range),
+                                                   _mm_cmpge_ps(tsla, _mm_loadu_ps(&es.attackCooldown[i]))));
+    __m128i target = seli(attacks, seli(engagingUnit, closest, _mm_set1_epi32(ENEMY_TARGET_SHIP)), _mm_set1_epi32(-1));
+    _mm_storeu_si128((__m128i *)&es.attackTarget[i], target);
+    _mm_storeu_ps(&es.timeSinceLastAttack[i], _mm_andnot_ps(attacks, tsla));
+}
+#endif
+
+// Both passes for enemies [begin, end), which are all of type T. A type that
+// only goes for the ship never looks for a unit.
+template <int T>
+static void updateEnemyRun(EnemyStore &es, int begin, int end, const float *unitCX, const float *unitCY, int unitCount,
+                           float shipX, float shipY, const FlowField *flow, float dt) {
+    constexpr EnemyTraits traits = ENEMY_TRAITS[T];
+    const bool needsUnit = !traits.prioritizeShip || traits.avoidsUnits;
+    bool indexed = unitCount > UNIT_SCAN_MAX;
+    if (!needsUnit) {
+        for (int e = begin; e < end; ++e) { es.nearestD2[e] = FLT_MAX; es.nearestUnit[e] = -1; es.nearestUX[e] = es.nearestUY[e] = 0.0f; }
+    } else if (indexed) {
+        for (int e = begin; e < end; ++e) nearestUnitIndexed<T>(es, e, unitCX, unitCY);
+    }
+    bool scan = needsUnit && !indexed;
+    int i = begin;
+#ifdef ENEMY_KERNEL_SSE2
+    for (; i + 4 <= end; i += 4) {
+        if (scan) nearestUnit4(es, i, unitCX, unitCY, unitCount);
+        stepEnemy4<T>(es, i, shipX, shipY, flow, dt);
+    }
+#endif
+    for (; i < end; ++i) {
+        if (scan) nearestUnitScalar(es, i, unitCX, unitCY, unitCount);
+        stepEnemyScalar<T>(es, i, shipX, shipY, flow, dt);
+    }
+}
+
+// Enemies [begin, end) in runs of one type, each through the kernel built for
+// it. Spawning sorted by type keeps the runs long; any order gives the same
+// result, since the scalar tail of a run matches the SSE2 lanes bit for bit.
+static void updateEnemyRange(EnemyStore &es, int begin, int end, const float *unitCX, const float *unitCY, int unitCount,
+                             float shipX, float shipY, const FlowField *flow, float dt, std::vector<EnemyAttack> &attacks) {
+    for (int a = begin; a < end; ) {
+        int type = es.type[a], b = a + 1;
+        while (b < end && es.type[b] == type) ++b;
+        forEachType<ENEMY_TYPE_COUNT>([&](auto t) {
+            if (decltype(t)::value == type) updateEnemyRun<decltype(t)::value>(es, a, b, unitCX, unitCY, unitCount, shipX, shipY, flow, dt);
+        });
+        a = b;
+    }
+    for (int e = begin; e < end; ++e) {
+        if (es.attackTarget[e] != -1) attacks.push_back(EnemyAttack{ e, es.attackTarget[e] });
+    }
+}
+
+// Pass 3, after every enemy has moved: pushes are worked out from the moved
+// positions in full before any is applied, so chunks never see each other's.
+static void separateEnemies(EnemyStore &es, float dt, JobSystem *jobs) {
+    int n = es.size(), phase = es.crowdPhase;
+    es.crowdPhase = (phase + 1) % CROWD_SLICES;
+    CrowdAgents agents{ es.x.data(), es.y.data(), es.moveX.data(), es.moveY.data(),
+                        es.crowdRadius.data(), es.crowdWeight.data(), n };
+    es.crowdGrid.build(agents);
+    int packed = es.crowdGrid.grid.size();
+    if (!packed) return;                 // nobody gives way, so every push is 0
+    float *pushX = es.crowdPushX.data(), *pushY = es.crowdPushY.data(), *block = es.crowdBlock.data();
+    if (!jobs || jobs->threadCount() == 1 || packed < 2 * ENEMY_CHUNK) {
+        crowdSeparation(es.crowdGrid, agents, 0, packed, phase, dt, pushX, pushY, block);
+    } else {
+        jobs->parallelFor(packed, ENEMY_CHUNK, [&](int begin, int end, int) {
+            crowdSeparation(es.crowdGrid, agents, begin, end, phase, dt, pushX, pushY, block);
+        });
+    }
+    for (int i = 0; i < n; ++i) {
+        es.x[i] += pushX[i] - es.moveX[i] * block[i];
+        es.y[i] += pushY[i] - es.moveY[i] * block[i];
+    }
+}
+
+void updateEnemyKernel(EnemyStore &es, const float *unitCX, const float *unitCY, int unitCount,
+                       float shipX, float shipY, const FlowField *flow, float dt, std::vector<EnemyAttack> &attacks,
+                       JobSystem *jobs) {
+    int n = es.size();
+    es.nearestD2.resize(n); es.nearestUX.resize(n); es.nearestUY.resize(n);
+    es.nearestUnit.resize(n); es.attackTarget.resize(n);
+    es.moveX.resize(n); es.moveY.resize(n);
+    if (unitCount > UNIT_SCAN_MAX) es.unitIndex.build(unitCX, unitCY, unitCount);
+
+    if (!jobs || jobs->threadCount() == 1 || n < 2 * ENEMY_CHUNK) {
+        updateEnemyRange(es, 0, n, unitCX, unitCY, unitCount, shipX, shipY, flow, dt, attacks);
+        separateEnemies(es, dt, nullptr);
+        return;
+    }
+
+    // Every enemy only writes its own slots, so chunks run in any order on any
+    // thread. Attacks go to the running thread's buffer, which is not in enemy
+    // order once a worker steals an earlier chunk after running a later one.
+    // The merged attacks are sorted by enemy index, which gives the serial order
+    // for any thread count, so keep the sort even though the buffers look sorted.
+    int threads = jobs->threadCount();
+    es.threadAttacks.resize(threads);
+    for (std::vector<EnemyAttack> &buf : es.threadAttacks) buf.clear();
+    jobs->parallelFor(n, ENEMY_CHUNK, [&](int begin, int end, int worker) {
+        updateEnemyRange(es, begin, end, unitCX, unitCY, unitCount, shipX, shipY, flow, dt, es.threadAttacks[worker]);
+    });
+
+    size_t start = attacks.size();
+    for (const std::vector<EnemyAttack> &buf : es.threadAttacks) attacks.insert(attacks.end(), buf.begin(), buf.end());
+    std::sort(attacks.begin() + start, attacks.end(), [](const EnemyAttack &a, const EnemyAttack &b) { return a.enemy < b.enemy; });
+    separateEnemies(es, dt, jobs);
+}
@@ -0,0 +1,112 @@
+#ifndef ENEMIES_H
+#define ENEMIES_H
+
+#include <raylib.h>
+#include <stdint.h>
+#include <vector>
+#include "archetypes.h"
+#include "crowd.h"
+#include "flowfield.h"
+#include "pool.h"
+#include "spatial.h"
+
+const int ENEMY_SIZE = 32;
+
+// One alien's full description. Only used to spawn into an EnemyStore.
+struct EnemyNPC {
+    float x = 0.0f, y = 0.0f;
+    int hp = 1;
+    int maxHp = 1;
+    float moveSpeed = 120.0f;
+    float detectionRange = 450.0f;
+    float attackRange = 100.0f;
+    float shipDetectionRange = 12000.0f;
+    float attackDamage = 15.0f;
+    float attackCooldown = 2.0f;
+    EnemyType type = ENEMY_GRUNT;   // what it does comes from ENEMY_TRAITS
+    float avoidUnitsRange = 0.0f;
+    float crowdRadius = 18.0f;      // separation from other aliens, see crowd.h
+    float crowdWeight = 24.0f;
+};
+
+const int ENEMY_TARGET_SHIP = -2;
+
+struct EnemyAttack {
+    int enemy;
+    int unit;       // index into the unit centers, or ENEMY_TARGET_SHIP
+};
+
+// Structure-of-arrays enemy storage. The hot arrays are everything the per-tick
+// movement/attack kernel reads or writes; the cold arrays are only touched when
+// an enemy is hit, drawn or attacks. Live enemies are packed at [0, size()) in
+// spawn order. A kill only clears alive; compact() then drops the dead, so
+// indices hold for one tick and anything kept longer is an EntityId. The
+// kernel takes runs of one type at a time, so a batch should be added sorted
+// by type.
+struct EnemyStore {
+    // hot
+    std::vector<float> x, y;
+    std::vector<float> moveSpeed;
+    std::vector<float> timeSinceLastAttack;
+    std::vector<float> attackCooldown;
+    std::vector<float> attackRange;
+    std::vector<float> detectionRange;
+    std::vector<float> shipDetectionRange;
+    std::vector<float> avoidUnitsRange;
+    std::vector<float> crowdRadius, crowdWeight;
+    std::vector<float> crowdPushX, crowdPushY, crowdBlock;  // from the enemy's last separation slice
+    std::vector<uint8_t> alive;
+    std::vector<uint8_t> type;
+
+    // cold
+    std::vector<int> hp, maxHp;
+    std::vector<uint8_t> showHp;
+    std::vector<float> attackDamage;
+    std::vector<float> prevX, prevY;   // positions at the start of the last tick, for render interpolation
+
+    // kernel scratch, one entry per enemy
+    std::vector<float> nearestD2, nearestUX, nearestUY;
+    std::vector<int> nearestUnit;
+    std::vector<int> attackTarget;
+    std::vector<std::vector<EnemyAttack>> threadAttacks;   // one per job thread
+    PointGrid unitIndex;                                   // unit centers, for armies too big to scan
+    CrowdGrid crowdGrid;                                   // enemy centers after moving, for separation
+    std::vector<float> moveX, moveY;                       // step taken this tick, before separation
+    int crowdPhase = 0;                                    // separation slice due next tick
+
+    SlotTable slots;
+
+    int size() const { return (int)x.size(); }
+    bool empty() const { return x.empty(); }
+    // Index of a live enemy, or -1 if it died or the handle is stale.
+    int find(EntityId id) const { int i = slots.find(id); return i >= 0 && alive[i] ? i : -1; }
+    EntityId idAt(int i) const { return slots.idAt(i); }
+    Rectangle bounds(int i) const {
+        return Rectangle{ x[i] - ENEMY_SIZE/2, y[i] - ENEMY_SIZE/2, (float)ENEMY_SIZE, (float)ENEMY_SIZE };
+    }
+
+    void clear();
+    void reserve(int n);
+    EntityId add(const EnemyNPC &e);
+    // Drops every enemy whose alive flag was cleared, keeping the rest in order.
+    void compact();
+};
+
+const int ENEMY_CHUNK = 256;    // enemies per job; a multiple of the SIMD width
+
+struct JobSystem;
+
+// One tick of enemy AI for every enemy in the store, which must be compacted:
+// nearest unit (from a grid of the unit centers for big armies), ship distance,
+// approach/avoid steering, separation from the other aliens and cooldowns,
+// with each type's ENEMY_TRAITS compiled into its own copy of the loop.
+// shipFlow, if given, is a flow field toward (shipX, shipY) that steers
+// ship-bound enemies around obstacles. Damage
+// is not applied here; attacks that land are appended to `attacks` in enemy
+// order. With jobs the store is split into ENEMY_CHUNK ranges across its
+// threads; the result is the same for any thread count.
+void updateEnemyKernel(EnemyStore &es, const float *unitCX, const float *unitCY, int unitCount,
+                       float shipX, float shipY, const FlowField *shipFlow, float dt, std::vector<EnemyAttack> &attacks,
+                       JobSystem *jobs = nullptr);
+
+#endif
@@ -0,0 +1,64 @@
+#include "filewatch.h"
+#include <chrono>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+static long long modifiedTime(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return 0;
+    return (long long)st.st_mtime;
+}
+
+FileWatch::~FileWatch() {
+#if defined(__linux__)
+    if (fd >= 0) close(fd);
+#endif
+}
+
+bool FileWatch::open(const char *path) {
+    std::string p = path;
+    size_t slash = p.find_last_of("/\\");
+    dir = slash == std::string::npos ? "." : p.substr(0, slash + 1);
+    name = slash == std::string::npos ? p : p.substr(slash + 1);
+    mtime = modifiedTime(p);
+#if defined(__linux__)
+    if (fd >= 0) close(fd);
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return false;
+    if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool FileWatch::changed() {
+#if defined(__linux__)
+    if (fd < 0) return false;
+    alignas(struct inotify_event) char buf[4096];
+    bool hit = false;
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->len && name == ev->name) hit = true;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return hit;
+#else
+    double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (now < nextPoll) return false;
+    nextPoll = now + 0.5;
+    long long m = modifiedTime(dir == "." ? name : dir + name);
+    if (m == mtime) return false;
+    mtime = m;
+    return true;
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef FILEWATCH_H
+#define FILEWATCH_H
+
+#include <string>
+
+// Tells when a file has been written, for reloading it while the game runs.
+// On Linux it is an inotify watch on the file's directory, so an editor that
+// saves by writing a new file and renaming it over the old one is still seen,
+// and checking costs one non-blocking read. Elsewhere it polls the file's
+// modification time, at most twice a second.
+struct FileWatch {
+    FileWatch() = default;
+    FileWatch(const FileWatch &) = delete;
+    FileWatch &operator=(const FileWatch &) = delete;
+    ~FileWatch();
+
+    bool open(const char *path);
+    // True once for each burst of writes since the last call.
+    bool changed();
+
+private:
+    std::string dir, name;
+    int fd = -1;
+    long long mtime = 0;
+    double nextPoll = 0.0;
+};
+
+#endif
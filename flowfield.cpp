@@ -0,0 +1,195 @@
+#include "flowfield.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+static const int STEP_COST = 10, DIAG_COST = 14;
+// Straight neighbors first, so index < 4 means a straight step.
+static const int NEIGHBOR_DX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+static const int NEIGHBOR_DY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+typedef std::pair<int, int> CostCell;
+typedef std::priority_queue<CostCell, std::vector<CostCell>, std::greater<CostCell>> CostQueue;
+
+static inline Rectangle grow(Rectangle r, float by) {
+    return Rectangle{ r.x - by, r.y - by, r.width + 2*by, r.height + 2*by };
+}
+
+static inline bool sameRect(const Rectangle &a, const Rectangle &b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+// Calls visit(cell) for every cell whose center lies inside r.
+template <typename F>
+static void forCentersIn(const FlowField &f, Rectangle r, F &&visit) {
+    int x0 = std::max(0, (int)ceilf(r.x * f.invCellSize - 0.5f));
+    int x1 = std::min(f.cols - 1, (int)floorf((r.x + r.width) * f.invCellSize - 0.5f));
+    int y0 = std::max(0, (int)ceilf(r.y * f.invCellSize - 0.5f));
+    int y1 = std::min(f.rows - 1, (int)floorf((r.y + r.height) * f.invCellSize - 0.5f));
+    for (int cy = y0; cy <= y1; ++cy)
+        for (int cx = x0; cx <= x1; ++cx) visit(cy * f.cols + cx);
+}
+
+bool FlowField::canStep(int cx, int cy, int dx, int dy) const {
+    int nx = cx + dx, ny = cy + dy;
+    if (nx < 0 || ny < 0 || nx >= cols || ny >= rows) return false;
+    if (blockers[ny * cols + nx]) return false;
+    // No cutting a corner past a blocked cell.
+    if (dx && dy && (blockers[cy * cols + nx] || blockers[ny * cols + cx])) return false;
+    return true;
+}
+
+// Whether the segment from (x0, y0) to (x1, y1) passes through r (Liang-Barsky).
+static bool segmentCrosses(float x0, float y0, float x1, float y1, const Rectangle &r) {
+    float dx = x1 - x0, dy = y1 - y0, t0 = 0.0f, t1 = 1.0f;
+    const float p[4] = { -dx, dx, -dy, dy };
+    const float q[4] = { x0 - r.x, r.x + r.width - x0, y0 - r.y, r.y + r.height - y0 };
+    for (int k = 0; k < 4; ++k) {
+        if (p[k] == 0.0f) { if (q[k] < 0.0f) return false; continue; }
+        float t = q[k] / p[k];
+        if (p[k] < 0.0f) { if (t > t1) return false; if (t > t0) t0 = t; }
+        else { if (t < t0) return false; if (t < t1) t1 = t; }
+    }
+    return true;
+}
+
+// Calls visit(cell) for every cell whose line to the goal crosses r: the wedge
+// behind r as seen from the goal, found inside the box that spans r and its
+// corners pushed out past the map.
+template <typename F>
+static void forShadowOf(const FlowField &f, const Rectangle &r, F &&visit) {
+    const Vector2 g = f.goal;
+    if (g.x >= r.x && g.x <= r.x + r.width && g.y >= r.y && g.y <= r.y + r.height) return;
+    float far = (f.cols + f.rows) * f.cellSize;
+    float minX = r.x, maxX = r.x + r.width, minY = r.y, maxY = r.y + r.height;
+    const float cornerX[4] = { r.x, r.x + r.width, r.x, r.x + r.width };
+    const float cornerY[4] = { r.y, r.y, r.y + r.height, r.y + r.height };
+    for (int k = 0; k < 4; ++k) {
+        float dx = cornerX[k] - g.x, dy = cornerY[k] - g.y, len = sqrtf(dx*dx + dy*dy);
+        float px = g.x + dx / len * far, py = g.y + dy / len * far;
+        minX = std::min(minX, px); maxX = std::max(maxX, px);
+        minY = std::min(minY, py); maxY = std::max(maxY, py);
+    }
+    int x0 = std::max(0, (int)floorf(minX * f.invCellSize)), x1 = std::min(f.cols - 1, (int)floorf(maxX * f.invCellSize));
+    int y0 = std::max(0, (int)floorf(minY * f.invCellSize)), y1 = std::min(f.rows - 1, (int)floorf(maxY * f.invCellSize));
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            if (segmentCrosses((cx + 0.5f) * f.cellSize, (cy + 0.5f) * f.cellSize, g.x, g.y, r)) visit(cy * f.cols + cx);
+        }
+    }
+}
+
+void FlowField::updateDir(int cell) {
+    dirX[cell] = 0.0f; dirY[cell] = 0.0f;
+    if (blockers[cell] || inSight[cell] || cost[cell] == INT_MAX) return;
+    int cx = cell % cols, cy = cell / cols;
+    int best = cost[cell], bestK = -1;
+    for (int k = 0; k < 8; ++k) {
+        if (!canStep(cx, cy, NEIGHBOR_DX[k], NEIGHBOR_DY[k])) continue;
+        int n = cell + NEIGHBOR_DY[k] * cols + NEIGHBOR_DX[k];
+        if (cost[n] < best) { best = cost[n]; bestK = k; }
+    }
+    if (bestK < 0) return;
+    float len = bestK < 4 ? 1.0f : 0.70710678f;
+    dirX[cell] = NEIGHBOR_DX[bestK] * len;
+    dirY[cell] = NEIGHBOR_DY[bestK] * len;
+}
+
+// Dijkstra out of seeds, whose costs are already set, lowering every cell it
+// reaches more cheaply than before. Lowered cells are appended to changed.
+void FlowField::propagate(const std::vector<int> &seeds, std::vector<int> &changed) {
+    CostQueue open;
+    for (int c : seeds) open.push(CostCell(cost[c], c));
+    while (!open.empty()) {
+        CostCell top = open.top();
+        open.pop();
+        int c = top.second;
+        if (top.first != cost[c]) continue;   // lowered again after this was queued
+        int cx = c % cols, cy = c / cols;
+        for (int k = 0; k < 8; ++k) {
+            if (!canStep(cx, cy, NEIGHBOR_DX[k], NEIGHBOR_DY[k])) continue;
+            int n = c + NEIGHBOR_DY[k] * cols + NEIGHBOR_DX[k];
+            int nc = top.first + (k < 4 ? STEP_COST : DIAG_COST);
+            if (nc < cost[n]) { cost[n] = nc; open.push(CostCell(nc, n)); changed.push_back(n); }
+        }
+    }
+}
+
+void FlowField::build(float width, float height, float cell, float grownBy, Vector2 goalPos,
+                      const std::vector<Rectangle> &obs) {
+    cellSize = cell; invCellSize = 1.0f / cell; clearance = grownBy; goal = goalPos;
+    cols = (int)ceilf(width * invCellSize); rows = (int)ceilf(height * invCellSize);
+    int n = cols * rows;
+    blockers.assign(n, 0); shadows.assign(n, 0); cost.assign(n, INT_MAX); inSight.assign(n, 0);
+    dirX.assign(n, 0.0f); dirY.assign(n, 0.0f);
+    stamp.assign(n, 0); stampNow = 0;
+    goalCell = cellAt(goal.x, goal.y);
+
+    obstacles.clear();
+    for (const Rectangle &r : obs) {
+        obstacles.push_back(grow(r, clearance));
+        // The goal always stays open, even with an obstacle on top of it.
+        forCentersIn(*this, obstacles.back(), [&](int c) { if (c != goalCell) blockers[c]++; });
+        forShadowOf(*this, obstacles.back(), [&](int c) { shadows[c]++; });
+    }
+
+    cost[goalCell] = 0;
+    std::vector<int> changed;
+    propagate(std::vector<int>(1, goalCell), changed);
+    for (int c = 0; c < n; ++c) {
+        inSight[c] = !blockers[c] && !shadows[c];
+        updateDir(c);
+    }
+}
+
+void FlowField::removeObstacle(Rectangle r) {
+    if (empty()) return;
+    Rectangle g = grow(r, clearance);
+    auto it = std::find_if(obstacles.begin(), obstacles.end(), [&](const Rectangle &o) { return sameRect(o, g); });
+    if (it == obstacles.end()) return;
+    obstacles.erase(it);
+
+    std::vector<int> freed, lit;
+    forCentersIn(*this, g, [&](int c) { if (c != goalCell && --blockers[c] == 0) freed.push_back(c); });
+    forShadowOf(*this, g, [&](int c) { if (--shadows[c] == 0) lit.push_back(c); });
+
+    // A reopened cell can be entered from any open neighbor, and it opens the
+    // diagonals between its neighbors, so all of those pull in cheaper costs
+    // first. Nothing got more expensive, so spreading the drops finishes the job.
+    std::vector<int> seeds, changed;
+    auto pull = [&](int c) {
+        if (blockers[c]) return;
+        int cx = c % cols, cy = c / cols, best = cost[c];
+        for (int k = 0; k < 8; ++k) {
+            if (!canStep(cx, cy, NEIGHBOR_DX[k], NEIGHBOR_DY[k])) continue;
+            int nc = cost[c + NEIGHBOR_DY[k] * cols + NEIGHBOR_DX[k]], step = k < 4 ? STEP_COST : DIAG_COST;
+            if (nc != INT_MAX && nc + step < best) best = nc + step;
+        }
+        if (best < cost[c]) { cost[c] = best; seeds.push_back(c); changed.push_back(c); }
+    };
+    auto around = [&](int c, auto &&visit) {
+        int cx = c % cols, cy = c / cols;
+        for (int y = std::max(0, cy - 1); y <= std::min(rows - 1, cy + 1); ++y)
+            for (int x = std::max(0, cx - 1); x <= std::min(cols - 1, cx + 1); ++x) visit(y * cols + x);
+    };
+    for (int c : freed) around(c, pull);
+    propagate(seeds, changed);
+
+    for (int c : freed) lit.push_back(c);
+    for (int c : lit) {
+        uint8_t sees = !blockers[c] && !shadows[c];
+        if (sees != inSight[c]) { inSight[c] = sees; changed.push_back(c); }
+    }
+
+    changed.insert(changed.end(), freed.begin(), freed.end());
+    stampNow++;
+    for (int c : changed) {
+        around(c, [&](int n) {
+            if (stamp[n] == stampNow) return;
+            stamp[n] = stampNow;
+            updateDir(n);
+        });
+    }
+}
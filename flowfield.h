@@ -0,0 +1,51 @@
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+#include <raylib.h>
+#include <stdint.h>
+#include <vector>
+
+// Grid flow field toward one goal. build() blocks every cell whose center an
+// obstacle covers, runs Dijkstra out from the goal into an integration field
+// (path cost per cell) and turns that into one step direction per cell. Cells
+// with a clear straight line to the goal get no direction: the straight vector
+// is already their shortest path, and the caller steers with it as before.
+// Removing an obstacle can only shorten paths, so it is patched in place.
+struct FlowField {
+    float cellSize = 32.0f;
+    float invCellSize = 1.0f / 32.0f;
+    float clearance = 0.0f;            // obstacles grow by this on every side
+    int cols = 0, rows = 0;
+    Vector2 goal{};
+    int goalCell = -1;
+
+    std::vector<uint8_t> blockers;     // per cell, obstacles covering its center
+    std::vector<uint16_t> shadows;     // per cell, obstacles its straight line to the goal crosses
+    std::vector<int> cost;             // integration field: 10 per straight step, 14 per diagonal
+    std::vector<uint8_t> inSight;      // per cell, straight line to the goal is clear
+    std::vector<float> dirX, dirY;     // per cell, unit step toward the goal; 0, 0 where in sight or stuck
+    std::vector<Rectangle> obstacles;  // grown by clearance
+
+    void build(float width, float height, float cellSize, float clearance, Vector2 goal,
+               const std::vector<Rectangle> &obstacles);
+    // r as passed to build(). Reopens its cells and lowers the costs behind it.
+    void removeObstacle(Rectangle r);
+    bool empty() const { return cost.empty(); }
+
+    int cellAt(float x, float y) const {
+        int cx = (int)(x * invCellSize), cy = (int)(y * invCellSize);
+        cx = cx < 0 ? 0 : (cx >= cols ? cols - 1 : cx);
+        cy = cy < 0 ? 0 : (cy >= rows ? rows - 1 : cy);
+        return cy * cols + cx;
+    }
+
+private:
+    std::vector<int> stamp;
+    int stampNow = 0;
+
+    bool canStep(int cx, int cy, int dx, int dy) const;
+    void updateDir(int cell);
+    void propagate(const std::vector<int> &seeds, std::vector<int> &changed);
+};
+
+#endif
@@ -0,0 +1,769 @@
+#include "game.h"
+#include "jobs.h"
+#include "profiler.h"
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+
+EnemyNPC makeEnemy(const Archetypes &arch, EnemyType type, int wave, float statScale) {
+    const EnemyArchetype &a = arch.enemies[type];
+    EnemyNPC e{};
+    e.type = type;
+    e.moveSpeed = a.moveSpeed; e.attackRange = a.attackRange; e.attackDamage = a.attackDamage; e.attackCooldown = a.attackCooldown;
+    e.hp = e.maxHp = (int)((a.hp + wave * a.hpPerWave) * statScale);
+    e.detectionRange = a.detectionRange + wave * a.detectionPerWave;
+    e.avoidUnitsRange = a.avoidUnitsRange;
+    e.crowdRadius = a.crowdRadius; e.crowdWeight = a.crowdWeight;
+    return e;
+}
+
+// Calls f(i) for every unit whose type heals, one type's run at a time.
+template <typename F>
+static void forEachHealer(Game &game, F &&f) {
+    forEachType<UNIT_TYPE_COUNT>([&](auto type) {
+        if (!UNIT_TRAITS[decltype(type)::value].heals) return;
+        for (int i = game.unitTypeStart[type]; i < game.unitTypeStart[type + 1]; ++i) f(i);
+    });
+}
+
+// Units step apart where they overlap (see crowd.h).
+static void separateUnits(Game &game, float dt) {
+    std::vector<Unit> &units = game.units;
+    int n = (int)units.size();
+    if (n < 2) return;
+    refreshUnitPoints(game);
+    game.unitCrowdR.resize(n); game.unitCrowdW.resize(n);
+    game.unitPushX.resize(n); game.unitPushY.resize(n); game.unitBlock.resize(n);
+    game.unitMoveX.resize(n); game.unitMoveY.resize(n);
+    for (int i = 0; i < n; ++i) {
+        const Unit &u = units[i];
+        game.unitCrowdR[i] = u.crowdRadius; game.unitCrowdW[i] = u.crowdWeight;
+        game.unitMoveX[i] = u.fx - u.prevFx; game.unitMoveY[i] = u.fy - u.prevFy;
+        game.unitPushX[i] = u.crowdPushX; game.unitPushY[i] = u.crowdPushY; game.unitBlock[i] = u.crowdBlock;
+    }
+    CrowdAgents agents{ game.unitCX.data(), game.unitCY.data(), game.unitMoveX.data(), game.unitMoveY.data(),
+                        game.unitCrowdR.data(), game.unitCrowdW.data(), n };
+    game.unitCrowd.build(agents);
+    crowdSeparation(game.unitCrowd, agents, 0, game.unitCrowd.grid.size(), (int)(game.tick % CROWD_SLICES), dt,
+                    game.unitPushX.data(), game.unitPushY.data(), game.unitBlock.data());
+    for (int i = 0; i < n; ++i) {
+        Unit &u = units[i];
+        u.crowdPushX = game.unitPushX[i]; u.crowdPushY = game.unitPushY[i]; u.crowdBlock = game.unitBlock[i];
+        float px = u.crowdPushX - game.unitMoveX[i] * u.crowdBlock, py = u.crowdPushY - game.unitMoveY[i] * u.crowdBlock;
+        if (px == 0.0f && py == 0.0f) continue;
+        u.fx = ClampVal(u.fx + px, 0.0f, MAP_WIDTH - u.width);
+        u.fy = ClampVal(u.fy + py, 0.0f, MAP_HEIGHT - u.height);
+        u.x = (int)lroundf(u.fx); u.y = (int)lroundf(u.fy);
+        game.unitPointsDirty = true;
+    }
+}
+
+static void spawnWave(Game &game, int wave) {
+    EnemyStore &enemies = game.enemies;
+    const Tuning &tuning = game.archetypes.tuning;
+    float enemyCountScale = 1.0f;
+    float enemyStatScale = 1.0f;
+    switch (game.difficulty) {
+        case DIFF_CASUAL: enemyCountScale = tuning.casualCountScale; enemyStatScale = tuning.casualStatScale; break;
+        case DIFF_NORMAL: enemyCountScale = tuning.normalCountScale; enemyStatScale = tuning.normalStatScale; break;
+        case DIFF_HARD: enemyCountScale = tuning.hardCountScale; enemyStatScale = tuning.hardStatScale; break;
+    }
+    int baseCount = tuning.waveBaseCount + wave * tuning.waveCountPerWave;
+    int spawnCount = (int)std::round(baseCount * enemyCountScale);
+    if (spawnCount < 1) spawnCount = 1;
+    Rng &rng = game.spawnRng;
+    int spawnTotal = 0;
+    for (const EnemyArchetype &a : game.archetypes.enemies) spawnTotal += a.spawnWeight;
+    std::vector<EnemyNPC> spawned;
+    spawned.reserve(spawnCount);
+    for (int i = 0; i < spawnCount; ++i) {
+        float x, y;
+        int margin = ENEMY_SIZE / 2 + 2;
+        int side = rng.range(0,3);
+        if (side == 0) { x = (float)rng.range(margin, (int)MAP_WIDTH - margin); y = (float)margin; }
+        else if (side == 1) { x = (float)rng.range(margin, (int)MAP_WIDTH - margin); y = MAP_HEIGHT - margin; }
+        else if (side == 2) { x = (float)margin; y = (float)rng.range(margin, (int)MAP_HEIGHT - margin); }
+        else { x = MAP_WIDTH - margin; y = (float)rng.range(margin, (int)MAP_HEIGHT - margin); }
+
+        int roll = rng.range(0, spawnTotal - 1), t = 0;
+        while (roll >= game.archetypes.enemies[t].spawnWeight) roll -= game.archetypes.enemies[t++].spawnWeight;
+        EnemyNPC e = makeEnemy(game.archetypes, (EnemyType)t, wave, enemyStatScale);
+        e.x = x; e.y = y;
+        spawned.push_back(e);
+    }
+    // The enemy kernel works through runs of one type.
+    std::stable_sort(spawned.begin(), spawned.end(), [](const EnemyNPC &a, const EnemyNPC &b) { return a.type < b.type; });
+    for (const EnemyNPC &e : spawned) enemies.add(e);
+    game.enemyPointsDirty = true;
+}
+
+static Rock makeRock(Rng &rng, const Ship &playerShip, const Tuning &tuning, int scrapMin, int scrapMax) {
+    Rock r{};
+    r.width = 48; r.height = 48;
+    int margin = 200;
+    r.x = rng.range(margin, (int)MAP_WIDTH - margin);
+    r.y = rng.range(margin, (int)MAP_HEIGHT - margin);
+    float dx = r.x - playerShip.x; float dy = r.y - playerShip.y;
+    if (dx*dx + dy*dy < 400.0f * 400.0f) { r.x += 400; }
+    r.hp = r.maxHp = rng.range(tuning.rockHpMin, tuning.rockHpMax);
+    r.scrapMin = scrapMin; r.scrapMax = scrapMax;
+    r.alive = true; r.showHp = false;
+    return r;
+}
+
+int FixedTimestep::advance(float frameTime, float timeScale) {
+    accumulator += frameTime * timeScale;
+    int ticks = (int)(accumulator / tickDt);
+    int cap = timeScale > 1.0f ? (int)(maxTicksPerFrame * timeScale) : maxTicksPerFrame;
+    if (ticks > cap) {
+        ticks = cap;
+        accumulator = tickDt * ticks;
+    }
+    accumulator -= tickDt * ticks;
+    if (accumulator < 0.0f) accumulator = 0.0f;
+    return ticks;
+}
+
+void refreshShipFlow(Game &game) {
+    if (!game.shipFlowDirty) return;
+    std::vector<Rectangle> obstacles;
+    obstacles.reserve(game.rocks.size());
+    for (const Rock &r : game.rocks) if (r.alive) obstacles.push_back(r.bounds());
+    // Grown by half an alien so paths keep its whole body off the rocks.
+    game.shipFlow.build(MAP_WIDTH, MAP_HEIGHT, FLOW_CELL_SIZE, ENEMY_SIZE / 2.0f,
+                        Vector2{ game.playerShip.x, game.playerShip.y }, obstacles);
+    game.shipFlowDirty = false;
+}
+
+void resetDerivedState(Game &game) {
+    game.enemyGrid.init(64.0f);
+    game.rockGrid.init(64.0f);
+    game.enemyPoints.init(64.0f);
+    game.unitPoints.init(128.0f);
+    game.hurtPoints.init(128.0f);
+    game.enemyPointsDirty = true;
+    game.unitPointsDirty = true;
+    game.rockGridDirty = true;
+    game.shipFlowDirty = true;
+    if (game.particles.capacity != game.particleCapacity) game.particles.init(game.particleCapacity);
+    else game.particles.clear();
+}
+
+static void setShopCosts(UpgradeShop &shop, const Tuning &tuning) {
+    shop.hullUpgradeCost = tuning.hullCost;
+    shop.shieldingUpgradeCost = tuning.shieldingCost;
+    shop.engineUpgradeCost = tuning.enginesCost;
+    shop.lifeSupportUpgradeCost = tuning.lifeSupportCost;
+}
+
+void startNewGame(Game &game) {
+    game.spawnRng.seed(game.seed, RNG_SPAWN);
+    game.lootRng.seed(game.seed, RNG_LOOT);
+    game.particleRng.seed(game.seed, RNG_PARTICLES);
+
+    Ship &playerShip = game.playerShip;
+    UpgradeShop &shop = game.shop;
+    std::vector<Unit> &units = game.units;
+
+    playerShip.x = MAP_WIDTH/2.0f;
+    playerShip.y = MAP_HEIGHT/2.0f;
+    playerShip.width = 120;
+    playerShip.height = 180;
+    playerShip.maxHp = 200;
+    playerShip.hp = playerShip.maxHp;
+    playerShip.hullIntegrity = 0;
+    playerShip.shielding = 0;
+    playerShip.engines = 0;
+    playerShip.lifeSupportSystems = 0;
+    playerShip.isComplete = false;
+
+    shop.scrapMetal = 0;
+    setShopCosts(shop, game.archetypes.tuning);
+
+    const float TAU = 6.28318530718f;
+    const int count = ClampVal(game.armySize, 1, MAX_ARMY_SIZE);
+    units.clear();
+    units.reserve(count);
+    Vector2 centerPos = { playerShip.x, playerShip.y };
+    // Rings around the ship, each as full as fits at UNIT_SPACING apart; the
+    // default six fill the first ring evenly.
+    const float UNIT_SPACING = 60.0f;
+    float ringRadius = 80.0f;
+    int ringStart = 0, ringCount = 0;
+    for (int i = 0; i < count; ++i) {
+        if (i == ringStart + ringCount) {
+            if (i > 0) ringRadius += 90.0f;
+            ringStart = i;
+            ringCount = std::min(count - i, (int)(TAU * ringRadius / UNIT_SPACING));
+        }
+        float t = ((i - ringStart) / (float)ringCount) * TAU;
+        float cx = centerPos.x + cosf(t) * ringRadius;
+        float cy = centerPos.y + sinf(t) * ringRadius;
+        Unit u{};
+        u.width = UNIT_WIDTH; u.height = UNIT_HEIGHT;
+        u.x = (int)lroundf(cx - u.width/2.0f);
+        u.y = (int)lroundf(cy - u.height/2.0f);
+        u.fx = (float)u.x; u.fy = (float)u.y;
+        u.prevFx = u.fx; u.prevFy = u.fy;
+        u.type = (UnitType)(i % UNIT_TYPE_COUNT);
+        const UnitArchetype &a = game.archetypes.units[u.type];
+        u.hp = u.maxHp = a.hp; u.fireRate = a.fireRate; u.range = a.range; u.damage = a.damage; u.speed = a.speed;
+        u.healRate = a.healRate; u.crowdRadius = a.crowdRadius; u.crowdWeight = a.crowdWeight;
+        u.selected = false; u.moving = false; u.showHp = true;
+        units.push_back(u);
+    }
+    // Types stay on the rings in turn, but the array goes one type at a time.
+    std::stable_sort(units.begin(), units.end(), [](const Unit &a, const Unit &b) { return a.type < b.type; });
+    for (int t = 0, i = 0; t <= UNIT_TYPE_COUNT; ++t) {
+        while (i < count && units[i].type < t) ++i;
+        game.unitTypeStart[t] = i;
+    }
+
+    game.areaOrders.clear();
+    game.rockAssign.reset(count);
+    game.claims.reset(count);
+
+    game.enemies.clear();
+    game.enemies.reserve(2000);
+    game.bullets.clear();
+    game.rocks.clear();
+    resetDerivedState(game);
+
+    {
+        const Tuning &tuning = game.archetypes.tuning;
+        game.rocks.reserve(tuning.startRocks);
+        for (int i = 0; i < tuning.startRocks; ++i) {
+            game.rocks.add(makeRock(game.spawnRng, playerShip, tuning, tuning.startRockScrapMin, tuning.startRockScrapMax));
+        }
+    }
+
+    game.currentWave = 1;
+    spawnWave(game, game.currentWave);
+    game.enemiesAlive = (int)game.enemies.size();
+
+    game.inIntermission = false;
+    game.intermissionTime = 0.0f;
+    game.tick = 0;
+}
+
+void applyArchetypes(Game &game, const Archetypes &next) {
+    game.archetypes = next;
+    for (Unit &u : game.units) {
+        const UnitArchetype &a = next.units[u.type];
+        u.maxHp = a.hp; u.hp = std::min(u.hp, u.maxHp);
+        u.fireRate = a.fireRate; u.range = a.range; u.damage = a.damage; u.speed = a.speed;
+        u.healRate = a.healRate; u.crowdRadius = a.crowdRadius; u.crowdWeight = a.crowdWeight;
+    }
+    EnemyStore &enemies = game.enemies;
+    for (int i = 0; i < enemies.size(); ++i) {
+        const EnemyArchetype &a = next.enemies[enemies.type[i]];
+        enemies.moveSpeed[i] = a.moveSpeed; enemies.attackRange[i] = a.attackRange;
+        enemies.attackDamage[i] = a.attackDamage; enemies.attackCooldown[i] = a.attackCooldown;
+        enemies.avoidUnitsRange[i] = a.avoidUnitsRange;
+        enemies.crowdRadius[i] = a.crowdRadius; enemies.crowdWeight[i] = a.crowdWeight;
+    }
+    setShopCosts(game.shop, next.tuning);
+}
+
+void startNextWave(Game &game) {
+    game.inIntermission = false;
+    game.intermissionTime = 0.0f;
+    game.currentWave++;
+    spawnWave(game, game.currentWave);
+    game.enemiesAlive = (int)game.enemies.size();
+}
+
+void updateGame(Game &game, float dt) {
+    Ship &playerShip = game.playerShip;
+    UpgradeShop &shop = game.shop;
+    std::vector<Unit> &units = game.units;
+    EnemyStore &enemies = game.enemies;
+    EntityPool<Bullet> &bullets = game.bullets;
+    ParticlePool &particles = game.particles;
+    EntityPool<Rock> &rocks = game.rocks;
+    Rng &fxRng = game.particleRng;
+    const Tuning &tuning = game.archetypes.tuning;
+
+    game.tick++;
+    if (playerShip.hp <= 0 || playerShip.isComplete) return;
+
+    for (auto &u : units) { u.prevFx = u.fx; u.prevFy = u.fy; }
+    enemies.prevX = enemies.x;
+    enemies.prevY = enemies.y;
+
+    ProfileScope zone(PZ_INTERMISSION);
+    game.enemiesAlive = enemies.size();
+    if (enemies.empty() && !game.inIntermission) {
+        enemies.clear();
+        game.enemyPointsDirty = true;
+        for (auto &u : units) {
+            int heal = (int)(u.maxHp * tuning.waveUnitHeal);
+            u.hp = ClampVal(u.hp + heal, 0, u.maxHp);
+        }
+        playerShip.hp = ClampVal(playerShip.hp + (int)(playerShip.maxHp * tuning.waveShipHeal), 0, playerShip.maxHp);
+        int rewardBase = tuning.rewardBase + game.currentWave * tuning.rewardPerWave;
+        float rewardScale = 1.0f;
+        switch (game.difficulty) {
+            case DIFF_CASUAL: rewardScale = tuning.casualRewardScale; break; // a little more scrap to help
+            case DIFF_NORMAL: rewardScale = tuning.normalRewardScale; break;
+            case DIFF_HARD: rewardScale = tuning.hardRewardScale; break; // less scrap, harder economy
+        }
+        shop.scrapMetal += (int)std::round(rewardBase * rewardScale);
+        for (int i = 0; i < tuning.waveRocks; ++i) {
+            rocks.add(makeRock(game.spawnRng, playerShip, tuning, tuning.waveRockScrapMin, tuning.waveRockScrapMax));
+        }
+        game.rockGridDirty = true;
+        game.shipFlowDirty = true;
+        game.rockAssign.rocksSpawned();
+        game.inIntermission = true;
+        game.intermissionTime = tuning.intermissionDuration;
+        for (int ui = 0; ui < (int)units.size(); ++ui) clearUnitOrders(game, ui);
+    }
+
+    if (game.inIntermission) {
+        game.intermissionTime -= dt;
+        if (game.intermissionTime <= 0.0f) {
+            startNextWave(game);
+        }
+    }
+
+    zone.next(PZ_UNIT_AI);
+    // The medics search a grid of the wounded built before anyone moves this
+    // pass; nobody's hp changes until it ends. A unit moves at most one step
+    // per tick, so an ally is at most a step (plus a pixel for rounding) off
+    // where the grid has it.
+    float maxStep = 0.0f;
+    for (const Unit &u : units) maxStep = std::max(maxStep, u.speed * dt);
+    bool hurtBuilt = false;
+    auto buildHurtPoints = [&]() {
+        refreshUnitPoints(game);
+        game.hurtUnits.clear(); game.hurtCX.clear(); game.hurtCY.clear();
+        for (int j = 0; j < (int)units.size(); ++j) {
+            const Unit &ally = units[j];
+            if (UNIT_TRAITS[ally.type].heals || ally.hp >= ally.maxHp) continue;
+            game.hurtUnits.push_back(j);
+            game.hurtCX.push_back(game.unitCX[j]);
+            game.hurtCY.push_back(game.unitCY[j]);
+        }
+        game.hurtPoints.build(game.hurtCX.data(), game.hurtCY.data(), (int)game.hurtUnits.size());
+        hurtBuilt = true;
+    };
+    // Type by type, in index order: each type gets a copy of the loop with its
+    // UNIT_TRAITS folded in.
+    forEachType<UNIT_TYPE_COUNT>([&](auto type) {
+        constexpr UnitTraits traits = UNIT_TRAITS[decltype(type)::value];
+        for (int i = game.unitTypeStart[type]; i < game.unitTypeStart[type + 1]; ++i) {
+            Unit &u = units[i];
+            if (u.fireTimer > 0.0f) { u.fireTimer -= dt; if (u.fireTimer < 0.0f) u.fireTimer = 0.0f; }
+
+            if (!traits.heals && !u.attacking) {
+                float ucx = u.fx + u.width/2.0f;
+                float ucy = u.fy + u.height/2.0f;
+
+                if (u.areaAttacking()) {
+                    EntityId t = pickAreaTarget(game, i);
+                    if (t.valid()) setUnitTarget(game, i, t);
+                    else clearUnitOrders(game, i);
+                }
+                if (!u.areaAttacking() && !u.attacking) {
+                    refreshEnemyPoints(game);
+                    int nearestEnemy = game.enemyPoints.nearest(ucx, ucy, u.range);
+                    if (nearestEnemy >= 0) {
+                        setUnitTarget(game, i, enemies.idAt(nearestEnemy));
+                        u.moving = false;
+                    } else {
+                        int assigned = assignedRock(game, i);
+                        if (assigned != -1) {
+                            float dxr = (float)rocks[assigned].x - ucx;
+                            float dyr = (float)rocks[assigned].y - ucy;
+                            float distR = sqrtf(dxr*dxr + dyr*dyr);
+                            if (distR > u.range + tuning.attackRangeHyst) {
+                                float inv = (distR > 0.0001f) ? (1.0f / distR) : 0.0f;
+                                float dirx = dxr * inv;
+                                float diry = dyr * inv;
+                                float desiredCX = (float)rocks[assigned].x - dirx * u.range;
+                                float desiredCY = (float)rocks[assigned].y - diry * u.range;
+                                u.targetX = (int)lroundf(desiredCX - u.width/2.0f);
+                                u.targetY = (int)lroundf(desiredCY - u.height/2.0f);
+                                u.moving = true;
+                            } else {
+                                if (u.fireTimer <= 0.0f) {
+                                    float inv = (distR > 0.0001f) ? (1.0f / distR) : 0.0f;
+                                    float dirx = dxr * inv;
+                                    float diry = dyr * inv;
+                                    Bullet b{}; b.x = ucx; b.y = ucy; b.speed = tuning.bulletSpeed; b.vx = dirx * b.speed; b.vy = diry * b.speed; b.active = true;
+                                    b.damage = u.damage; b.unitIndex = i;
+                                    bullets.add(b);
+                                    u.fireTimer = 1.0f / u.fireRate;
+                                }
+                                u.moving = false;
+                            }
+                        }
+                    }
+                }
+            }
+            if (u.attacking) {
+                int ti = enemies.find(u.target);
+                if (ti < 0) {
+                    // Releases the dead target's claim before picking the next one.
+                    setUnitTarget(game, i, EntityId{}); u.moving = false;
+                    if (u.areaAttacking()) {
+                        EntityId t = pickAreaTarget(game, i);
+                        if (t.valid()) setUnitTarget(game, i, t);
+                        else clearUnitOrders(game, i);
+                    }
+                } else {
+                    float ucx = u.fx + u.width/2.0f;
+                    float ucy = u.fy + u.height/2.0f;
+                    float ecx = enemies.x[ti];
+                    float ecy = enemies.y[ti];
+                    float dx = ecx - ucx, dy = ecy - ucy;
+                    float distToEnemy = sqrtf(dx*dx + dy*dy);
+                    if (distToEnemy > u.range + tuning.attackRangeHyst) {
+                        float inv = (distToEnemy > 0.0001f) ? (1.0f / distToEnemy) : 0.0f;
+                        float dirx = dx * inv, diry = dy * inv;
+                        float desiredCX = ecx - dirx * u.range;
+                        float desiredCY = ecy - diry * u.range;
+                        u.targetX = (int)lroundf(desiredCX - u.width/2.0f);
+                        u.targetY = (int)lroundf(desiredCY - u.height/2.0f);
+                        u.moving = true;
+                    } else {
+                        u.moving = false;
+                        if (u.fireTimer <= 0.0f) {
+                            float inv = (distToEnemy > 0.0001f) ? (1.0f / distToEnemy) : 0.0f;
+                            float dirx = dx * inv, diry = dy * inv;
+                            Bullet b{}; b.x = ucx; b.y = ucy; b.speed = tuning.bulletSpeed; b.vx = dirx * b.speed; b.vy = diry * b.speed; b.active = true;
+                            b.damage = u.damage; b.unitIndex = i;
+                            bullets.add(b);
+                            u.fireTimer = 1.0f / u.fireRate;
+                        }
+                    }
+                }
+            }
+
+            if (traits.heals) {
+                int bestIdx = -1; float bestDist = 1e9f;
+                float ucx = u.fx + u.width/2.0f; float ucy = u.fy + u.height/2.0f;
+                if (!hurtBuilt) buildHurtPoints();
+                // Whoever is nearest now was within two steps of the grid's nearest.
+                float slack = 2.0f * maxStep + 1.0f, gridD2 = 0.0f;
+                int h = game.hurtPoints.nearest(ucx, ucy, tuning.medicSearch + slack, &gridD2);
+                if (h >= 0) {
+                    game.hurtPoints.queryRadius(ucx, ucy, sqrtf(gridD2) + slack, [&](int k, float) {
+                        int j = game.hurtUnits[k];
+                        const Unit &ally = units[j];
+                        float acx = ally.fx + ally.width/2.0f; float acy = ally.fy + ally.height/2.0f;
+                        float dx = acx - ucx, dy = acy - ucy; float d = sqrtf(dx*dx + dy*dy);
+                        if (d < bestDist || (d == bestDist && j < bestIdx)) { bestDist = d; bestIdx = j; }
+                    });
+                }
+                if (bestIdx != -1 && bestDist <= tuning.medicSearch) {
+                    float acx = units[bestIdx].fx + units[bestIdx].width/2.0f; float acy = units[bestIdx].fy + units[bestIdx].height/2.0f;
+                    float dx = acx - ucx, dy = acy - ucy; float len = sqrtf(dx*dx + dy*dy);
+                    float stopDist = u.range * 0.85f;
+                    if (len > stopDist) {
+                        float inv = (len > 0.0001f) ? (1.0f/len) : 0.0f;
+                        float tx = acx - dx*inv*stopDist;
+                        float ty = acy - dy*inv*stopDist;
+                        u.targetX = (int)lroundf(tx - u.width/2.0f);
+                        u.targetY = (int)lroundf(ty - u.height/2.0f);
+                        u.moving = true;
+                    } else {
+                        u.moving = false;
+                    }
+                }
+                setUnitTarget(game, i, EntityId{});
+            }
+
+            if (u.moving) {
+                float dx = (float)u.targetX - u.fx, dy = (float)u.targetY - u.fy;
+                float dist = sqrtf(dx*dx + dy*dy);
+                float step = u.speed * dt;
+                if (dist <= step || dist < 0.5f) { u.fx = (float)u.targetX; u.fy = (float)u.targetY; u.moving = false; }
+                else if (dist > 0.0f) { u.fx += (dx/dist)*step; u.fy += (dy/dist)*step; }
+            }
+            u.x = (int)lroundf(u.fx); u.y = (int)lroundf(u.fy);
+        }
+    });
+    game.unitPointsDirty = true;
+
+    // Healers only look at allies the unit grid puts within reach; each ally
+    // is healed at most once per healer, so the order they come back in is moot.
+    zone.next(PZ_HEALERS);
+    refreshUnitPoints(game);
+    forEachHealer(game, [&](int i) {
+        Unit &healer = units[i];
+        if (healer.healRate <= 0.0f || healer.range <= 0.0f) return;
+        float healerCX = healer.fx + healer.width * 0.5f;
+        float healerCY = healer.fy + healer.height * 0.5f;
+        float maxRange = healer.range;
+        game.unitPoints.queryRadius(healerCX, healerCY, maxRange * 1.001f + 1.0f, [&](int j, float) {
+            if (i == j) return;
+            Unit &ally = units[j];
+            if (ally.hp >= ally.maxHp) return;
+            float allyCX = ally.fx + ally.width * 0.5f;
+            float allyCY = ally.fy + ally.height * 0.5f;
+            float dx = allyCX - healerCX;
+            float dy = allyCY - healerCY;
+            float dist = sqrtf(dx*dx + dy*dy);
+            if (dist > maxRange) return;
+            float factor = (maxRange - dist) / maxRange;
+            if (factor < 0.0f) factor = 0.0f;
+            float frameHeal = healer.healRate * factor * dt; 
+            if (frameHeal <= 0.0f) return;
+            ally.healFraction += frameHeal;
+            int whole = (int)ally.healFraction;
+            if (whole > 0) {
+                ally.hp += whole;
+                ally.healFraction -= (float)whole;
+                if (ally.hp > ally.maxHp) {
+                    ally.hp = ally.maxHp;
+                    ally.healFraction = 0.0f; 
+                }
+                if (ally.hp < ally.maxHp) ally.showHp = true;
+            }
+        });
+    });
+
+    zone.next(PZ_ENEMY_AI);
+    refreshUnitPoints(game);
+    const std::vector<float> &unitCX = game.unitCX;
+    const std::vector<float> &unitCY = game.unitCY;
+    game.enemyAttacks.clear();
+    refreshShipFlow(game);
+    updateEnemyKernel(enemies, unitCX.data(), unitCY.data(), (int)units.size(), playerShip.x, playerShip.y, &game.shipFlow,
+                      dt, game.enemyAttacks, &gJobs);
+    game.enemyPointsDirty = true;
+    // Damage is applied in enemy order, same as when each enemy attacked inline.
+    for (const EnemyAttack &atk : game.enemyAttacks) {
+        int damage = (int)enemies.attackDamage[atk.enemy];
+        if (atk.unit != ENEMY_TARGET_SHIP) {
+            Unit &target = units[atk.unit];
+            target.hp -= damage;
+            if (target.hp < 0) target.hp = 0;
+            if (target.hp < target.maxHp) target.showHp = true;
+        } else if (!game.shipInvulnerable) {
+            playerShip.hp -= damage;
+            if (playerShip.hp < 0) playerShip.hp = 0;
+        }
+    }
+
+    zone.next(PZ_HEALERS);
+    float maxUnitW = 0.0f, maxUnitH = 0.0f;
+    for (const Unit &u : units) { maxUnitW = std::max(maxUnitW, (float)u.width); maxUnitH = std::max(maxUnitH, (float)u.height); }
+    forEachHealer(game, [&](int i) {
+        Unit &medic = units[i];
+        if (medic.healRate <= 0.0f) return;
+        
+        Rectangle medicRect = {medic.fx, medic.fy, (float)medic.width, (float)medic.height};
+        // Any unit touching the medic has its center within a unit's size of the medic's box.
+        Rectangle reach = { medicRect.x - maxUnitW, medicRect.y - maxUnitH, medicRect.width + 2*maxUnitW, medicRect.height + 2*maxUnitH };
+        game.unitPoints.queryRect(reach, [&](int j) {
+            if (i == j) return;
+            Unit &patient = units[j];
+            if (patient.hp >= patient.maxHp) return;
+            
+            Rectangle patientRect = {patient.fx, patient.fy, (float)patient.width, (float)patient.height};
+            
+            if (CheckCollisionRecs(medicRect, patientRect)) {
+                patient.hp += (int)(medic.healRate * dt * 2.0f);
+                if (patient.hp > patient.maxHp) patient.hp = patient.maxHp;
+            }
+        });
+    });
+
+    zone.next(PZ_CROWD);
+    separateUnits(game, dt);
+
+    zone.next(PZ_BULLETS);
+    // Broadphase for this tick's bullets: only live enemies and rocks go in the
+    // grids, and each bullet sweeps the segment it travels this tick so fast
+    // bullets at high time scales cannot step over a 32px alien.
+    // With only a handful of bullets in flight a straight scan is cheaper than
+    // rebuilding the enemy grid, so the grid only kicks in past that point.
+    SpatialGrid &enemyGrid = game.enemyGrid;
+    SpatialGrid &rockGrid = game.rockGrid;
+    const int BROADPHASE_MIN_BULLETS = 8;
+    bool useEnemyGrid = (int)bullets.size() >= BROADPHASE_MIN_BULLETS;
+    if (useEnemyGrid) {
+        enemyGrid.clear();
+        for (int ei = 0; ei < enemies.size(); ++ei) enemyGrid.add(ei, enemies.bounds(ei));
+        enemyGrid.build();
+    }
+    refreshRockGrid(game);
+
+    bool enemyDied = false, rockDied = false;
+    for (auto &b : bullets) {
+        Vector2 from{ b.x, b.y };
+        b.prevX = b.x; b.prevY = b.y;
+        b.x += b.vx * dt;
+        b.y += b.vy * dt;
+        Vector2 to{ b.x, b.y };
+        if (b.x < -50 || b.y < -50 || b.x > MAP_WIDTH + 50 || b.y > MAP_HEIGHT + 50) { b.active = false; continue; }
+
+        int hitEnemy = -1, hitRock = -1;
+        float bestT = 2.0f;
+        // Whatever earlier bullets killed this tick stays in the pools until the
+        // compact below, so hits still check the flags.
+        auto considerEnemy = [&](int ei) {
+            if (!enemies.alive[ei]) return;
+            float t;
+            if (!segmentHitsRect(from, to, enemies.bounds(ei), t)) return;
+            // Ties go to the lowest index so the grid and the scan agree.
+            if (t < bestT || (t == bestT && ei < hitEnemy)) { bestT = t; hitEnemy = ei; }
+        };
+        if (useEnemyGrid) enemyGrid.querySegment(from, to, considerEnemy);
+        else for (int ei = 0; ei < enemies.size(); ++ei) considerEnemy(ei);
+        rockGrid.querySegment(from, to, [&](int ri) {
+            const Rock &r = rocks[ri];
+            if (!r.alive) return;
+            Rectangle rr = r.bounds();
+            float t;
+            if (segmentHitsRect(from, to, rr, t) && t < bestT) { bestT = t; hitRock = ri; hitEnemy = -1; }
+        });
+
+        if (hitEnemy != -1) {
+            int e = hitEnemy;
+            enemies.showHp[e] = 1;
+            enemies.hp[e] -= b.damage;
+            if (enemies.hp[e] <= 0) {
+                enemies.alive[e] = 0;
+                enemyDied = true;
+                
+                shop.scrapMetal += game.lootRng.range(tuning.alienScrapMin, tuning.alienScrapMax);
+                
+                particles.emit(PFX_ENEMY_DEATH, enemies.x[e] + ENEMY_SIZE/2.0f, enemies.y[e] + ENEMY_SIZE/2.0f, fxRng);
+            }
+            b.active = false; 
+        } else if (hitRock != -1) {
+            Rock &r = rocks[hitRock];
+            r.showHp = true;
+            r.hp -= b.damage;
+            if (r.hp <= 0) {
+                r.alive = false;
+                rockDied = true;
+                if (!game.shipFlowDirty) game.shipFlow.removeObstacle(r.bounds());
+                int gain = game.lootRng.range(r.scrapMin, r.scrapMax);
+                shop.scrapMetal += gain;
+                particles.emit(PFX_ROCK_BREAK, (float)r.x, (float)r.y, fxRng);
+            }
+            b.active = false;
+        }
+    }
+    bullets.compact([](const Bullet &b) { return !b.active; });
+    if (enemyDied) enemies.compact();
+    if (rockDied) { rocks.compact([](const Rock &r) { return !r.alive; }); game.rockGridDirty = true; }
+
+    zone.next(PZ_PARTICLES);
+    particles.update(dt);
+}
+
+// Sends every unit in idx so the group's center lands on (cx, cy), keeping
+// each unit's offset from the current group center.
+static void moveFormation(Game &game, const std::vector<int> &idx, float cx, float cy) {
+    std::vector<Unit> &units = game.units;
+    Vector2 selCenter{0,0};
+    for (int i : idx) { selCenter.x += units[i].x + units[i].width/2.0f; selCenter.y += units[i].y + units[i].height/2.0f; }
+    selCenter.x /= (float)idx.size(); selCenter.y /= (float)idx.size();
+    for (int i : idx) {
+        Unit &u = units[i];
+        float offX = (u.x + u.width/2.0f) - selCenter.x;
+        float offY = (u.y + u.height/2.0f) - selCenter.y;
+        float tcx = cx + offX, tcy = cy + offY;
+        u.targetX = (int)lroundf(tcx - u.width/2.0f);
+        u.targetY = (int)lroundf(tcy - u.height/2.0f);
+        u.moving = true;
+    }
+}
+
+static void areaAttack(Game &game, const std::vector<int> &selIdx, Rectangle rect) {
+    EnemyStore &enemies = game.enemies;
+    std::vector<int> hits;
+    refreshEnemyPoints(game);
+    // An enemy's box touches rect when its center is within half a box of it.
+    const float half = ENEMY_SIZE / 2.0f;
+    game.enemyPoints.queryRect(Rectangle{ rect.x - half, rect.y - half, rect.width + 2*half, rect.height + 2*half }, [&](int i) {
+        if (CheckCollisionRecs(rect, enemies.bounds(i))) hits.push_back(i);
+    });
+    std::sort(hits.begin(), hits.end());
+    std::vector<EntityId> captured;
+    for (int i : hits) captured.push_back(enemies.idAt(i));
+    Vector2 center{ rect.x + rect.width*0.5f, rect.y + rect.height*0.5f };
+    giveAreaOrder(game, selIdx, rect, captured);
+    distributeTargets(game, selIdx);
+    moveFormation(game, selIdx, center.x, center.y);
+}
+
+static void buyUpgrade(Game &game, int kind) {
+    Ship &ship = game.playerShip;
+    UpgradeShop &shop = game.shop;
+    switch (kind) {
+        case UPGRADE_HULL:
+            if (shop.scrapMetal >= shop.hullUpgradeCost && ship.hullIntegrity < ship.maxHullIntegrity) {
+                shop.scrapMetal -= shop.hullUpgradeCost;
+                ship.hullIntegrity += 8;
+            }
+            break;
+        case UPGRADE_SHIELDING:
+            if (shop.scrapMetal >= shop.shieldingUpgradeCost && ship.shielding < ship.maxShielding) {
+                shop.scrapMetal -= shop.shieldingUpgradeCost;
+                ship.shielding += 5;
+            }
+            break;
+        case UPGRADE_ENGINES:
+            if (shop.scrapMetal >= shop.engineUpgradeCost && ship.engines < ship.maxEngines) {
+                shop.scrapMetal -= shop.engineUpgradeCost;
+                ship.engines += 3;
+            }
+            break;
+        case UPGRADE_LIFE_SUPPORT:
+            if (shop.scrapMetal >= shop.lifeSupportUpgradeCost && ship.lifeSupportSystems < ship.maxLifeSupportSystems) {
+                shop.scrapMetal -= shop.lifeSupportUpgradeCost;
+                ship.lifeSupportSystems += 3;
+            }
+            break;
+    }
+    ship.isComplete = (ship.hullIntegrity >= ship.maxHullIntegrity &&
+                       ship.shielding >= ship.maxShielding &&
+                       ship.engines >= ship.maxEngines &&
+                       ship.lifeSupportSystems >= ship.maxLifeSupportSystems);
+}
+
+void applyCommand(Game &game, const Command &cmd) {
+    std::vector<Unit> &units = game.units;
+    // Unit lists come from input or a file; drop anything out of range.
+    std::vector<int> idx;
+    idx.reserve(cmd.units.size());
+    for (int i : cmd.units) if (i >= 0 && i < (int)units.size()) idx.push_back(i);
+
+    switch (cmd.type) {
+        case CMD_SELECT:
+            for (auto &u : units) u.selected = false;
+            for (int i : idx) units[i].selected = true;
+            break;
+        case CMD_MOVE:
+            if (idx.empty()) break;
+            for (int i : idx) clearUnitOrders(game, i);
+            moveFormation(game, idx, (float)cmd.x, (float)cmd.y);
+            break;
+        case CMD_ATTACK: {
+            // arg holds the enemy's EntityId bits; a stale id means it died first.
+            EntityId target{ (uint32_t)cmd.arg };
+            if (game.enemies.find(target) < 0) break;
+            for (int i : idx) { clearUnitOrders(game, i); setUnitTarget(game, i, target); }
+            break;
+        }
+        case CMD_AREA_ATTACK:
+            if (idx.empty()) break;
+            areaAttack(game, idx, Rectangle{ (float)cmd.x, (float)cmd.y, (float)cmd.w, (float)cmd.h });
+            break;
+        case CMD_UPGRADE:
+            buyUpgrade(game, cmd.arg);
+            break;
+        case CMD_NEXT_WAVE:
+            if (game.inIntermission && game.playerShip.hp > 0 && !game.playerShip.isComplete) startNextWave(game);
+            break;
+        default:
+            break;
+    }
+}
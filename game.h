@@ -0,0 +1,307 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <raylib.h>
+#include <stdint.h>
+#include <vector>
+#include "archetypes.h"
+#include "enemies.h"
+#include "particles.h"
+#include "pool.h"
+#include "rng.h"
+#include "spatial.h"
+
+#ifndef PI
+#define PI 3.14159265358979323846f
+#endif
+
+enum Difficulty {
+    DIFF_CASUAL = 0,
+    DIFF_NORMAL = 1,
+    DIFF_HARD = 2
+};
+
+struct Unit {
+    int x, y;
+    int width, height;
+    int speed;
+    bool selected = false;
+    bool moving = false;
+    int targetX = 0, targetY = 0;
+    float fx = 0.0f, fy = 0.0f;
+    float prevFx = 0.0f, prevFy = 0.0f;
+
+    UnitType type;
+    int hp = 100;
+    int maxHp = 100;
+    float fireRate = 1.0f;
+    float range = 100.0f;
+    int damage = 10;
+    float healRate = 0.0f;
+    bool showHp = false;
+
+    // Orders and timers, kept with the unit so one pass over the army touches one array.
+    bool attacking = false;
+    EntityId target;            // enemy being attacked while attacking
+    int areaOrder = -1;         // index into Game::areaOrders while area attacking
+    float fireTimer = 0.0f;
+    float healFraction = 0.0f;  // healing received short of a whole hp
+    float crowdRadius = 30.0f;  // separation from other units, see crowd.h
+    float crowdWeight = 20.0f;
+    float crowdPushX = 0.0f, crowdPushY = 0.0f, crowdBlock = 0.0f;  // from its last separation slice
+
+    bool areaAttacking() const { return areaOrder >= 0; }
+};
+
+// An area-attack order. Every unit sent by the same command shares one, so a
+// box dragged over hundreds of units stores its capture list once.
+struct AreaOrder {
+    Rectangle rect{};
+    std::vector<EntityId> targets;  // what the box captured; dead entries are pruned as found
+    int users = 0;                  // units carrying it; 0 means the slot is free
+};
+
+struct Bullet {
+    float x, y;
+    float prevX, prevY;
+    float vx, vy;
+    float speed;
+    int damage = 10;
+    int unitIndex = -1;
+    bool active = true;     // cleared on a hit; the pool drops it at the end of the tick
+};
+
+struct Rock {
+    int x, y;
+    int width, height;
+    int hp = 200;
+    int maxHp = 200;
+    bool alive = true;      // cleared when broken; the pool drops it at the end of the tick
+    bool showHp = false;
+    int scrapMin = 6;
+    int scrapMax = 14;
+
+    Rectangle bounds() const { return Rectangle{ (float)(x - width/2), (float)(y - height/2), (float)width, (float)height }; }
+};
+
+struct Ship {
+    float x, y;
+    int width, height;
+    int hp = 100;
+    int maxHp = 100;
+    int hullIntegrity = 0;
+    int maxHullIntegrity = 100;
+    int shielding = 0;
+    int maxShielding = 50;
+    int engines = 0;
+    int maxEngines = 25;
+    int lifeSupportSystems = 0;
+    int maxLifeSupportSystems = 25;
+    bool isComplete = false;
+};
+
+struct UpgradeShop {
+    int scrapMetal = 0;
+    int hullUpgradeCost = 10;
+    int shieldingUpgradeCost = 15;
+    int engineUpgradeCost = 20;
+    int lifeSupportUpgradeCost = 25;
+};
+
+template <typename T>
+static inline T ClampVal(T v, T lo, T hi) { return v < lo ? lo : (v > hi ? hi : v); }
+static inline float LerpVal(float a, float b, float t) { return a + (b - a) * t; }
+
+const float MAP_WIDTH = 3500.0f;
+const float MAP_HEIGHT = 3500.0f;
+
+const int UNIT_COUNT = 6;                // default army: one of each type
+const int MAX_ARMY_SIZE = 1000;
+const int UNIT_WIDTH = 45, UNIT_HEIGHT = 75;
+const int CONTROL_GROUP_COUNT = 9;       // number keys 1-9
+const float FLOW_CELL_SIZE = 32.0f;
+const int SIM_TICK_RATE = 60;
+
+const float TIME_SCALE_MAX = 10000.0f;  // fast-forward as fast as the machine allows
+
+// Turns variable frame times into whole fixed-length simulation ticks. timeScale
+// changes how many ticks a frame runs, never how long a tick is.
+struct FixedTimestep {
+    float tickDt = 1.0f / SIM_TICK_RATE;
+    float accumulator = 0.0f;
+    int maxTicksPerFrame = 16;   // at 1x; a long hitch drops time instead of spiralling. Scales with timeScale.
+
+    void setRate(int ticksPerSecond) { tickDt = 1.0f / (float)ticksPerSecond; accumulator = 0.0f; }
+    int advance(float frameTime, float timeScale);
+    // How far rendering is between the previous tick and the latest one, in [0, 1).
+    float alpha() const { return accumulator / tickDt; }
+};
+
+enum CommandType {
+    CMD_SELECT = 0,     // units becomes the whole selection
+    CMD_MOVE,           // units move in formation so their center lands on (x, y)
+    CMD_ATTACK,         // units focus enemy arg
+    CMD_AREA_ATTACK,    // units clear the enemies inside rect (x, y, w, h)
+    CMD_UPGRADE,        // buy ship upgrade arg (an UpgradeKind)
+    CMD_NEXT_WAVE,      // skip the rest of the intermission
+    CMD_TIME_SCALE,     // frontend only: arg quarter steps of speed, e.g. 4 = 1x
+    CMD_TYPE_COUNT
+};
+
+enum UpgradeKind {
+    UPGRADE_HULL = 0,
+    UPGRADE_SHIELDING,
+    UPGRADE_ENGINES,
+    UPGRADE_LIFE_SUPPORT
+};
+
+// One player action, already resolved against the world (unit indices, enemy
+// index, whole world pixels) so applying it again on the same tick of the same
+// seed does exactly what it did live.
+struct Command {
+    CommandType type = CMD_SELECT;
+    uint32_t tick = 0;
+    std::vector<int> units;
+    int x = 0, y = 0, w = 0, h = 0;
+    int arg = 0;
+};
+
+// Which rock each unit mines when it has nothing to shoot. Kept up to date by
+// events instead of per tick: rocks spawning mark it for a full optimal
+// re-solve, and a unit whose rock died is repaired on its own the next time it
+// asks. When nothing changed, asking is a lookup.
+struct RockAssignments {
+    std::vector<EntityId> unitRock; // per unit, invalid for none
+    std::vector<int> holders;       // per rock slot, how many units it is assigned to
+    bool dirty = true;
+    bool exhausted = false;         // every rock is dead; nothing to repair until more spawn
+
+    void reset(int unitCount) { unitRock.assign(unitCount, EntityId{}); holders.clear(); dirty = true; exhausted = false; }
+    void rocksSpawned() { dirty = true; exhausted = false; }
+};
+
+// Which aliens area-attacking units are shooting at, so a group spreads its
+// fire over what it captured instead of piling onto one target. Changes only
+// when a unit takes or drops a target (setUnitTarget); nothing is rescanned per tick.
+struct TargetClaims {
+    std::vector<int> count;         // per enemy slot, how many area-attacking units are on it
+    std::vector<int> unitClaim;     // per unit, the enemy slot it claims or -1
+
+    void reset(int unitCount) { count.clear(); unitClaim.assign(unitCount, -1); }
+    bool claimed(EntityId enemy) const { int s = enemy.slot(); return s < (int)count.size() && count[s] > 0; }
+};
+
+// Everything the simulation touches. Input and rendering live in main.cpp and
+// only read or poke this state, so the same update runs with or without a window.
+struct Game {
+    Difficulty difficulty = DIFF_NORMAL;
+    int currentWave = 1;
+    int enemiesAlive = 0;
+    uint32_t tick = 0;   // ticks run since startNewGame; commands are stamped with it
+
+    // startNewGame reseeds every stream from this, so a seed plus the same
+    // inputs replays a run exactly.
+    uint64_t seed = 0;
+    Rng spawnRng;
+    Rng lootRng;
+    Rng particleRng;
+
+    // Enemies, bullets and rocks are packed pools: between ticks every entry is
+    // live. Anything that outlives a tick refers to them by EntityId.
+    // Sorted by type: type t is [unitTypeStart[t], unitTypeStart[t + 1]), so
+    // the unit pass runs each type through a loop built for it.
+    std::vector<Unit> units;
+    int unitTypeStart[UNIT_TYPE_COUNT + 1] = {};
+    int armySize = UNIT_COUNT;          // applied by startNewGame; types repeat in UnitType order
+    // Unit and alien stats, applied as they spawn. DEFAULT_ARCHETYPES unless a
+    // balance file replaced them.
+    Archetypes archetypes = DEFAULT_ARCHETYPES;
+    EnemyStore enemies;
+    EntityPool<Bullet> bullets;
+    ParticlePool particles;
+    int particleCapacity = DEFAULT_PARTICLE_CAPACITY;   // applied by startNewGame
+    EntityPool<Rock> rocks;
+
+    SpatialGrid enemyGrid;
+    // Enemy centers for targeting and picking. Rebuilt on first use after
+    // enemies move, spawn or die.
+    PointGrid enemyPoints;
+    bool enemyPointsDirty = true;
+    // Unit centers (also in unitCX/unitCY) for healing, picking and selection.
+    // Rebuilt on first use after units move.
+    PointGrid unitPoints;
+    bool unitPointsDirty = true;
+    // Wounded fighters as of the start of the unit pass, for the medics'
+    // search. hurtUnits maps its ids back to unit indices.
+    PointGrid hurtPoints;
+    std::vector<int> hurtUnits;
+    std::vector<float> hurtCX, hurtCY;
+    SpatialGrid rockGrid;
+    bool rockGridDirty = true;
+    // Paths to the ship around the rocks. Rebuilt when rocks spawn, patched
+    // when one breaks.
+    FlowField shipFlow;
+    bool shipFlowDirty = true;
+
+    Ship playerShip{};
+    UpgradeShop shop{};
+
+    std::vector<AreaOrder> areaOrders;
+    RockAssignments rockAssign;
+    TargetClaims claims;
+
+    bool inIntermission = false;
+    float intermissionTime = 0.0f;
+
+    std::vector<float> unitCX, unitCY;
+    // Separation scratch; see crowd.h.
+    CrowdGrid unitCrowd;
+    std::vector<float> unitCrowdR, unitCrowdW, unitMoveX, unitMoveY, unitPushX, unitPushY, unitBlock;
+    std::vector<EnemyAttack> enemyAttacks;
+
+    // Soak-test switch: enemies still go for the ship but it takes no damage.
+    bool shipInvulnerable = false;
+};
+
+// Stats for one enemy of the given type on the given wave; position is left at 0, 0.
+EnemyNPC makeEnemy(const Archetypes &arch, EnemyType type, int wave, float statScale);
+void startNewGame(Game &game);
+// Puts next in effect mid-game: live units and aliens take its stats, except
+// alien hp and detection range, which were set for the wave they came in on,
+// and the shop its prices. Anything read at spawn time waits for the next spawn.
+void applyArchetypes(Game &game, const Archetypes &next);
+// Resets the grids, flow field and particles, and marks everything built from
+// the entities stale. For a game whose entities were just replaced wholesale.
+void resetDerivedState(Game &game);
+void startNextWave(Game &game);
+// Advances the simulation by dt seconds. Does nothing once the ship is destroyed or complete.
+void updateGame(Game &game, float dt);
+// Index of the rock unit should mine, or -1 once none are left.
+int assignedRock(Game &game, int unit);
+// Points unit at enemy (an invalid id stands it down) and keeps the claim table
+// in step. Every change to a unit's attacking/target goes through here.
+void setUnitTarget(Game &game, int unit, EntityId enemy);
+// Gives the units in idx one shared area-attack order on rect over captured.
+void giveAreaOrder(Game &game, const std::vector<int> &idx, Rectangle rect, const std::vector<EntityId> &captured);
+// Drops any attack or area-attack order the unit has.
+void clearUnitOrders(Game &game, int unit);
+// Best target left in the unit's area-attack list: the nearest one no other
+// unit claims, else the nearest overall. Prunes dead entries; invalid once empty.
+EntityId pickAreaTarget(Game &game, int unit);
+// Gives each unit in idx a target from its area-attack list in turn, so later
+// units see the claims of earlier ones.
+void distributeTargets(Game &game, const std::vector<int> &idx);
+// Rebuilds the enemy point grid if enemies changed since the last build.
+void refreshEnemyPoints(Game &game);
+// Rebuilds unitCX/unitCY and the unit point grid if units moved since the last build.
+void refreshUnitPoints(Game &game);
+// Rebuilds the rock grid if rocks were added or dropped since the last build.
+// Rocks broken this tick stay in it until then; queries skip them.
+void refreshRockGrid(Game &game);
+// Rebuilds the ship flow field if rocks spawned since the last build.
+void refreshShipFlow(Game &game);
+// Applies a player action before the next tick. Input handling and replay
+// playback both go through here, so a recording replays exactly.
+void applyCommand(Game &game, const Command &cmd);
+
+#endif
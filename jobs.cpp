@@ -0,0 +1,95 @@
+#include "jobs.h"
+
+JobSystem gJobs;
+
+void JobSystem::start(int workers) {
+    stop();
+    if (workers <= 0) return;
+    quitting = false;
+    for (int i = 0; i <= workers; ++i) queues.emplace_back(new WorkQueue());
+    for (int i = 1; i <= workers; ++i) threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::stop() {
+    if (threads.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : threads) t.join();
+    threads.clear();
+    queues.clear();
+}
+
+bool JobSystem::take(int self, Job &out) {
+    {
+        WorkQueue &own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            out = own.jobs.back();
+            own.jobs.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    int n = (int)queues.size();
+    for (int k = 1; k < n; ++k) {
+        WorkQueue &victim = *queues[(self + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            out = victim.jobs.front();
+            victim.jobs.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline void runJob(const Job &job, int worker) {
+    (*job.fn)(job.begin, job.end, worker);
+    // Last touch of the batch: the caller may return as soon as this hits zero.
+    job.remaining->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::workerLoop(int self) {
+    for (;;) {
+        Job job;
+        if (take(self, job)) { runJob(job, self); continue; }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] { return quitting || queued.load() > 0; });
+        if (quitting) return;
+    }
+}
+
+void JobSystem::parallelFor(int count, int grain, const RangeFn &fn) {
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+    int chunks = (count + grain - 1) / grain;
+    if (threads.empty() || chunks == 1) {
+        for (int begin = 0; begin < count; begin += grain) fn(begin, begin + grain < count ? begin + grain : count, 0);
+        return;
+    }
+
+    std::atomic<int> remaining(chunks);
+    int n = (int)queues.size();
+    for (int c = 0; c < chunks; ++c) {
+        int begin = c * grain, end = begin + grain < count ? begin + grain : count;
+        WorkQueue &q = *queues[c % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.jobs.push_back(Job{ &fn, begin, end, &remaining });
+        queued++;
+    }
+    {
+        // Taking the lock orders the pushes before any sleeper rechecks queued.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_all();
+
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        Job job;
+        if (take(0, job)) runJob(job, 0);
+        else std::this_thread::yield();
+    }
+}
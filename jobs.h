@@ -0,0 +1,58 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fn(begin, end, worker): one chunk of a parallelFor. worker is in
+// [0, threadCount()), 0 being the calling thread, so it can index per-thread buffers.
+typedef std::function<void(int, int, int)> RangeFn;
+
+struct Job {
+    const RangeFn *fn;
+    int begin, end;
+    std::atomic<int> *remaining;
+};
+
+struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+};
+
+// Small fork-join pool. Every thread owns a deque: it takes its own jobs from
+// the back and, once that is empty, steals from the front of someone else's.
+// The thread calling parallelFor is worker 0 and works through the batch with
+// the others instead of blocking. Not re-entrant: jobs must not call parallelFor.
+struct JobSystem {
+    // workers extra threads beside the caller; 0 runs everything inline.
+    void start(int workers);
+    void stop();
+    int threadCount() const { return queues.empty() ? 1 : (int)queues.size(); }
+
+    // Splits [0, count) into chunks of grain and returns once all have run.
+    // Chunk boundaries depend only on count and grain, never on the thread count.
+    void parallelFor(int count, int grain, const RangeFn &fn);
+
+    ~JobSystem() { stop(); }
+
+private:
+    std::vector<std::unique_ptr<WorkQueue>> queues;   // [0] belongs to the caller
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int> queued{0};
+    bool quitting = false;
+
+    bool take(int self, Job &out);
+    void workerLoop(int self);
+};
+
+extern JobSystem gJobs;
+
+#endif
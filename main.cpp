@@ -1,12 +1,21 @@
 #include <raylib.h>
+#include <rlgl.h>
 #include <vector>
 #include <cmath>
 #include <algorithm>
 #include <cstdio>
-
-#ifndef PI
-#define PI 3.14159265358979323846f
-#endif
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "atlas.h"
+#include "background.h"
+#include "filewatch.h"
+#include "game.h"
+#include "jobs.h"
+#include "profiler.h"
+#include "replay.h"
+#include "rewind.h"
+#include "snapshot.h"
 
 enum GameState {
     STATE_MENU,
@@ -14,138 +23,539 @@ enum GameState {
     STATE_GAME
 };
 
-enum Difficulty {
-    DIFF_CASUAL = 0,
-    DIFF_NORMAL = 1,
-    DIFF_HARD = 2
-};
-
-enum UnitType {
-    UNIT_RIFLE,   
-    UNIT_SHOTGUN,
-    UNIT_SNIPER,
-    UNIT_HEAVY,
-    UNIT_ROCKET,
-    UNIT_HEALER
+struct LaunchOptions {
+    bool headless = false;
+    int waves = 10;
+    Difficulty difficulty = DIFF_NORMAL;
+    bool hasSeed = false;
+    unsigned int seed = 0;
+    long long maxTicks = 0;
+    bool invulnerable = false;
+    int tickRate = SIM_TICK_RATE;
+    const char *recordPath = nullptr;
+    const char *replayPath = nullptr;
+    bool profile = false;
+    const char *tracePath = nullptr;
+    int maxParticles = DEFAULT_PARTICLE_CAPACITY;
+    int threads = 0;    // 0: one per core
+    int armySize = UNIT_COUNT;
+    const char *balancePath = nullptr;
+    const char *writeBalancePath = nullptr;
+    const char *loadSnapshotPath = nullptr;
+    const char *saveSnapshotPath = nullptr;
+    int rewindBudgetMb = 64;    // 0: no rewind buffer
+    long long rewindTo = -1;    // headless: tick to rewind to after the run
+    Archetypes archetypes = DEFAULT_ARCHETYPES;     // with --balance applied
 };
 
-enum EnemyType {
-    ENEMY_GRUNT,
-    ENEMY_FAST,
-    ENEMY_TANK,
-    ENEMY_SHOOTER,
-    ENEMY_SIEGE
-};
+static void printUsage(const char *exe) {
+    printf("Usage: %s [--headless] [--waves N] [--difficulty casual|normal|hard] [--seed N] [--max-ticks N] [--invulnerable] [--tick-rate HZ]\n"
+           "          [--record FILE] [--replay FILE] [--profile] [--trace FILE] [--max-particles N] [--threads N]\n"
+           "          [--army N] [--balance FILE] [--write-balance FILE] [--load-snapshot FILE] [--save-snapshot FILE]\n"
+           "          [--rewind-budget MB] [--rewind-to TICK]\n", exe);
+    printf("  --headless        run the simulation without a window, as fast as possible\n");
+    printf("  --waves N         headless: stop once wave N has been cleared (default 10)\n");
+    printf("  --difficulty D    starting difficulty (default normal)\n");
+    printf("  --seed N          seed the simulation for reproducible runs (default: clock)\n");
+    printf("  --max-ticks N     headless: stop after N simulation ticks (default unlimited)\n");
+    printf("  --invulnerable    headless: the ship takes no damage, for long soak runs\n");
+    printf("  --tick-rate HZ    simulation ticks per second (default %d)\n", SIM_TICK_RATE);
+    printf("  --record FILE     save every player command of the last game to FILE\n");
+    printf("  --replay FILE     play FILE back instead of live input; seed, difficulty\n");
+    printf("                    and tick rate come from the recording\n");
+    printf("  --profile         headless: print time spent per simulation phase\n");
+    printf("  --trace FILE      capture profiling zones from startup and write them to FILE\n");
+    printf("                    as Chrome trace JSON (window: F4 toggles capture, F3 the overlay)\n");
+    printf("  --max-particles N particle pool size; a full pool recycles the oldest (default %d)\n", DEFAULT_PARTICLE_CAPACITY);
+    printf("  --threads N       simulation threads including the main one (default: one per core);\n");
+    printf("                    results are identical for any N\n");
+    printf("  --army N          start with N units, the types in turn (default %d, max %d)\n", UNIT_COUNT, MAX_ARMY_SIZE);
+    printf("  --balance FILE    take stats and tuning from FILE; what it leaves out keeps the defaults\n");
+    printf("                    (window: reloaded each time FILE is saved)\n");
+    printf("  --write-balance FILE\n");
+    printf("                    write the stats in effect (the defaults, or --balance over them) to FILE and exit\n");
+    printf("  --load-snapshot FILE\n");
+    printf("                    start from the game saved in FILE instead of a new one; its seed, difficulty\n");
+    printf("                    and stats come with it, though --balance overrides the stats (window: F9 loads it again)\n");
+    printf("  --save-snapshot FILE\n");
+    printf("                    headless: save the game to FILE when the run ends (window: F5 saves,\n");
+    printf("                    default snapshot.bin)\n");
+    printf("  --rewind-budget MB\n");
+    printf("                    memory for rewinding through the last minutes of play (default 64, 0 for none);\n");
+    printf("                    window: , and . step back and forward a tick, a second with shift\n");
+    printf("  --rewind-to TICK  headless: after the run, rewind to TICK before printing its state hash\n");
+    printf("                    and saving --save-snapshot\n");
+}
+
+static bool parseArgs(int argc, char **argv, LaunchOptions &opts) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (strcmp(arg, "--headless") == 0) {
+            opts.headless = true;
+        } else if (strcmp(arg, "--waves") == 0 && hasValue) {
+            opts.waves = atoi(argv[++i]);
+            if (opts.waves < 1) return false;
+        } else if (strcmp(arg, "--difficulty") == 0 && hasValue) {
+            const char *d = argv[++i];
+            if (strcmp(d, "casual") == 0) opts.difficulty = DIFF_CASUAL;
+            else if (strcmp(d, "normal") == 0) opts.difficulty = DIFF_NORMAL;
+            else if (strcmp(d, "hard") == 0) opts.difficulty = DIFF_HARD;
+            else return false;
+        } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+            opts.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+            opts.hasSeed = true;
+        } else if (strcmp(arg, "--max-ticks") == 0 && hasValue) {
+            opts.maxTicks = atoll(argv[++i]);
+        } else if (strcmp(arg, "--invulnerable") == 0) {
+            opts.invulnerable = true;
+        } else if (strcmp(arg, "--tick-rate") == 0 && hasValue) {
+            opts.tickRate = atoi(argv[++i]);
+            if (opts.tickRate < 10 || opts.tickRate > 1000) return false;
+        } else if (strcmp(arg, "--record") == 0 && hasValue) {
+            opts.recordPath = argv[++i];
+        } else if (strcmp(arg, "--replay") == 0 && hasValue) {
+            opts.replayPath = argv[++i];
+        } else if (strcmp(arg, "--profile") == 0) {
+            opts.profile = true;
+        } else if (strcmp(arg, "--trace") == 0 && hasValue) {
+            opts.tracePath = argv[++i];
+        } else if (strcmp(arg, "--max-particles") == 0 && hasValue) {
+            opts.maxParticles = atoi(argv[++i]);
+            if (opts.maxParticles < 0) return false;
+        } else if (strcmp(arg, "--threads") == 0 && hasValue) {
+            opts.threads = atoi(argv[++i]);
+            if (opts.threads < 1) return false;
+        } else if (strcmp(arg, "--army") == 0 && hasValue) {
+            opts.armySize = atoi(argv[++i]);
+            if (opts.armySize < 1 || opts.armySize > MAX_ARMY_SIZE) return false;
+        } else if (strcmp(arg, "--balance") == 0 && hasValue) {
+            const char *path = opts.balancePath = argv[++i];
+            std::string error;
+            if (!loadArchetypes(path, opts.archetypes, error)) {
+                fprintf(stderr, "failed to load balance %s: %s\n", path, error.c_str());
+                return false;
+            }
+        } else if (strcmp(arg, "--write-balance") == 0 && hasValue) {
+            opts.writeBalancePath = argv[++i];
+        } else if (strcmp(arg, "--load-snapshot") == 0 && hasValue) {
+            opts.loadSnapshotPath = argv[++i];
+        } else if (strcmp(arg, "--save-snapshot") == 0 && hasValue) {
+            opts.saveSnapshotPath = argv[++i];
+        } else if (strcmp(arg, "--rewind-budget") == 0 && hasValue) {
+            opts.rewindBudgetMb = atoi(argv[++i]);
+            if (opts.rewindBudgetMb < 0 || opts.rewindBudgetMb > 65536) return false;
+        } else if (strcmp(arg, "--rewind-to") == 0 && hasValue) {
+            opts.rewindTo = atoll(argv[++i]);
+            if (opts.rewindTo < 0) return false;
+        } else {
+            return false;
+        }
+    }
+    // A recording starts from a new game, so it cannot pick up from a snapshot.
+    if (opts.loadSnapshotPath && (opts.recordPath || opts.replayPath)) {
+        fprintf(stderr, "--load-snapshot cannot be combined with --record or --replay\n");
+        return false;
+    }
+    return true;
+}
+
+// Fast-forward speeds the F key cycles through. TIME_SCALE_MAX means "as fast as
+// possible": the sim just gets a bigger wall-clock slice per displayed frame.
+static const float FAST_FORWARD_SPEEDS[] = { 10.0f, 50.0f, TIME_SCALE_MAX };
+static const int FAST_FORWARD_COUNT = 3;
+static const double FF_FRAME_BUDGET_S = 0.012;  // leaves room to draw inside a 60 Hz frame
+static const double FF_MAX_BUDGET_S = 0.100;    // at max the window redraws ~10 times a second
+
+static const char *difficultyName(Difficulty d) {
+    return (d == DIFF_CASUAL) ? "casual" : (d == DIFF_NORMAL ? "normal" : "hard");
+}
+
+// Stand-in for the player during headless runs: units that have nothing left to
+// shoot or mine walk toward the nearest alien, so waves cannot stall.
+static void autopilotOrders(Game &game, std::vector<Command> &out) {
+    refreshEnemyPoints(game);
+    for (int i = 0; i < (int)game.units.size(); ++i) {
+        const Unit &u = game.units[i];
+        if (UNIT_TRAITS[u.type].heals || u.moving || u.attacking) continue;
+        float ucx = u.fx + u.width/2.0f, ucy = u.fy + u.height/2.0f;
+        const EnemyStore &es = game.enemies;
+        int nearest = game.enemyPoints.nearest(ucx, ucy, 1e9f);
+        if (nearest == -1) continue;
+        Command c;
+        c.type = CMD_MOVE;
+        c.units.push_back(i);
+        c.x = (int)lroundf(es.x[nearest]);
+        c.y = (int)lroundf(es.y[nearest]);
+        out.push_back(c);
+    }
+}
+
+// Topmost (last drawn) enemy whose box contains p, or -1.
+static int enemyAt(Game &game, Vector2 p) {
+    refreshEnemyPoints(game);
+    const float half = ENEMY_SIZE / 2.0f;
+    int hit = -1;
+    game.enemyPoints.queryRect(Rectangle{ p.x - half, p.y - half, 2*half, 2*half }, [&](int i) {
+        if (i > hit && CheckCollisionPointRec(p, game.enemies.bounds(i))) hit = i;
+    });
+    return hit;
+}
+
+// Topmost rock whose box contains p, or -1.
+static int rockAt(Game &game, Vector2 p) {
+    refreshRockGrid(game);
+    int hit = -1;
+    game.rockGrid.queryRect(Rectangle{ p.x, p.y, 0.0f, 0.0f }, [&](int i) {
+        if (i > hit && game.rocks[i].alive && CheckCollisionPointRec(p, game.rocks[i].bounds())) hit = i;
+    });
+    return hit;
+}
+
+// Topmost (last drawn) fighter whose box contains p, or -1. Medics follow on
+// their own and cannot be picked.
+static int unitAt(Game &game, Vector2 p) {
+    refreshUnitPoints(game);
+    const float halfW = UNIT_WIDTH / 2.0f + 1.0f, halfH = UNIT_HEIGHT / 2.0f + 1.0f;
+    int hit = -1;
+    game.unitPoints.queryRect(Rectangle{ p.x - halfW, p.y - halfH, 2*halfW, 2*halfH }, [&](int i) {
+        const Unit &u = game.units[i];
+        if (i < hit || UNIT_TRAITS[u.type].heals) return;
+        if (CheckCollisionPointRec(p, Rectangle{ (float)u.x, (float)u.y, (float)u.width, (float)u.height })) hit = i;
+    });
+    return hit;
+}
+
+// Fighters whose box overlaps r, in index order.
+static void unitsIn(Game &game, Rectangle r, std::vector<int> &out) {
+    refreshUnitPoints(game);
+    const float halfW = UNIT_WIDTH / 2.0f + 1.0f, halfH = UNIT_HEIGHT / 2.0f + 1.0f;
+    out.clear();
+    game.unitPoints.queryRect(Rectangle{ r.x - halfW, r.y - halfH, r.width + 2*halfW, r.height + 2*halfH }, [&](int i) {
+        const Unit &u = game.units[i];
+        if (UNIT_TRAITS[u.type].heals) return;
+        if (CheckCollisionRecs(r, Rectangle{ (float)u.x, (float)u.y, (float)u.width, (float)u.height })) out.push_back(i);
+    });
+    std::sort(out.begin(), out.end());
+}
+
+static Color unitTypeColor(UnitType t) {
+    switch (t) {
+        case UNIT_RIFLE: return WHITE;
+        case UNIT_SHOTGUN: return YELLOW;
+        case UNIT_SNIPER: return BLUE;
+        case UNIT_HEAVY: return RED;
+        case UNIT_ROCKET: return ORANGE;
+        case UNIT_HEALER: return GREEN;
+        default: return YELLOW;
+    }
+}
+
+// FNV-1a over the gameplay state, so two runs can be compared by one number.
+static uint64_t stateHash(const Game &game) {
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&](const void *p, size_t n) {
+        const unsigned char *b = (const unsigned char *)p;
+        for (size_t i = 0; i < n; ++i) { h ^= b[i]; h *= 1099511628211ULL; }
+    };
+    mix(&game.tick, sizeof game.tick);
+    mix(&game.currentWave, sizeof game.currentWave);
+    mix(&game.playerShip.hp, sizeof game.playerShip.hp);
+    mix(&game.shop.scrapMetal, sizeof game.shop.scrapMetal);
+    for (const Unit &u : game.units) {
+        mix(&u.fx, sizeof u.fx); mix(&u.fy, sizeof u.fy); mix(&u.hp, sizeof u.hp);
+    }
+    const EnemyStore &es = game.enemies;
+    for (int i = 0; i < es.size(); ++i) {
+        mix(&es.x[i], sizeof(float)); mix(&es.y[i], sizeof(float)); mix(&es.hp[i], sizeof(int));
+    }
+    for (const Rock &r : game.rocks) mix(&r.hp, sizeof r.hp);
+    return h;
+}
+
+// World-space rectangle the camera shows. The camera never rotates.
+static Rectangle cameraView(const Camera2D &cam, int screenW, int screenH) {
+    return Rectangle{ cam.target.x - cam.offset.x / cam.zoom, cam.target.y - cam.offset.y / cam.zoom,
+                      screenW / cam.zoom, screenH / cam.zoom };
+}
+
+static inline bool inView(const Rectangle &v, float x, float y, float w, float h) {
+    return x < v.x + v.width && x + w > v.x && y < v.y + v.height && y + h > v.y;
+}
+
+static inline bool circleInView(const Rectangle &v, float cx, float cy, float r) {
+    return inView(v, cx - r, cy - r, 2.0f * r, 2.0f * r);
+}
+
+// Every visible particle as a quad in the same rlgl batch as the sprites, rather
+// than a DrawCircle (and its triangle fan) each. They are 2-3 px, so a square
+// reads the same as a circle.
+static void drawParticles(const ParticlePool &pool, float alpha, const SpriteAtlas &atlas, const Rectangle &view) {
+    if (pool.count == 0) return;
+    const Rectangle &w = atlas[SPRITE_WHITE];
+    float u0 = w.x / atlas.texture.width, v0 = w.y / atlas.texture.height;
+    float u1 = (w.x + w.width) / atlas.texture.width, v1 = (w.y + w.height) / atlas.texture.height;
+    rlSetTexture(atlas.texture.id);
+    rlBegin(RL_QUADS);
+    rlNormal3f(0.0f, 0.0f, 1.0f);
+    for (int i = 0; i < pool.count; ++i) {
+        float x = LerpVal(pool.prevX[i], pool.x[i], alpha), y = LerpVal(pool.prevY[i], pool.y[i], alpha);
+        if (!circleInView(view, x, y, 3.0f)) continue;
+        float fade = ClampVal(pool.life[i] * pool.invMaxLife[i], 0.0f, 1.0f);
+        float half = 2.0f + (1.0f - fade);
+        Color c = pool.color[i];
+        rlColor4ub(c.r, c.g, c.b, (unsigned char)(fade * 255));
+        rlTexCoord2f(u0, v0); rlVertex2f(x - half, y - half);
+        rlTexCoord2f(u0, v1); rlVertex2f(x - half, y + half);
+        rlTexCoord2f(u1, v1); rlVertex2f(x + half, y + half);
+        rlTexCoord2f(u1, v0); rlVertex2f(x + half, y - half);
+    }
+    rlEnd();
+    rlSetTexture(0);
+}
+
+// A replay runs under the stats in effect, which only reproduces it if they are
+// the ones it was recorded with.
+static void checkReplayBalance(const Recording &rec, const Archetypes &a) {
+    if (rec.archetypesHash && rec.archetypesHash != archetypesHash(a))
+        fprintf(stderr, "warning: the replay was recorded with other unit and alien stats; pass the same --balance file\n");
+}
+
+// Steps the same simulation the windowed game runs, with no window or GL context,
+// at a fixed tick and no frame pacing. With --replay the recorded commands drive
+// the units instead of the autopilot and the run ends where the recording does.
+static int runHeadless(const LaunchOptions &opts) {
+    Recording replay;
+    ReplayCursor cursor;
+    if (opts.replayPath) {
+        std::string error;
+        if (!loadRecording(opts.replayPath, replay, error)) {
+            fprintf(stderr, "failed to load replay %s: %s\n", opts.replayPath, error.c_str());
+            return 1;
+        }
+        cursor.rec = &replay;
+        checkReplayBalance(replay, opts.archetypes);
+    }
 
-struct Unit {
-    int x, y; 
-    int width, height;   
-    int speed;           
-    Texture2D texture;   
-    bool selected = false;
-    bool moving = false;
-    int targetX = 0, targetY = 0;
-    float fx = 0.0f, fy = 0.0f;
-    
-    UnitType type;
-    int hp = 100;
-    int maxHp = 100;
-    float fireRate = 1.0f;   
-    float range = 100.0f;
-    int damage = 10;
-    float healRate = 0.0f;
-    bool showHp = false;
-};
+    Recording record;
+    record.seed = opts.replayPath ? replay.seed : opts.seed;
+    record.difficulty = opts.replayPath ? replay.difficulty : opts.difficulty;
+    record.tickRate = opts.replayPath ? replay.tickRate : opts.tickRate;
+    record.invulnerable = opts.replayPath ? replay.invulnerable : opts.invulnerable;
+    record.armySize = opts.replayPath ? replay.armySize : opts.armySize;
+    record.archetypesHash = archetypesHash(opts.archetypes);
+    const float TICK_DT = 1.0f / (float)record.tickRate;
+
+    Game game;
+    game.difficulty = record.difficulty;
+    game.seed = record.seed;
+    game.particleCapacity = opts.maxParticles;
+    game.armySize = record.armySize;
+    game.archetypes = opts.archetypes;
+    if (opts.loadSnapshotPath) {
+        std::string error;
+        auto s0 = std::chrono::steady_clock::now();
+        if (!loadSnapshot(opts.loadSnapshotPath, game, error)) {
+            fprintf(stderr, "failed to load snapshot %s: %s\n", opts.loadSnapshotPath, error.c_str());
+            return 1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s0).count();
+        printf("loaded snapshot %s in %.3f ms: wave %d tick %u enemies %d units %d\n", opts.loadSnapshotPath, ms,
+               game.currentWave, game.tick, game.enemies.size(), (int)game.units.size());
+        // The snapshot brings the stats it was saved with; the balance file wins.
+        if (opts.balancePath) applyArchetypes(game, opts.archetypes);
+        if (opts.invulnerable) game.shipInvulnerable = true;
+    } else {
+        startNewGame(game);
+        game.shipInvulnerable = record.invulnerable;
+    }
 
-struct EnemyNPC {
-    int x, y;           
-    int width, height; 
-    int hp = 1;       
-    int maxHp = 1;     
-    bool showHp = false;
-    bool alive = true;
-    
-    float fx = 0.0f, fy = 0.0f; 
-    float moveSpeed = 120.0f;
-    float detectionRange = 450.0f; 
-    float attackRange = 100.0f;
-    float shipDetectionRange = 12000.0f; 
-    float attackDamage = 15.0f;
-    float attackCooldown = 2.0f;
-    float timeSinceLastAttack = 0.0f;
-    int targetUnitIndex = -1;
-    EnemyType type = ENEMY_GRUNT;
-    bool prioritizeShip = false;     
-    float avoidUnitsRange = 0.0f;   
-};
+    if (opts.replayPath) {
+        printf("headless replay: %s difficulty=%s seed=%llu tick-rate=%d commands=%d end-tick=%u\n", opts.replayPath,
+               difficultyName(record.difficulty), (unsigned long long)record.seed, record.tickRate,
+               (int)replay.commands.size(), replay.endTick);
+    } else {
+        printf("headless: difficulty=%s waves=%d seed=%llu tick-rate=%d army=%d\n", difficultyName(game.difficulty), opts.waves,
+               (unsigned long long)game.seed, opts.tickRate, (int)game.units.size());
+    }
 
-struct Bullet {
-    float x, y;
-    float vx, vy;
-    float speed;
-    int damage = 10;
-    int unitIndex = -1;
-    bool active = true;
-};
+    if (opts.profile) gProfiler.enabled = true;
+    if (opts.tracePath) gProfiler.startCapture();
 
-struct Particle {
-    float x, y, vx, vy;
-    float life, maxLife;
-    Color color;
-    bool active;
-};
+    // Only kept headless when something is going to rewind.
+    RewindBuffer rewind;
+    bool rewinding = opts.rewindTo >= 0 && opts.rewindBudgetMb > 0;
+    if (rewinding) {
+        rewind.budgetBytes = (size_t)opts.rewindBudgetMb << 20;
+        rewind.keyframeInterval = record.tickRate;
+        rewind.reset(game);
+    }
 
-struct Rock {
-    int x, y;
-    int width, height;
-    int hp = 200;
-    int maxHp = 200;
-    bool alive = true;
-    bool showHp = false;
-    int scrapMin = 6;
-    int scrapMax = 14;
-};
+    long long ticks = 0;
+    std::vector<Command> orders;
+    auto t0 = std::chrono::steady_clock::now();
+    for (;;) {
+        if (opts.maxTicks > 0 && ticks >= opts.maxTicks) break;
+        if (opts.replayPath) {
+            size_t from = cursor.next;
+            cursor.applyDue(game);
+            if (rewinding) for (size_t k = from; k < cursor.next; ++k) rewind.command(game, replay.commands[k]);
+            if (cursor.finished(game)) break;
+        } else {
+            if (game.playerShip.hp <= 0 || game.playerShip.isComplete) break;
+            if (game.inIntermission && game.currentWave >= opts.waves) break;
+            if (game.tick % 30 == 0) {
+                orders.clear();
+                autopilotOrders(game, orders);
+                for (Command &c : orders) {
+                    c.tick = game.tick;
+                    if (rewinding) rewind.command(game, c);
+                    applyCommand(game, c);
+                    if (opts.recordPath) record.commands.push_back(c);
+                }
+            }
+        }
+        {
+            ProfileScope zone(PZ_SIM);
+            updateGame(game, TICK_DT);
+        }
+        if (rewinding) rewind.afterTick(game);
+        ticks++;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double wall = std::chrono::duration<double>(t1 - t0).count();
+
+    const char *outcome = "tick limit reached";
+    if (opts.replayPath && cursor.finished(game)) outcome = "replay finished";
+    if (game.playerShip.hp <= 0) outcome = "ship destroyed";
+    else if (game.playerShip.isComplete) outcome = "ship complete";
+    else if (!opts.replayPath && game.inIntermission && game.currentWave >= opts.waves) outcome = "target wave cleared";
+
+    printf("ticks: %lld  sim time: %.1f s  wall: %.3f s  ticks/sec: %.0f\n",
+           ticks, ticks * (double)TICK_DT, wall, wall > 0.0 ? ticks / wall : 0.0);
+    printf("result: %s at wave %d\n", outcome, game.currentWave);
+    printf("ship hp: %d/%d  scrap: %d  enemies alive: %d  bullets: %d  rocks: %d\n",
+           game.playerShip.hp, game.playerShip.maxHp, game.shop.scrapMetal, game.enemiesAlive,
+           game.bullets.size(), game.rocks.size());
+    if ((int)game.units.size() <= 2 * UNIT_COUNT) {
+        for (const auto &u : game.units) {
+            printf("  unit %d: hp %d/%d at (%d, %d)\n", (int)u.type, u.hp, u.maxHp, u.x, u.y);
+        }
+    } else {
+        int alive = 0, hp = 0, maxHp = 0;
+        for (const auto &u : game.units) { alive += u.hp > 0; hp += std::max(u.hp, 0); maxHp += u.maxHp; }
+        printf("  units: %d, %d above 0 hp, hp %d/%d\n", (int)game.units.size(), alive, hp, maxHp);
+    }
+    printf("state: %016llx\n", (unsigned long long)stateHash(game));
+    if (rewinding) {
+        printf("rewind: ticks %u-%u in %d keyframes, %.1f MB\n", rewind.oldestTick(), rewind.newestTick(),
+               rewind.keyframes(), rewind.bytes() / 1048576.0);
+        auto s0 = std::chrono::steady_clock::now();
+        if (!rewind.seek(game, (uint32_t)opts.rewindTo, TICK_DT)) {
+            fprintf(stderr, "cannot rewind to tick %lld: the buffer holds %u-%u\n", opts.rewindTo, rewind.oldestTick(),
+                    rewind.newestTick());
+            return 1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s0).count();
+        printf("rewound to tick %u in %.3f ms at wave %d\n", game.tick, ms, game.currentWave);
+        printf("state: %016llx\n", (unsigned long long)stateHash(game));
+    }
 
-struct Ship {
-    float x, y;
-    int width, height;
-    int hp = 100;
-    int maxHp = 100;
-    int hullIntegrity = 0;
-    int maxHullIntegrity = 100;
-    int shielding = 0;
-    int maxShielding = 50;
-    int engines = 0;
-    int maxEngines = 25;
-    int lifeSupportSystems = 0;
-    int maxLifeSupportSystems = 25;
-    bool isComplete = false;
-};
+    if (gProfiler.enabled && ticks > 0) {
+        printf("%-14s %10s %12s %6s\n", "zone", "total ms", "us/tick", "share");
+        double simNs = (double)gProfiler.totalNs[PZ_SIM];
+        for (int z = PZ_SIM; z <= PZ_PARTICLES; ++z) {
+            double ns = (double)gProfiler.totalNs[z];
+            printf("%-14s %10.1f %12.3f %5.1f%%\n", profileZoneName(z), ns / 1e6, ns / 1e3 / ticks,
+                   simNs > 0.0 ? 100.0 * ns / simNs : 0.0);
+        }
+    }
+    if (opts.tracePath) {
+        gProfiler.stopCapture();
+        if (!gProfiler.writeTrace(opts.tracePath)) {
+            fprintf(stderr, "failed to write trace %s\n", opts.tracePath);
+            return 1;
+        }
+        printf("trace: %d events to %s", (int)gProfiler.events.size(), opts.tracePath);
+        if (gProfiler.droppedEvents) printf(" (%d dropped, buffer full)", (int)gProfiler.droppedEvents);
+        printf("\n");
+    }
 
-struct UpgradeShop {
-    int scrapMetal = 0;
-    int hullUpgradeCost = 10;
-    int shieldingUpgradeCost = 15;
-    int engineUpgradeCost = 20;
-    int lifeSupportUpgradeCost = 25;
-};
+    if (opts.recordPath) {
+        record.endTick = game.tick;
+        if (!saveRecording(opts.recordPath, record)) {
+            fprintf(stderr, "failed to write recording %s\n", opts.recordPath);
+            return 1;
+        }
+        printf("recorded %d commands to %s\n", (int)record.commands.size(), opts.recordPath);
+    }
+    if (opts.saveSnapshotPath) {
+        std::string error;
+        auto s0 = std::chrono::steady_clock::now();
+        if (!saveSnapshot(opts.saveSnapshotPath, game, error)) {
+            fprintf(stderr, "failed to write snapshot %s: %s\n", opts.saveSnapshotPath, error.c_str());
+            return 1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s0).count();
+        printf("saved snapshot to %s in %.3f ms\n", opts.saveSnapshotPath, ms);
+    }
+    return 0;
+}
 
-template <typename T>
-static inline T ClampVal(T v, T lo, T hi) { return v < lo ? lo : (v > hi ? hi : v); }
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) { printUsage(argv[0]); return 0; }
+    }
+    LaunchOptions opts;
+    if (!parseArgs(argc, argv, opts)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (opts.writeBalancePath) {
+        if (!saveArchetypes(opts.writeBalancePath, opts.archetypes)) {
+            fprintf(stderr, "failed to write balance %s\n", opts.writeBalancePath);
+            return 1;
+        }
+        printf("wrote balance to %s\n", opts.writeBalancePath);
+        return 0;
+    }
+    if (!opts.hasSeed) opts.seed = (unsigned int)std::chrono::steady_clock::now().time_since_epoch().count();
+    int threads = opts.threads > 0 ? opts.threads : (int)std::thread::hardware_concurrency();
+    gJobs.start(std::min(threads, 64) - 1);
+    if (opts.headless) return runHeadless(opts);
+
+    Recording replay;
+    ReplayCursor replayCursor;
+    bool replaying = false;
+    if (opts.replayPath) {
+        std::string error;
+        if (!loadRecording(opts.replayPath, replay, error)) {
+            fprintf(stderr, "failed to load replay %s: %s\n", opts.replayPath, error.c_str());
+            return 1;
+        }
+        replayCursor.rec = &replay;
+        replaying = true;
+        checkReplayBalance(replay, opts.archetypes);
+    }
 
-int main() {
     int SCREEN_WIDTH = 1280;
     int SCREEN_HEIGHT = 720;
     
-    const float MAP_WIDTH = 3500.0f;
-    const float MAP_HEIGHT = 3500.0f;
     const float MIN_ZOOM = 0.25f;
     const float MAX_ZOOM = 8.0f;
 
+    // The sprites decode on a worker while the window opens, and go to the GPU
+    // from the frame loop once they are ready.
+    SpriteAtlas atlas;
+    startSpriteAtlas(atlas);
+
+    StartupTimeline startup;
+    uint64_t stepStart = profilerNowNs();
     SetConfigFlags(FLAG_WINDOW_RESIZABLE);
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "SCC Game Jam 2025");
     SetWindowMinSize(800, 600);
     SetTargetFPS(60);
+    startup.add("window init", stepStart, profilerNowNs());
 
     GameState gameState = STATE_MENU;
     bool quitRequested = false;
@@ -156,206 +566,32 @@ int main() {
     camera.rotation = 0.0f;
     camera.zoom = 1.0f;
 
-    int currentWave = 1;
-    Difficulty difficulty = DIFF_NORMAL; // default
-    int enemiesAlive = 0;
-
-    Texture2D unitTex = LoadTexture("unit.png");
-    SetTextureFilter(unitTex, TEXTURE_FILTER_POINT);
-    Texture2D alienTex = LoadTexture("alien.png");
-    SetTextureFilter(alienTex, TEXTURE_FILTER_POINT);
-
-    const int count = 6;
-    std::vector<Unit> units; units.reserve(count);
-    const float TAU = 6.28318530718f; 
-    const float ringRadius = 80.0f;  
-    Vector2 center = camera.target;  
-    for (int i = 0; i < count; ++i) {
-        float t = (i / (float)count) * TAU;
-        float cx = center.x + cosf(t) * ringRadius;
-        float cy = center.y + sinf(t) * ringRadius;
-        Unit u{};
-        u.texture = unitTex;
-        u.width = 90 / 2; u.height = 150 / 2;
-        u.speed = 200;
-        u.x = (int)lroundf(cx - u.width/2.0f);
-        u.y = (int)lroundf(cy - u.height/2.0f);
-        u.fx = (float)u.x; u.fy = (float)u.y;
-        
-        u.type = (UnitType)i;
-        switch (u.type) {
-            case UNIT_RIFLE:  
-                u.hp = u.maxHp = 220;
-                u.fireRate = 2.5f;
-                u.range = 140.0f;
-                u.damage = 18;
-                break;
-            case UNIT_SHOTGUN:
-                u.hp = u.maxHp = 260;
-                u.fireRate = 1.8f;
-                u.range = 90.0f;
-                u.damage = 30;
-                u.speed = 260;
-                break;
-            case UNIT_SNIPER:  
-                u.hp = u.maxHp = 180;
-                u.fireRate = 1.0f;
-                u.range = 240.0f;
-                u.damage = 50;
-                break;
-            case UNIT_HEAVY:    
-                u.hp = u.maxHp = 340;
-                u.fireRate = 4.5f;
-                u.range = 160.0f;
-                u.damage = 10;
-                u.speed = 160;
-                break;
-            case UNIT_ROCKET:  
-                u.hp = u.maxHp = 200;
-                u.fireRate = 0.7f;
-                u.range = 190.0f;
-                u.damage = 75; 
-                break;
-            case UNIT_HEALER:   
-                u.hp = u.maxHp = 240;
-                u.fireRate = 1.0f;
-                u.range = 150.0f;
-                u.damage = 5;
-                u.healRate = 40.0f;
-                break;
-        }
-
-        u.showHp = true;
-        units.push_back(u);
-    }
-
-    std::vector<EnemyNPC> enemies; enemies.reserve(2000);
-    auto spawnWave = [&](int wave){
-        float enemyCountScale = 1.0f;
-        float enemyStatScale = 1.0f;
-        switch (difficulty) {
-            case DIFF_CASUAL: enemyCountScale = 0.75f; enemyStatScale = 0.85f; break;
-            case DIFF_NORMAL: enemyCountScale = 1.0f; enemyStatScale = 1.0f; break;
-            case DIFF_HARD: enemyCountScale = 1.35f; enemyStatScale = 1.25f; break;
-        }
-        int baseCount = 8 + wave * 2;
-        int spawnCount = (int)std::round(baseCount * enemyCountScale);
-        if (spawnCount < 1) spawnCount = 1;
-        for (int i = 0; i < spawnCount; ++i) {
-            EnemyNPC e{};
-            e.width = 32; e.height = 32;
-            int margin = std::max(e.width, e.height) / 2 + 2;
-            int side = GetRandomValue(0,3);
-            if (side == 0) { e.x = GetRandomValue(margin, (int)MAP_WIDTH - margin); e.y = margin; }
-            else if (side == 1) { e.x = GetRandomValue(margin, (int)MAP_WIDTH - margin); e.y = (int)MAP_HEIGHT - margin; }
-            else if (side == 2) { e.x = margin; e.y = GetRandomValue(margin, (int)MAP_HEIGHT - margin); }
-            else { e.x = (int)MAP_WIDTH - margin; e.y = GetRandomValue(margin, (int)MAP_HEIGHT - margin); }
-            e.fx = (float)e.x; e.fy = (float)e.y;
-
-            int roll = GetRandomValue(0, 99);
-            if (roll < 50) { // grunt
-                e.type = ENEMY_GRUNT; e.moveSpeed = 110.0f; e.attackRange = 65.0f; e.attackDamage = 10.0f; e.attackCooldown = 1.8f; e.hp = e.maxHp = (int)((70 + wave*4) * enemyStatScale);
-            } else if (roll < 78) { // fast
-                e.type = ENEMY_FAST; e.moveSpeed = 180.0f; e.attackRange = 45.0f; e.attackDamage = 7.0f; e.attackCooldown = 1.4f; e.hp = e.maxHp = (int)((50 + wave*3) * enemyStatScale);
-            } else if (roll < 92) { // tank
-                e.type = ENEMY_TANK; e.moveSpeed = 75.0f; e.attackRange = 80.0f; e.attackDamage = 18.0f; e.attackCooldown = 2.4f; e.hp = e.maxHp = (int)((160 + wave*10) * enemyStatScale);
-            } else if (roll < 98) { // shooter
-                e.type = ENEMY_SHOOTER; e.moveSpeed = 100.0f; e.attackRange = 260.0f; e.attackDamage = 8.0f; e.attackCooldown = 1.9f; e.hp = e.maxHp = (int)((60 + wave*5) * enemyStatScale);
-            } else { // siege
-                e.type = ENEMY_SIEGE; e.moveSpeed = 65.0f; e.attackRange = 380.0f; e.attackDamage = 10.0f; e.attackCooldown = 3.0f; e.hp = e.maxHp = (int)((55 + wave*5) * enemyStatScale);
-                e.prioritizeShip = true; e.avoidUnitsRange = 200.0f;
-            }
-            e.detectionRange = 380.0f + wave * 10.0f;
-            e.showHp = false; e.alive = true;
-            enemies.push_back(e);
-        }
-    };
-
-    spawnWave(currentWave);
-    enemiesAlive = (int)enemies.size();
-
-    std::vector<Bullet> bullets;
-    std::vector<Particle> particles;
-    std::vector<Rock> rocks;
-
-    Ship playerShip{};
-    playerShip.x = MAP_WIDTH/2.0f;
-    playerShip.y = MAP_HEIGHT/2.0f;
-    playerShip.width = 120;
-    playerShip.height = 180;
-    playerShip.maxHp = 200;
-    playerShip.hp = playerShip.maxHp;
-    
-    UpgradeShop shop{};
-
-    {
-        int numRocks = 16;
-        rocks.reserve(numRocks);
-        for (int i = 0; i < numRocks; ++i) {
-            Rock r{};
-            r.width = 48; r.height = 48;
-            int margin = 200;
-            r.x = GetRandomValue(margin, (int)MAP_WIDTH - margin);
-            r.y = GetRandomValue(margin, (int)MAP_HEIGHT - margin);
-            float dx = r.x - playerShip.x; float dy = r.y - playerShip.y;
-            if (dx*dx + dy*dy < 400.0f * 400.0f) {
-                r.x += 400; r.y += 0;
-            }
-            r.hp = r.maxHp = GetRandomValue(160, 260);
-            r.scrapMin = 10; r.scrapMax = 20;
-            r.alive = true; r.showHp = false;
-            rocks.push_back(r);
-        }
-    }
-
-    std::vector<bool> unitAttacking; unitAttacking.resize(count, false);
-    std::vector<int> unitTargetEnemy; unitTargetEnemy.resize(count, -1);
-    std::vector<float> unitFireTimer; unitFireTimer.resize(count, 0.0f);
-
-    std::vector<bool> unitAreaAttack; unitAreaAttack.resize(count, false);
-    std::vector<Vector2> unitAreaCenter; unitAreaCenter.resize(count, Vector2{0,0});
-    std::vector<float> unitAreaRadius; unitAreaRadius.resize(count, 0.0f);
-    std::vector<Rectangle> unitAreaRect; unitAreaRect.resize(count, Rectangle{0,0,0,0});
-    std::vector<std::vector<int>> unitAreaTargets; unitAreaTargets.resize(count);
-    std::vector<float> unitHealFraction; unitHealFraction.resize(count, 0.0f);
-    std::vector<int> unitAssignedRock; unitAssignedRock.resize(count, -1);
-    bool rockAssignmentDirty = true;
-    auto recomputeRockAssignments = [&]() {
-        std::vector<int> aliveRocks; aliveRocks.reserve(rocks.size());
-        for (int ri = 0; ri < (int)rocks.size(); ++ri) if (rocks[ri].alive) aliveRocks.push_back(ri);
-        std::vector<char> used; used.assign(rocks.size(), 0);
-        for (int ui = 0; ui < (int)units.size(); ++ui) {
-            if (units[ui].type == UNIT_HEALER) { unitAssignedRock[ui] = -1; continue; }
-            int bestR = -1; float bestD = 1e9f;
-            float ucx = units[ui].fx + units[ui].width/2.0f;
-            float ucy = units[ui].fy + units[ui].height/2.0f;
-            for (int ri : aliveRocks) {
-                if (used[ri]) continue;
-                const Rock &r = rocks[ri];
-                float dx = (float)r.x - ucx, dy = (float)r.y - ucy; float d = sqrtf(dx*dx + dy*dy);
-                if (d < bestD) { bestD = d; bestR = ri; }
-            }
-            if (bestR != -1) { unitAssignedRock[ui] = bestR; used[bestR] = 1; }
-            else unitAssignedRock[ui] = -1;
-        }
-        for (int ui = 0; ui < (int)units.size(); ++ui) {
-            if (units[ui].type == UNIT_HEALER) continue;
-            if (unitAssignedRock[ui] != -1) continue;
-            int bestR = -1; float bestD = 1e9f;
-            float ucx = units[ui].fx + units[ui].width/2.0f;
-            float ucy = units[ui].fy + units[ui].height/2.0f;
-            for (int ri : aliveRocks) {
-                const Rock &r = rocks[ri];
-                float dx = (float)r.x - ucx, dy = (float)r.y - ucy; float d = sqrtf(dx*dx + dy*dy);
-                if (d < bestD) { bestD = d; bestR = ri; }
-            }
-            unitAssignedRock[ui] = bestR;
-        }
-        rockAssignmentDirty = false;
-    };
-
-    const float ATTACK_RANGE_HYST = 12.0f; 
-    const float BULLET_SPEED = 500.0f;   
+    Game game;
+    game.difficulty = opts.difficulty;
+    game.particleCapacity = opts.maxParticles;
+    game.archetypes = opts.archetypes;
+    Difficulty &difficulty = game.difficulty;
+    int &currentWave = game.currentWave;
+    int &enemiesAlive = game.enemiesAlive;
+
+    stepStart = profilerNowNs();
+    Background background;
+    bakeBackground(background);
+    startup.add("background bake", stepStart, profilerNowNs());
+    std::vector<int> visibleEnemies;
+
+    std::vector<Unit> &units = game.units;
+    EnemyStore &enemies = game.enemies;
+    EntityPool<Bullet> &bullets = game.bullets;
+    const ParticlePool &particles = game.particles;
+    EntityPool<Rock> &rocks = game.rocks;
+    Ship &playerShip = game.playerShip;
+    UpgradeShop &shop = game.shop;
+
+    // Number-key control groups, unit indices in ascending order. A new game
+    // fills 1-5 with one squad per fighter type.
+    std::vector<int> controlGroups[CONTROL_GROUP_COUNT];
+    std::vector<int> boxHits;
 
     bool isDragging = false, didDrag = false;
     Vector2 dragStart{0,0}, dragEnd{0,0};
@@ -363,110 +599,208 @@ int main() {
     Vector2 rightDragStart{0,0}, rightDragEnd{0,0};
 
     float timeScale = 1.0f;  
+    float effectiveSpeed = 1.0f;    // sim seconds per real second, smoothed, for the HUD
     bool isPaused = false;
+    FixedTimestep stepper;
+    stepper.setRate(opts.tickRate);
     
-    bool inIntermission = false;
-    float intermissionTime = 0.0f;
-    const float INTERMISSION_DURATION = 20.0f;
-
-    auto startNewGame = [&]() {
-        playerShip.x = MAP_WIDTH/2.0f;
-        playerShip.y = MAP_HEIGHT/2.0f;
-        playerShip.width = 120;
-        playerShip.height = 180;
-        playerShip.maxHp = 200;
-        playerShip.hp = playerShip.maxHp;
-        playerShip.hullIntegrity = 0;
-        playerShip.shielding = 0;
-        playerShip.engines = 0;
-        playerShip.lifeSupportSystems = 0;
-        playerShip.isComplete = false;
-
-        shop.scrapMetal = 0;
-        shop.hullUpgradeCost = 10;
-        shop.shieldingUpgradeCost = 15;
-        shop.engineUpgradeCost = 20;
-        shop.lifeSupportUpgradeCost = 25;
-
-        units.clear();
-        Vector2 centerPos = { playerShip.x, playerShip.y };
-        for (int i = 0; i < count; ++i) {
-            float t = (i / (float)count) * TAU;
-            float cx = centerPos.x + cosf(t) * ringRadius;
-            float cy = centerPos.y + sinf(t) * ringRadius;
-            Unit u{};
-            u.texture = unitTex;
-            u.width = 90 / 2; u.height = 150 / 2;
-            u.speed = 200;
-            u.x = (int)lroundf(cx - u.width/2.0f);
-            u.y = (int)lroundf(cy - u.height/2.0f);
-            u.fx = (float)u.x; u.fy = (float)u.y;
-            u.type = (UnitType)i;
-            switch (u.type) {
-                case UNIT_RIFLE:  u.hp = u.maxHp = 200; u.fireRate = 2.0f; u.range = 120.0f; u.damage = 15; break;
-                case UNIT_SHOTGUN: u.hp = u.maxHp = 240; u.fireRate = 1.5f; u.range = 80.0f;  u.damage = 25; u.speed = 250; break;
-                case UNIT_SNIPER:  u.hp = u.maxHp = 160; u.fireRate = 0.8f; u.range = 200.0f; u.damage = 40; break;
-                case UNIT_HEAVY:   u.hp = u.maxHp = 300; u.fireRate = 4.0f; u.range = 140.0f; u.damage = 8;  u.speed = 150; break;
-                case UNIT_ROCKET:  u.hp = u.maxHp = 180; u.fireRate = 0.5f; u.range = 160.0f; u.damage = 60; break;
-                case UNIT_HEALER:  u.hp = u.maxHp = 220; u.fireRate = 1.0f; u.range = 100.0f; u.damage = 5;  u.healRate = 20.0f; break;
-            }
-            u.selected = false; u.moving = false; u.showHp = true;
-            units.push_back(u);
+    bool &inIntermission = game.inIntermission;
+    float &intermissionTime = game.intermissionTime;
+
+    // Every player action that touches the simulation goes through issue(), so
+    // --record sees exactly what was applied and on which tick.
+    Recording record;
+    bool recording = false;
+    // The last minutes of play, for stepping back with , and forward with .
+    // While scrubbed back, what was played after this point is still kept, and
+    // playing on (or giving an order) from here drops it.
+    RewindBuffer rewind;
+    rewind.budgetBytes = (size_t)opts.rewindBudgetMb << 20;
+    bool rewindEnabled = opts.rewindBudgetMb > 0;
+    bool scrubbed = false;
+    auto playFromHere = [&]() {
+        if (!scrubbed) return;
+        scrubbed = false;
+        while (recording && !record.commands.empty() && record.commands.back().tick >= game.tick) record.commands.pop_back();
+    };
+    auto issue = [&](Command c) {
+        playFromHere();
+        c.tick = game.tick;
+        if (rewindEnabled) rewind.command(game, c);
+        applyCommand(game, c);
+        if (recording) record.commands.push_back(c);
+    };
+    auto resetRewind = [&]() {
+        scrubbed = false;
+        rewind.keyframeInterval = (int)lroundf(1.0f / stepper.tickDt);
+        if (rewindEnabled) rewind.reset(game);
+    };
+    auto issueSelection = [&](const std::vector<bool> &sel) {
+        Command c;
+        c.type = CMD_SELECT;
+        bool changed = false;
+        for (int i = 0; i < (int)units.size(); ++i) {
+            if (sel[i]) c.units.push_back(i);
+            if (sel[i] != units[i].selected) changed = true;
         }
-
-        unitAttacking.assign(count, false);
-        unitTargetEnemy.assign(count, -1);
-        unitFireTimer.assign(count, 0.0f);
-        unitAreaAttack.assign(count, false);
-        unitAreaCenter.assign(count, Vector2{0,0});
-        unitAreaRadius.assign(count, 0.0f);
-        unitAreaRect.assign(count, Rectangle{0,0,0,0});
-        for (auto &v : unitAreaTargets) v.clear();
-    unitHealFraction.assign(count, 0.0f);
-
-        enemies.clear();
-        bullets.clear();
-        particles.clear();
-        rocks.clear();
-
-        {
-            int numRocks = 10;
-            rocks.reserve(numRocks);
-            for (int i = 0; i < numRocks; ++i) {
-                Rock r{};
-                r.width = 48; r.height = 48;
-                int margin = 200;
-                r.x = GetRandomValue(margin, (int)MAP_WIDTH - margin);
-                r.y = GetRandomValue(margin, (int)MAP_HEIGHT - margin);
-                float dx = r.x - playerShip.x; float dy = r.y - playerShip.y;
-                if (dx*dx + dy*dy < 400.0f * 400.0f) { r.x += 400; }
-                r.hp = r.maxHp = GetRandomValue(160, 260);
-                r.scrapMin = 6; r.scrapMax = 14;
-                r.alive = true; r.showHp = false;
-                rocks.push_back(r);
-            }
+        if (changed) issue(c);
+    };
+    auto currentSelection = [&]() {
+        std::vector<bool> sel(units.size());
+        for (int i = 0; i < (int)units.size(); ++i) sel[i] = units[i].selected;
+        return sel;
+    };
+    auto resetControlGroups = [&]() {
+        for (std::vector<int> &g : controlGroups) g.clear();
+        for (int i = 0; i < (int)units.size(); ++i) {
+            if (!UNIT_TRAITS[units[i].type].heals) controlGroups[units[i].type].push_back(i);
         }
+    };
+    auto stopRecording = [&]() {
+        if (!recording) return;
+        recording = false;
+        record.endTick = game.tick;
+        if (!saveRecording(opts.recordPath, record)) fprintf(stderr, "failed to write recording %s\n", opts.recordPath);
+    };
 
-        currentWave = 1;
-        spawnWave(currentWave);
-        enemiesAlive = (int)enemies.size();
+    auto startGame = [&]() {
+        if (replaying) {
+            game.seed = replay.seed;
+            game.difficulty = replay.difficulty;
+            game.armySize = replay.armySize;
+            stepper.setRate(replay.tickRate);
+            replayCursor.next = 0;
+        } else {
+            // An explicit --seed replays the same run on every restart.
+            game.seed = opts.hasSeed ? opts.seed : (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+            game.armySize = opts.armySize;
+            stepper.setRate(opts.tickRate);
+        }
+        startNewGame(game);
+        resetControlGroups();
+        game.shipInvulnerable = replaying && replay.invulnerable;
+        camera.target = { playerShip.x, playerShip.y };
+        isPaused = false;
+        timeScale = 1.0f;
+        if (opts.recordPath && !replaying) {
+            record = Recording{};
+            record.seed = game.seed;
+            record.difficulty = game.difficulty;
+            record.tickRate = opts.tickRate;
+            record.armySize = game.armySize;
+            record.archetypesHash = archetypesHash(game.archetypes);
+            recording = true;
+        }
+        resetRewind();
+    };
+    auto leaveGame = [&]() {
+        stopRecording();
+        replaying = false;
+        gameState = STATE_MENU;
+    };
+    // The --balance file is watched, and the tables that change in it are put in
+    // effect between frames, so stats can be tuned with the game running. A
+    // file that fails to parse is reported and the old values stay.
+    BalanceReloader balanceReloader;
+    Archetypes balance = DEFAULT_ARCHETYPES;
+    FileWatch balanceWatch;
+    bool balancePending = false;
+    if (opts.balancePath) {
+        uint32_t changed = 0;
+        std::string error;
+        if (!balanceReloader.reload(opts.balancePath, balance, changed, error)) {
+            fprintf(stderr, "failed to load balance %s: %s\n", opts.balancePath, error.c_str());
+            CloseWindow();
+            return 1;
+        }
+        if (!balanceWatch.open(opts.balancePath)) fprintf(stderr, "cannot watch %s; edits to it will not be reloaded\n", opts.balancePath);
+    }
+    auto reloadBalance = [&]() {
+        uint32_t changed = 0;
+        std::string error;
+        if (!balanceReloader.reload(opts.balancePath, balance, changed, error)) {
+            fprintf(stderr, "balance %s not reloaded: %s\n", opts.balancePath, error.c_str());
+            return;
+        }
+        if (!changed) return;
+        Archetypes next = game.archetypes;
+        printf("balance reloaded:");
+        if (changed & BALANCE_TABLE_TUNING) { next.tuning = balance.tuning; printf(" [game]"); }
+        for (int t = 0; t < UNIT_TYPE_COUNT; ++t) {
+            if (changed & balanceUnitTable(t)) { next.units[t] = balance.units[t]; printf(" [unit %s]", UNIT_TRAITS[t].name); }
+        }
+        for (int t = 0; t < ENEMY_TYPE_COUNT; ++t) {
+            if (changed & balanceEnemyTable(t)) { next.enemies[t] = balance.enemies[t]; printf(" [enemy %s]", ENEMY_TRAITS[t].name); }
+        }
+        printf("\n");
+        applyArchetypes(game, next);
+        // Neither the recording nor the rewind history can reproduce the change.
+        if (recording) printf("recording stopped at tick %u, since it would not replay past the change\n", game.tick);
+        stopRecording();
+        if (gameState == STATE_GAME) resetRewind();
+    };
 
+    // F5 saves the game to --save-snapshot's file and F9 loads --load-snapshot's,
+    // both snapshot.bin by default, so F9 after F5 goes back to it.
+    const char *saveSnapshotPath = opts.saveSnapshotPath ? opts.saveSnapshotPath : "snapshot.bin";
+    const char *loadSnapshotPath = opts.loadSnapshotPath ? opts.loadSnapshotPath : saveSnapshotPath;
+    auto loadGame = [&]() {
+        std::string error;
+        if (!loadSnapshot(loadSnapshotPath, game, error)) {
+            fprintf(stderr, "failed to load snapshot %s: %s\n", loadSnapshotPath, error.c_str());
+            return false;
+        }
+        // The snapshot brings the stats it was saved with; the balance file wins.
+        if (opts.balancePath) applyArchetypes(game, balance);
+        // Commands recorded so far lead to a state this one did not come from.
+        stopRecording();
+        resetControlGroups();
         camera.target = { playerShip.x, playerShip.y };
         isPaused = false;
         timeScale = 1.0f;
-        inIntermission = false;
-        intermissionTime = 0.0f;
+        resetRewind();
+        return true;
     };
+    if (replaying) {
+        startGame();
+        gameState = STATE_GAME;
+    } else if (opts.loadSnapshotPath) {
+        if (loadGame()) gameState = STATE_GAME;
+    }
 
-    auto startNextWave = [&]() {
-        inIntermission = false;
-        intermissionTime = 0.0f;
-        currentWave++;
-        spawnWave(currentWave);
-        enemiesAlive = (int)enemies.size();
+    bool showProfiler = false;
+    const char *tracePath = opts.tracePath ? opts.tracePath : "trace.json";
+    if (opts.tracePath) gProfiler.startCapture();
+    auto finishCapture = [&]() {
+        if (!gProfiler.capturing) return;
+        gProfiler.stopCapture();
+        if (!gProfiler.writeTrace(tracePath)) fprintf(stderr, "failed to write trace %s\n", tracePath);
     };
 
+    // Printed once the first frame is up and the sprites are on the GPU.
+    uint64_t firstFrameStart = profilerNowNs();
+    int startupFrames = 0;      // frames finished, counted until the report is out
+    bool startupPrinted = false;
+
     while (!WindowShouldClose()) {
+        // The menu draws without sprites, so it only polls for them; a game waits.
+        if (!atlas.ready() && finishSpriteAtlas(atlas, gameState == STATE_GAME)) {
+            startup.add("sprite decode", atlas.decodeStartNs, atlas.decodeEndNs);
+            startup.add("sprite upload", atlas.uploadStartNs, atlas.uploadEndNs);
+        }
+        if (!startupPrinted) {
+            if (startupFrames++ == 1) startup.add("first frame", firstFrameStart, profilerNowNs());
+            if (startupFrames > 1 && atlas.ready()) {
+                startup.print();
+                startupPrinted = true;
+            }
+        }
+        // A replay has to run on the stats it was recorded with, so changes wait for it to end.
+        if (opts.balancePath && balanceWatch.changed()) balancePending = true;
+        if (balancePending && !replaying) {
+            balancePending = false;
+            reloadBalance();
+        }
         camera.offset = { (float)GetScreenWidth()/2.0f, (float)GetScreenHeight()/2.0f };
 
         if (gameState != STATE_GAME) {
@@ -525,7 +859,7 @@ int main() {
                     } else if (CheckCollisionPointRec(m, btnHard)) {
                         difficulty = DIFF_HARD;
                     } else if (CheckCollisionPointRec(m, btnStart)) {
-                        startNewGame();
+                        startGame();
                         gameState = STATE_GAME;
                     } else if (CheckCollisionPointRec(m, btnOptions)) {
                         gameState = STATE_OPTIONS;
@@ -576,6 +910,7 @@ int main() {
             if (quitRequested) break;
             continue;
         }
+        ProfileScope frameZone(PZ_INPUT);
     float camSpeed = 200.0f * GetFrameTime() / camera.zoom;
         if (IsKeyDown(KEY_W)) camera.target.y -= camSpeed;
         if (IsKeyDown(KEY_S)) camera.target.y += camSpeed;
@@ -601,20 +936,20 @@ int main() {
             camera.target.y -= d.y / camera.zoom;
         }
 
-        for (int i = 0; i < 9; ++i) {
-            int key = KEY_ONE + i;
-            if (IsKeyPressed((KeyboardKey)key)) {
-                if (i < (int)units.size()) {
-                    if (units[i].type != UNIT_HEALER) {
-                        if (IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL)) {
-                            units[i].selected = !units[i].selected;
-                        } else {
-                            for (auto &u : units) u.selected = false;
-                            units[i].selected = true;
-                        }
-                    }
-                }
+        // N selects group N, Shift+N adds it to the selection, Ctrl+N stores the
+        // selection as group N.
+        for (int g = 0; g < CONTROL_GROUP_COUNT && !replaying; ++g) {
+            if (!IsKeyPressed((KeyboardKey)(KEY_ONE + g))) continue;
+            std::vector<int> &group = controlGroups[g];
+            if (IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL)) {
+                group.clear();
+                for (int i = 0; i < (int)units.size(); ++i) if (units[i].selected) group.push_back(i);
+                continue;
             }
+            std::vector<bool> sel = currentSelection();
+            if (!IsKeyDown(KEY_LEFT_SHIFT) && !IsKeyDown(KEY_RIGHT_SHIFT)) std::fill(sel.begin(), sel.end(), false);
+            for (int i : group) if (i < (int)units.size()) sel[i] = true;
+            issueSelection(sel);
         }
 
         if (IsKeyPressed(KEY_SPACE)) {
@@ -623,6 +958,31 @@ int main() {
         if (IsKeyPressed(KEY_F11)) {
             ToggleFullscreen();
         }
+        if (IsKeyPressed(KEY_F3)) showProfiler = !showProfiler;
+        if (IsKeyPressed(KEY_F5)) {
+            std::string error;
+            if (!saveSnapshot(saveSnapshotPath, game, error)) fprintf(stderr, "failed to write snapshot %s: %s\n", saveSnapshotPath, error.c_str());
+        }
+        if (!replaying && IsKeyPressed(KEY_F9)) loadGame();
+        if (rewindEnabled && !rewind.empty() && (IsKeyPressed(KEY_COMMA) || IsKeyPressed(KEY_PERIOD))) {
+            long long step = (IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT)) ? rewind.keyframeInterval : 1;
+            long long target = (long long)game.tick + (IsKeyPressed(KEY_PERIOD) ? step : -step);
+            target = ClampVal(target, (long long)rewind.oldestTick(), (long long)rewind.newestTick());
+            if (target != (long long)game.tick && rewind.seek(game, (uint32_t)target, stepper.tickDt)) {
+                scrubbed = true;
+                if (replaying) {
+                    replayCursor.next = 0;
+                    while (replayCursor.next < replay.commands.size() && replay.commands[replayCursor.next].tick < game.tick) replayCursor.next++;
+                }
+            }
+            isPaused = true;
+        }
+        if (IsKeyPressed(KEY_F4)) {
+            if (gProfiler.capturing) finishCapture();
+            else gProfiler.startCapture();
+        }
+        gProfiler.enabled = showProfiler || gProfiler.capturing;
+        float prevTimeScale = timeScale;
         if (IsKeyPressed(KEY_EQUAL) || IsKeyPressed(KEY_KP_ADD)) {
             timeScale += 0.25f;
         }
@@ -635,38 +995,35 @@ int main() {
             if (quantized > 3.0f) quantized = 3.0f;
             timeScale = quantized;
         }
+        if (IsKeyPressed(KEY_F)) {
+            // 1x (or any +/- speed) -> 10x -> 50x -> max -> 1x
+            int next = 0;
+            while (next < FAST_FORWARD_COUNT && FAST_FORWARD_SPEEDS[next] <= timeScale) next++;
+            timeScale = next < FAST_FORWARD_COUNT ? FAST_FORWARD_SPEEDS[next] : 1.0f;
+        }
         if (IsKeyPressed(KEY_R)) {  
             timeScale = 1.0f;
             isPaused = false;
         }
-
-        if (IsKeyPressed(KEY_A) && (IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL))) {
-            for (auto &u : units) {
-                if (u.type != UNIT_HEALER) u.selected = true; else u.selected = false;
-            }
+        if (timeScale != prevTimeScale && !replaying) {
+            Command c; c.type = CMD_TIME_SCALE; c.arg = (int)lroundf(timeScale * 4.0f);
+            issue(c);
         }
 
-        if (IsKeyPressed(KEY_H) && shop.scrapMetal >= shop.hullUpgradeCost && playerShip.hullIntegrity < playerShip.maxHullIntegrity) {
-            shop.scrapMetal -= shop.hullUpgradeCost;
-            playerShip.hullIntegrity += 8;
-        }
-        if (IsKeyPressed(KEY_U) && shop.scrapMetal >= shop.shieldingUpgradeCost && playerShip.shielding < playerShip.maxShielding) {
-            shop.scrapMetal -= shop.shieldingUpgradeCost;
-            playerShip.shielding += 5;
-        }
-        if (IsKeyPressed(KEY_E) && shop.scrapMetal >= shop.engineUpgradeCost && playerShip.engines < playerShip.maxEngines) {
-            shop.scrapMetal -= shop.engineUpgradeCost;
-            playerShip.engines += 3;
-        }
-        if (IsKeyPressed(KEY_L) && shop.scrapMetal >= shop.lifeSupportUpgradeCost && playerShip.lifeSupportSystems < playerShip.maxLifeSupportSystems) {
-            shop.scrapMetal -= shop.lifeSupportUpgradeCost;
-            playerShip.lifeSupportSystems += 3;
+        if (!replaying && IsKeyPressed(KEY_A) && (IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL))) {
+            std::vector<bool> sel(units.size());
+            for (int i = 0; i < (int)units.size(); ++i) sel[i] = !UNIT_TRAITS[units[i].type].heals;
+            issueSelection(sel);
         }
 
-        playerShip.isComplete = (playerShip.hullIntegrity >= playerShip.maxHullIntegrity &&
-                                playerShip.shielding >= playerShip.maxShielding &&
-                                playerShip.engines >= playerShip.maxEngines &&
-                                playerShip.lifeSupportSystems >= playerShip.maxLifeSupportSystems);
+        if (!replaying) {
+            const int upgradeKeys[] = { KEY_H, KEY_U, KEY_E, KEY_L };
+            for (int k = 0; k < 4; ++k) {
+                if (!IsKeyPressed(upgradeKeys[k])) continue;
+                Command c; c.type = CMD_UPGRADE; c.arg = UPGRADE_HULL + k;
+                issue(c);
+            }
+        }
 
     float halfViewW = ((float)GetScreenWidth() / camera.zoom) * 0.5f;
     float halfViewH = ((float)GetScreenHeight() / camera.zoom) * 0.5f;
@@ -675,7 +1032,7 @@ int main() {
         camera.target.x = (MAP_WIDTH <= 2*halfViewW) ? MAP_WIDTH*0.5f : ClampVal(camera.target.x, minX, maxX);
         camera.target.y = (MAP_HEIGHT <= 2*halfViewH) ? MAP_HEIGHT*0.5f : ClampVal(camera.target.y, minY, maxY);
 
-        if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+        if (!replaying && IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
             dragStart = GetMousePosition(); dragEnd = dragStart; isDragging = true; didDrag = false;
         }
         if (isDragging && IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
@@ -688,30 +1045,27 @@ int main() {
                 Vector2 ws = GetScreenToWorld2D(dragStart, camera), we = GetScreenToWorld2D(dragEnd, camera);
                 float l = std::min(ws.x, we.x), r = std::max(ws.x, we.x);
                 float t = std::min(ws.y, we.y), b = std::max(ws.y, we.y);
-                Rectangle sel{l, t, r-l, b-t};
-                if (!shiftHeld) for (auto &u : units) u.selected = false;
-                for (auto &u : units) {
-                    Rectangle rect{ (float)u.x, (float)u.y, (float)u.width, (float)u.height };
-                    if (u.type != UNIT_HEALER && CheckCollisionRecs(sel, rect)) u.selected = true;
-                }
+                Rectangle box{l, t, r-l, b-t};
+                std::vector<bool> sel = currentSelection();
+                if (!shiftHeld) std::fill(sel.begin(), sel.end(), false);
+                unitsIn(game, box, boxHits);
+                for (int i : boxHits) sel[i] = true;
+                issueSelection(sel);
             } else {
                 Vector2 wMouse = GetScreenToWorld2D(GetMousePosition(), camera);
-                int hit = -1;
-                for (int i = (int)units.size() - 1; i >= 0; --i) {
-                    if (units[i].type == UNIT_HEALER) continue; 
-                    Rectangle rect{ (float)units[i].x, (float)units[i].y, (float)units[i].width, (float)units[i].height };
-                    if (CheckCollisionPointRec(wMouse, rect)) { hit = i; break; }
-                }
+                int hit = unitAt(game, wMouse);
+                std::vector<bool> sel = currentSelection();
                 if (hit != -1) {
-                    if (shiftHeld) units[hit].selected = !units[hit].selected;
-                    else for (int i = 0; i < (int)units.size(); ++i) units[i].selected = (i == hit);
+                    if (shiftHeld) sel[hit] = !sel[hit];
+                    else for (int i = 0; i < (int)units.size(); ++i) sel[i] = (i == hit);
                 } else if (!shiftHeld) {
-                    for (auto &u : units) u.selected = false;
+                    std::fill(sel.begin(), sel.end(), false);
                 }
+                issueSelection(sel);
             }
             isDragging = false; didDrag = false;
         }
-        if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
+        if (!replaying && IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
             rightDragStart = GetMousePosition(); rightDragEnd = rightDragStart; isRightDragging = true; rightDidDrag = false;
         }
         if (isRightDragging && IsMouseButtonDown(MOUSE_RIGHT_BUTTON)) {
@@ -723,626 +1077,92 @@ int main() {
                 Vector2 ws = GetScreenToWorld2D(rightDragStart, camera), we = GetScreenToWorld2D(rightDragEnd, camera);
                 float l = std::min(ws.x, we.x), r = std::max(ws.x, we.x);
                 float t = std::min(ws.y, we.y), b = std::max(ws.y, we.y);
-                Rectangle rect{l, t, r-l, b-t};
-                std::vector<int> selIdx; Vector2 selCenter{0,0};
-                for (int i=0;i<(int)units.size();++i) if (units[i].selected) { selIdx.push_back(i); selCenter.x += units[i].x + units[i].width/2.0f; selCenter.y += units[i].y + units[i].height/2.0f; }
-                if (!selIdx.empty()) {
-                    std::vector<int> captured;
-                    for (int i = 0; i < (int)enemies.size(); ++i) {
-                        if (!enemies[i].alive) continue;
-                        Rectangle er{ (float)(enemies[i].x - enemies[i].width/2), (float)(enemies[i].y - enemies[i].height/2), (float)enemies[i].width, (float)enemies[i].height };
-                        if (CheckCollisionRecs(rect, er)) captured.push_back(i);
-                    }
-                    selCenter.x /= (float)selIdx.size(); selCenter.y /= (float)selIdx.size();
-                    for (int idx : selIdx) {
-                        unitAreaAttack[idx] = true;
-                        unitAreaCenter[idx] = { l + (r-l)*0.5f, t + (b-t)*0.5f };
-                        unitAreaRadius[idx] = 0.0f;
-                        unitAreaRect[idx] = rect;
-                        unitAreaTargets[idx] = captured;
-                        unitAttacking[idx] = false; unitTargetEnemy[idx] = -1;
-                    }
-                    if (!captured.empty()) {
-                        std::vector<int> assigned; assigned.reserve(selIdx.size());
-                        for (int idx : selIdx) {
-                            if (units[idx].type == UNIT_HEALER) continue;
-                            float ucx = units[idx].fx + units[idx].width/2.0f;
-                            float ucy = units[idx].fy + units[idx].height/2.0f;
-                            float bestD = 1e9f; int bestI = -1;
-                            for (int tIdx : captured) {
-                                if (std::find(assigned.begin(), assigned.end(), tIdx) != assigned.end()) continue;
-                                if (tIdx < 0 || tIdx >= (int)enemies.size() || !enemies[tIdx].alive) continue;
-                                float dx = (float)enemies[tIdx].x - ucx; float dy = (float)enemies[tIdx].y - ucy; float d = sqrtf(dx*dx + dy*dy);
-                                if (d < bestD) { bestD = d; bestI = tIdx; }
-                            }
-                            if (bestI != -1) { unitAttacking[idx] = true; unitTargetEnemy[idx] = bestI; assigned.push_back(bestI); }
-                        }
-                        for (int idx : selIdx) {
-                            if (units[idx].type == UNIT_HEALER) continue;
-                            if (unitAttacking[idx]) continue;
-                            float ucx = units[idx].fx + units[idx].width/2.0f;
-                            float ucy = units[idx].fy + units[idx].height/2.0f;
-                            float bestD = 1e9f; int bestI = -1;
-                            for (int tIdx : captured) {
-                                if (tIdx < 0 || tIdx >= (int)enemies.size() || !enemies[tIdx].alive) continue;
-                                float dx = (float)enemies[tIdx].x - ucx; float dy = (float)enemies[tIdx].y - ucy; float d = sqrtf(dx*dx + dy*dy);
-                                if (d < bestD) { bestD = d; bestI = tIdx; }
-                            }
-                            if (bestI != -1) { unitAttacking[idx] = true; unitTargetEnemy[idx] = bestI; }
-                        }
-                    }
-                    Vector2 wCenter{ l + (r-l)*0.5f, t + (b-t)*0.5f };
-                    for (int idx : selIdx) {
-                        Unit &u = units[idx];
-                        float offX = (u.x + u.width/2.0f) - selCenter.x;
-                        float offY = (u.y + u.height/2.0f) - selCenter.y;
-                        float tcx = wCenter.x + offX, tcy = wCenter.y + offY;
-                        u.targetX = (int)lroundf(tcx - u.width/2.0f);
-                        u.targetY = (int)lroundf(tcy - u.height/2.0f);
-                        u.moving = true;
-                    }
-                }
+                Command c;
+                c.type = CMD_AREA_ATTACK;
+                for (int i = 0; i < (int)units.size(); ++i) if (units[i].selected) c.units.push_back(i);
+                c.x = (int)floorf(l); c.y = (int)floorf(t);
+                c.w = (int)ceilf(r) - c.x; c.h = (int)ceilf(b) - c.y;
+                if (!c.units.empty()) issue(c);
             } else {
                 Vector2 wMouse = GetScreenToWorld2D(GetMousePosition(), camera);
-                int hitUnit = -1;
-                for (int i = (int)units.size() - 1; i >= 0; --i) {
-                    if (units[i].type == UNIT_HEALER) continue; 
-                    Rectangle ur{ (float)units[i].x, (float)units[i].y, (float)units[i].width, (float)units[i].height };
-                    if (CheckCollisionPointRec(wMouse, ur)) { hitUnit = i; break; }
-                }
+                int hitUnit = unitAt(game, wMouse);
                 if (hitUnit != -1) {
-                    for (int i = 0; i < (int)units.size(); ++i) units[i].selected = (i == hitUnit);
+                    std::vector<bool> sel(units.size(), false);
+                    sel[hitUnit] = true;
+                    issueSelection(sel);
                 } else {
-                    int clickedEnemy = -1;
-                    for (int i = (int)enemies.size() - 1; i >= 0; --i) {
-                        if (!enemies[i].alive) continue;
-                        Rectangle er{ (float)(enemies[i].x - enemies[i].width/2), (float)(enemies[i].y - enemies[i].height/2), (float)enemies[i].width, (float)enemies[i].height };
-                        if (CheckCollisionPointRec(wMouse, er)) { clickedEnemy = i; break; }
-                    }
-                    std::vector<int> selIdx; Vector2 selCenter{0,0};
-                    for (int i=0;i<(int)units.size();++i) if (units[i].selected && units[i].type != UNIT_HEALER) { selIdx.push_back(i); selCenter.x += units[i].x + units[i].width/2.0f; selCenter.y += units[i].y + units[i].height/2.0f; }
-                    if (!selIdx.empty()) {
+                    int clickedEnemy = enemyAt(game, wMouse);
+                    Command c;
+                    for (int i = 0; i < (int)units.size(); ++i) if (units[i].selected && !UNIT_TRAITS[units[i].type].heals) c.units.push_back(i);
+                    if (!c.units.empty()) {
                         if (clickedEnemy != -1) {
-                            for (int idx : selIdx) { unitAreaAttack[idx] = false; unitAreaTargets[idx].clear(); unitAttacking[idx] = true; unitTargetEnemy[idx] = clickedEnemy; }
+                            c.type = CMD_ATTACK;
+                            c.arg = (int)enemies.idAt(clickedEnemy).bits;
                         } else {
-                            selCenter.x /= (float)selIdx.size(); selCenter.y /= (float)selIdx.size();
-                            for (int idx : selIdx) { unitAreaAttack[idx] = false; unitAreaTargets[idx].clear(); unitAttacking[idx] = false; unitTargetEnemy[idx] = -1; }
-                            for (int idx : selIdx) {
-                                Unit &u = units[idx];
-                                float offX = (u.x + u.width/2.0f) - selCenter.x;
-                                float offY = (u.y + u.height/2.0f) - selCenter.y;
-                                float tcx = wMouse.x + offX, tcy = wMouse.y + offY;
-                                u.targetX = (int)lroundf(tcx - u.width/2.0f);
-                                u.targetY = (int)lroundf(tcy - u.height/2.0f);
-                                u.moving = true;
-                            }
+                            c.type = CMD_MOVE;
+                            c.x = (int)lroundf(wMouse.x);
+                            c.y = (int)lroundf(wMouse.y);
                         }
+                        issue(c);
                     }
                 }
             }
             isRightDragging = false; rightDidDrag = false;
         }
 
-        float dt = isPaused ? 0.0f : GetFrameTime() * timeScale;
-        if (playerShip.hp <= 0 || playerShip.isComplete) {
-            dt = 0.0f;
+        if (!replaying && inIntermission && playerShip.hp > 0 && !playerShip.isComplete && IsKeyPressed(KEY_ENTER)) {
+            Command c; c.type = CMD_NEXT_WAVE;
+            issue(c);
         }
 
-    if (!isPaused && playerShip.hp > 0 && !playerShip.isComplete) {
-            int aliveCount = 0;
-            for (const auto &e : enemies) if (e.alive) aliveCount++;
-            enemiesAlive = aliveCount;
-            if (aliveCount == 0 && !inIntermission) {
-                enemies.clear();
-                for (auto &u : units) {
-                    int heal = (int)(u.maxHp * 0.4f);
-                    u.hp = ClampVal(u.hp + heal, 0, u.maxHp);
-                }
-                playerShip.hp = ClampVal(playerShip.hp + (int)(playerShip.maxHp * 0.25f), 0, playerShip.maxHp);
-                int rewardBase = 12 + currentWave * 2;
-                float rewardScale = 1.0f;
-                switch (difficulty) {
-                    case DIFF_CASUAL: rewardScale = 1.15f; break; // a little more scrap to help
-                    case DIFF_NORMAL: rewardScale = 1.0f; break;
-                    case DIFF_HARD: rewardScale = 0.85f; break; // less scrap, harder economy
-                }
-                shop.scrapMetal += (int)std::round(rewardBase * rewardScale);
-                for (int i = 0; i < 4; ++i) {
-                    Rock r{}; r.width = 48; r.height = 48; int margin = 200;
-                    r.x = GetRandomValue(margin, (int)MAP_WIDTH - margin);
-                    r.y = GetRandomValue(margin, (int)MAP_HEIGHT - margin);
-                    float dx = r.x - playerShip.x; float dy = r.y - playerShip.y;
-                    if (dx*dx + dy*dy < 400.0f * 400.0f) { r.x += 400; }
-                    r.hp = r.maxHp = GetRandomValue(160, 260);
-                    r.scrapMin = 10; r.scrapMax = 20; r.alive = true; r.showHp = false;
-                    rocks.push_back(r);
-                }
-                inIntermission = true;
-                intermissionTime = INTERMISSION_DURATION;
-                for (int ui = 0; ui < (int)units.size(); ++ui) {
-                    unitAttacking[ui] = false;
-                    unitTargetEnemy[ui] = -1;
-                    unitAreaAttack[ui] = false;
-                    unitAreaTargets[ui].clear();
+        frameZone.next(PZ_SIM);
+        if (!isPaused) {
+            int ticks = stepper.advance(GetFrameTime(), timeScale);
+            // Fast-forward only ever adds ticks, each the same length, so a run
+            // ends the same at any speed. Past 3x the ticks get a wall-clock
+            // slice per frame and whatever does not fit is dropped, so the
+            // window keeps redrawing and taking input however slow the sim gets.
+            double simStart = GetTime();
+            double budget = timeScale >= TIME_SCALE_MAX ? FF_MAX_BUDGET_S : FF_FRAME_BUDGET_S;
+            int ran = 0;
+            if (ticks > 0) playFromHere();
+            for (int t = 0; t < ticks; ++t) {
+                if (timeScale > 3.0f && GetTime() - simStart > budget) break;
+                ran++;
+                if (replaying) {
+                    size_t from = replayCursor.next;
+                    int scale = replayCursor.applyDue(game);
+                    if (scale > 0) timeScale = scale / 4.0f;
+                    if (rewindEnabled) for (size_t k = from; k < replayCursor.next; ++k) rewind.command(game, replay.commands[k]);
+                    if (replayCursor.finished(game)) { isPaused = true; break; }
                 }
+                updateGame(game, stepper.tickDt);
+                if (rewindEnabled) rewind.afterTick(game);
             }
+            float frameTime = GetFrameTime();
+            if (frameTime > 0.0f) effectiveSpeed = LerpVal(effectiveSpeed, ran * stepper.tickDt / frameTime, 0.1f);
         }
+        // Moving things are drawn between their last two ticks.
+        const float alpha = stepper.alpha();
 
-        if (inIntermission && playerShip.hp > 0 && !playerShip.isComplete) {
-            if (IsKeyPressed(KEY_ENTER)) {
-                startNextWave();
-            } else if (!isPaused) {
-                intermissionTime -= GetFrameTime() * timeScale;
-                if (intermissionTime <= 0.0f) {
-                    startNextWave();
-                }
-            }
-        }
-        
-        for (int i = 0; i < (int)units.size(); ++i) {
-            Unit &u = units[i];
-            if (unitFireTimer[i] > 0.0f) { unitFireTimer[i] -= dt; if (unitFireTimer[i] < 0.0f) unitFireTimer[i] = 0.0f; }
-
-            if (!unitAttacking[i] && u.type != UNIT_HEALER) {
-                float ucx = u.fx + u.width/2.0f;
-                float ucy = u.fy + u.height/2.0f;
-                int nearestEnemy = -1;
-                float nearestDist = 1e9f;
-
-                if (unitAreaAttack[i]) {
-                    auto &list = unitAreaTargets[i];
-                    list.erase(std::remove_if(list.begin(), list.end(), [&](int idx){ return idx < 0 || idx >= (int)enemies.size() || !enemies[idx].alive; }), list.end());
-                    if (!list.empty()) {
-                        std::vector<char> used(enemies.size(), 0);
-                        for (int j = 0; j < (int)units.size(); ++j) {
-                            if (j == i) continue;
-                            if (unitAreaAttack[j] && unitAttacking[j]) {
-                                int tj = unitTargetEnemy[j];
-                                if (tj >= 0 && tj < (int)enemies.size() && enemies[tj].alive) used[tj] = 1;
-                            }
-                        }
-                        int bestI = -1; float bestD = 1e9f;
-                        for (int t : list) {
-                            if (t >= 0 && t < (int)enemies.size() && !used[t]) {
-                                float dx = (float)enemies[t].x - ucx; float dy = (float)enemies[t].y - ucy; float d = sqrtf(dx*dx + dy*dy);
-                                if (d < bestD) { bestD = d; bestI = t; }
-                            }
-                        }
-                        if (bestI == -1) { 
-                            bestD = 1e9f;
-                            for (int t : list) {
-                                float dx = (float)enemies[t].x - ucx; float dy = (float)enemies[t].y - ucy; float d = sqrtf(dx*dx + dy*dy);
-                                if (d < bestD) { bestD = d; bestI = t; }
-                            }
-                        }
-                        if (bestI != -1) { unitAttacking[i] = true; unitTargetEnemy[i] = bestI; }
-                    } else {
-                        unitAreaAttack[i] = false;
-                    }
-                }
-                if (!unitAreaAttack[i] && !unitAttacking[i]) {
-                    for (int ei = 0; ei < (int)enemies.size(); ++ei) {
-                        const EnemyNPC &e = enemies[ei];
-                        if (!e.alive) continue;
-                        float dx = (float)e.x - ucx;
-                        float dy = (float)e.y - ucy;
-                        float d = sqrtf(dx*dx + dy*dy);
-                        if (d < nearestDist) { nearestDist = d; nearestEnemy = ei; }
-                    }
-                    if (nearestEnemy >= 0 && nearestDist <= u.range) {
-                        unitAttacking[i] = true;
-                        unitTargetEnemy[i] = nearestEnemy;
-                        u.moving = false;
-                    } else {
-                        if (rockAssignmentDirty) recomputeRockAssignments();
-                        int assigned = (i < (int)unitAssignedRock.size()) ? unitAssignedRock[i] : -1;
-                        if (assigned < 0 || assigned >= (int)rocks.size() || !rocks[assigned].alive) {
-                            rockAssignmentDirty = true;
-                            recomputeRockAssignments();
-                            assigned = (i < (int)unitAssignedRock.size()) ? unitAssignedRock[i] : -1;
-                        }
-                        if (assigned != -1) {
-                            float dxr = (float)rocks[assigned].x - ucx;
-                            float dyr = (float)rocks[assigned].y - ucy;
-                            float distR = sqrtf(dxr*dxr + dyr*dyr);
-                            if (distR > u.range + ATTACK_RANGE_HYST) {
-                                float inv = (distR > 0.0001f) ? (1.0f / distR) : 0.0f;
-                                float dirx = dxr * inv;
-                                float diry = dyr * inv;
-                                float desiredCX = (float)rocks[assigned].x - dirx * u.range;
-                                float desiredCY = (float)rocks[assigned].y - diry * u.range;
-                                u.targetX = (int)lroundf(desiredCX - u.width/2.0f);
-                                u.targetY = (int)lroundf(desiredCY - u.height/2.0f);
-                                u.moving = true;
-                            } else {
-                                if (unitFireTimer[i] <= 0.0f) {
-                                    float inv = (distR > 0.0001f) ? (1.0f / distR) : 0.0f;
-                                    float dirx = dxr * inv;
-                                    float diry = dyr * inv;
-                                    Bullet b{}; b.x = ucx; b.y = ucy; b.speed = BULLET_SPEED; b.vx = dirx * b.speed; b.vy = diry * b.speed; b.active = true;
-                                    b.damage = u.damage; b.unitIndex = i;
-                                    bullets.push_back(b);
-                                    unitFireTimer[i] = 1.0f / u.fireRate;
-                                }
-                                u.moving = false;
-                            }
-                        }
-                    }
-                }
-            }
-            if (unitAttacking[i]) {
-                int ti = unitTargetEnemy[i];
-                if (ti < 0 || ti >= (int)enemies.size() || !enemies[ti].alive) {
-                    unitAttacking[i] = false; unitTargetEnemy[i] = -1; u.moving = false;
-                    if (unitAreaAttack[i]) {
-                        auto &list = unitAreaTargets[i];
-                        list.erase(std::remove_if(list.begin(), list.end(), [&](int idx){ return idx < 0 || idx >= (int)enemies.size() || !enemies[idx].alive; }), list.end());
-                        if (!list.empty()) {
-                            float ucx2 = u.fx + u.width/2.0f; float ucy2 = u.fy + u.height/2.0f;
-                            std::vector<char> used(enemies.size(), 0);
-                            for (int j = 0; j < (int)units.size(); ++j) {
-                                if (j == i) continue;
-                                if (unitAreaAttack[j] && unitAttacking[j]) {
-                                    int tj = unitTargetEnemy[j];
-                                    if (tj >= 0 && tj < (int)enemies.size() && enemies[tj].alive) used[tj] = 1;
-                                }
-                            }
-                            int bestI = -1; float bestD = 1e9f;
-                            for (int t : list) {
-                                if (!used[t]) {
-                                    float dx2 = (float)enemies[t].x - ucx2; float dy2 = (float)enemies[t].y - ucy2; float d2 = sqrtf(dx2*dx2 + dy2*dy2);
-                                    if (d2 < bestD) { bestD = d2; bestI = t; }
-                                }
-                            }
-                            if (bestI == -1) {
-                                bestD = 1e9f;
-                                for (int t : list) {
-                                    float dx2 = (float)enemies[t].x - ucx2; float dy2 = (float)enemies[t].y - ucy2; float d2 = sqrtf(dx2*dx2 + dy2*dy2);
-                                    if (d2 < bestD) { bestD = d2; bestI = t; }
-                                }
-                            }
-                            if (bestI != -1) { unitAttacking[i] = true; unitTargetEnemy[i] = bestI; }
-                            else unitAreaAttack[i] = false;
-                        } else unitAreaAttack[i] = false;
-                    }
-                } else {
-                    float ucx = u.fx + u.width/2.0f;
-                    float ucy = u.fy + u.height/2.0f;
-                    float ecx = (float)enemies[ti].x;
-                    float ecy = (float)enemies[ti].y;
-                    float dx = ecx - ucx, dy = ecy - ucy;
-                    float distToEnemy = sqrtf(dx*dx + dy*dy);
-                    if (distToEnemy > u.range + ATTACK_RANGE_HYST) {
-                        float inv = (distToEnemy > 0.0001f) ? (1.0f / distToEnemy) : 0.0f;
-                        float dirx = dx * inv, diry = dy * inv;
-                        float desiredCX = ecx - dirx * u.range;
-                        float desiredCY = ecy - diry * u.range;
-                        u.targetX = (int)lroundf(desiredCX - u.width/2.0f);
-                        u.targetY = (int)lroundf(desiredCY - u.height/2.0f);
-                        u.moving = true;
-                    } else {
-                        u.moving = false;
-                        if (unitFireTimer[i] <= 0.0f) {
-                            float inv = (distToEnemy > 0.0001f) ? (1.0f / distToEnemy) : 0.0f;
-                            float dirx = dx * inv, diry = dy * inv;
-                            Bullet b{}; b.x = ucx; b.y = ucy; b.speed = BULLET_SPEED; b.vx = dirx * b.speed; b.vy = diry * b.speed; b.active = true;
-                            b.damage = u.damage; b.unitIndex = i;
-                            bullets.push_back(b);
-                            unitFireTimer[i] = 1.0f / u.fireRate;
-                        }
-                    }
-                }
-            }
-
-            if (u.type == UNIT_HEALER) {
-                int bestIdx = -1; float bestDist = 1e9f;
-                float ucx = u.fx + u.width/2.0f; float ucy = u.fy + u.height/2.0f;
-                for (int j = 0; j < (int)units.size(); ++j) {
-                    if (j == i) continue;
-                    const Unit &ally = units[j];
-                    if (ally.type == UNIT_HEALER) continue;
-                    if (ally.hp >= ally.maxHp) continue;
-                    float acx = ally.fx + ally.width/2.0f; float acy = ally.fy + ally.height/2.0f;
-                    float dx = acx - ucx, dy = acy - ucy; float d = sqrtf(dx*dx + dy*dy);
-                    if (d < bestDist) { bestDist = d; bestIdx = j; }
-                }
-                const float MEDIC_SEARCH = 1000.0f;
-                if (bestIdx != -1 && bestDist <= MEDIC_SEARCH) {
-                    float acx = units[bestIdx].fx + units[bestIdx].width/2.0f; float acy = units[bestIdx].fy + units[bestIdx].height/2.0f;
-                    float dx = acx - ucx, dy = acy - ucy; float len = sqrtf(dx*dx + dy*dy);
-                    float stopDist = u.range * 0.85f;
-                    if (len > stopDist) {
-                        float inv = (len > 0.0001f) ? (1.0f/len) : 0.0f;
-                        float tx = acx - dx*inv*stopDist;
-                        float ty = acy - dy*inv*stopDist;
-                        u.targetX = (int)lroundf(tx - u.width/2.0f);
-                        u.targetY = (int)lroundf(ty - u.height/2.0f);
-                        u.moving = true;
-                    } else {
-                        u.moving = false;
-                    }
-                }
-                unitAttacking[i] = false; unitTargetEnemy[i] = -1; 
-            }
-
-            if (u.moving) {
-                float dx = (float)u.targetX - u.fx, dy = (float)u.targetY - u.fy;
-                float dist = sqrtf(dx*dx + dy*dy);
-                float step = u.speed * dt;
-                if (dist <= step || dist < 0.5f) { u.fx = (float)u.targetX; u.fy = (float)u.targetY; u.moving = false; }
-                else if (dist > 0.0f) { u.fx += (dx/dist)*step; u.fy += (dy/dist)*step; }
-            }
-            u.x = (int)lroundf(u.fx); u.y = (int)lroundf(u.fy);
-        }
-
-        for (int i = 0; i < (int)units.size(); ++i) {
-            Unit &healer = units[i];
-            if (healer.type != UNIT_HEALER || healer.healRate <= 0.0f) continue;
-            float healerCX = healer.fx + healer.width * 0.5f;
-            float healerCY = healer.fy + healer.height * 0.5f;
-            float maxRange = healer.range;
-            for (int j = 0; j < (int)units.size(); ++j) {
-                if (i == j) continue;
-                Unit &ally = units[j];
-                if (ally.hp >= ally.maxHp) continue;
-                float allyCX = ally.fx + ally.width * 0.5f;
-                float allyCY = ally.fy + ally.height * 0.5f;
-                float dx = allyCX - healerCX;
-                float dy = allyCY - healerCY;
-                float dist = sqrtf(dx*dx + dy*dy);
-                if (dist > maxRange) continue;
-                float factor = (maxRange - dist) / maxRange;
-                if (factor < 0.0f) factor = 0.0f;
-                float frameHeal = healer.healRate * factor * dt; 
-                if (frameHeal <= 0.0f) continue;
-                unitHealFraction[j] += frameHeal;
-                int whole = (int)unitHealFraction[j];
-                if (whole > 0) {
-                    ally.hp += whole;
-                    unitHealFraction[j] -= (float)whole;
-                    if (ally.hp > ally.maxHp) {
-                        ally.hp = ally.maxHp;
-                        unitHealFraction[j] = 0.0f; 
-                    }
-                    if (ally.hp < ally.maxHp) ally.showHp = true;
-                }
-            }
-        }
-
-        for (int i = 0; i < (int)enemies.size(); ++i) {
-            EnemyNPC &enemy = enemies[i];
-            if (!enemy.alive) continue;
-
-            enemy.timeSinceLastAttack += dt;
-
-            float closestDist = 1e9f;
-            int closestUnit = -1;
-            float enemyCX = enemy.fx;
-            float enemyCY = enemy.fy;
-
-            for (int j = 0; j < (int)units.size(); ++j) {
-                const Unit &unit = units[j];
-                float unitCX = unit.fx + unit.width/2.0f;
-                float unitCY = unit.fy + unit.height/2.0f;
-                float dx = unitCX - enemyCX;
-                float dy = unitCY - enemyCY;
-                float dist = sqrtf(dx*dx + dy*dy);
-                if (dist < closestDist) { closestDist = dist; closestUnit = j; }
-            }
-
-            float distToShip = 1e9f;
-            float shipCX = playerShip.x; float shipCY = playerShip.y;
-            {
-                float dxs = shipCX - enemyCX; float dys = shipCY - enemyCY;
-                distToShip = sqrtf(dxs*dxs + dys*dys);
-            }
-
-            float shipPriorityRadius = enemy.attackRange + 10.0f; 
-            bool shipClose = (distToShip <= shipPriorityRadius);
-            bool engagingUnit = !shipClose && !enemy.prioritizeShip && (closestUnit >= 0 && closestDist <= enemy.detectionRange);
-            bool engagingShip = shipClose || enemy.prioritizeShip || (!engagingUnit && distToShip <= enemy.shipDetectionRange);
-
-            if (engagingUnit || engagingShip) {
-                float tx = engagingUnit ? (units[closestUnit].fx + units[closestUnit].width/2.0f) : shipCX;
-                float ty = engagingUnit ? (units[closestUnit].fy + units[closestUnit].height/2.0f) : shipCY;
-                float distToTarget = engagingUnit ? closestDist : distToShip;
-                bool shouldApproach = (distToTarget > enemy.attackRange);
-                if (enemy.avoidUnitsRange > 0.0f && closestUnit >= 0 && closestDist < enemy.avoidUnitsRange) {
-                    float ux = units[closestUnit].fx + units[closestUnit].width/2.0f;
-                    float uy = units[closestUnit].fy + units[closestUnit].height/2.0f;
-                    float dx = enemyCX - ux; float dy = enemyCY - uy; float len = sqrtf(dx*dx + dy*dy);
-                    if (len > 0.001f) {
-                        float step = enemy.moveSpeed * dt;
-                        float nx = dx / len, ny = dy / len;
-                        enemy.fx += nx * step;
-                        enemy.fy += ny * step;
-                        enemy.x = (int)lroundf(enemy.fx);
-                        enemy.y = (int)lroundf(enemy.fy);
-                    }
-                } else if (shouldApproach) {
-                    float dx = tx - enemyCX;
-                    float dy = ty - enemyCY;
-                    float len = sqrtf(dx*dx + dy*dy);
-                    if (len > 0.001f) {
-                        float step = enemy.moveSpeed * dt;
-                        float nx = dx / len, ny = dy / len;
-                        enemy.fx += nx * step;
-                        enemy.fy += ny * step;
-                        enemy.x = (int)lroundf(enemy.fx);
-                        enemy.y = (int)lroundf(enemy.fy);
-                    }
-                }
-
-                if (distToTarget <= enemy.attackRange && enemy.timeSinceLastAttack >= enemy.attackCooldown) {
-                    if (engagingUnit) {
-                        units[closestUnit].hp -= (int)enemy.attackDamage;
-                        if (units[closestUnit].hp < 0) units[closestUnit].hp = 0;
-                        if (units[closestUnit].hp < units[closestUnit].maxHp) units[closestUnit].showHp = true;
-                    } else if (engagingShip) {
-                        playerShip.hp -= (int)enemy.attackDamage;
-                        if (playerShip.hp < 0) playerShip.hp = 0;
-                    }
-                    enemy.timeSinceLastAttack = 0.0f;
-                }
-            }
-        }
-
-        {
-            Vector2 avg{0,0}; int cnt = 0;
-            for (const auto &u : units) if (u.type != UNIT_HEALER) { avg.x += u.fx + u.width/2.0f; avg.y += u.fy + u.height/2.0f; cnt++; }
-            if (cnt > 0) { avg.x /= cnt; avg.y /= cnt; }
-            int inRadius = 0; const float clusterRadius = 140.0f;
-            for (auto &u : units) if (u.type != UNIT_HEALER) {
-                float cx = u.fx + u.width/2.0f, cy = u.fy + u.height/2.0f;
-                float dx = cx - avg.x, dy = cy - avg.y; float d2 = dx*dx + dy*dy;
-                if (d2 <= clusterRadius*clusterRadius) inRadius++;
-            }
-            static float blobTimer = 0.0f; blobTimer += dt;
-            (void)inRadius; (void)clusterRadius; (void)avg; (void)cnt; (void)blobTimer;
-        }
-        
-        for (int i = 0; i < (int)units.size(); ++i) {
-            Unit &medic = units[i];
-            if (medic.type != UNIT_HEALER || medic.healRate <= 0.0f) continue;
-            
-            Rectangle medicRect = {medic.fx, medic.fy, (float)medic.width, (float)medic.height};
-            
-            for (int j = 0; j < (int)units.size(); ++j) {
-                if (i == j) continue;
-                Unit &patient = units[j];
-                if (patient.hp >= patient.maxHp) continue;
-                
-                Rectangle patientRect = {patient.fx, patient.fy, (float)patient.width, (float)patient.height};
-                
-                if (CheckCollisionRecs(medicRect, patientRect)) {
-                    patient.hp += (int)(medic.healRate * dt * 2.0f);
-                    if (patient.hp > patient.maxHp) patient.hp = patient.maxHp;
-                }
-            }
-        }
-
-        for (auto &b : bullets) {
-            if (!b.active) continue;
-            b.x += b.vx * dt;
-            b.y += b.vy * dt;
-            if (b.x < -50 || b.y < -50 || b.x > MAP_WIDTH + 50 || b.y > MAP_HEIGHT + 50) b.active = false;
-            if (b.active) {
-                for (auto &e : enemies) {
-                    if (!e.alive) continue;
-                    Rectangle er{ (float)(e.x - e.width/2), (float)(e.y - e.height/2), (float)e.width, (float)e.height };
-                    if (CheckCollisionPointRec(Vector2{ b.x, b.y }, er)) {
-                        e.showHp = true;
-                        e.hp -= b.damage; 
-                        if (e.hp <= 0) {
-                            e.alive = false;
-                            
-                            shop.scrapMetal += GetRandomValue(2, 5);
-                            
-                            for (int p = 0; p < 12; ++p) {
-                                Particle particle;
-                                particle.x = e.x + e.width/2.0f;
-                                particle.y = e.y + e.height/2.0f;
-                                
-                                float angle = (float)p / 12.0f * 2.0f * PI + ((float)rand() / RAND_MAX - 0.5f) * 0.5f;
-                                float speed = 80.0f + (float)rand() / RAND_MAX * 120.0f;
-                                particle.vx = cosf(angle) * speed;
-                                particle.vy = sinf(angle) * speed;
-                                
-                                particle.maxLife = 0.8f + (float)rand() / RAND_MAX * 0.4f;
-                                particle.life = particle.maxLife;
-                                
-                                int colorVariant = rand() % 3;
-                                if (colorVariant == 0) particle.color = (Color){180, 20, 20, 255};
-                                else if (colorVariant == 1) particle.color = (Color){220, 40, 40, 255};
-                                else particle.color = (Color){160, 10, 10, 255};                        
-                                
-                                particle.active = true;
-                                particles.push_back(particle);
-                            }
-                        }
-                        b.active = false; 
-                        break; 
-                    }
-                }
-                if (!b.active) continue;
-                for (auto &r : rocks) {
-                    if (!r.alive) continue;
-                    Rectangle rr{ (float)(r.x - r.width/2), (float)(r.y - r.height/2), (float)r.width, (float)r.height };
-                    if (CheckCollisionPointRec(Vector2{ b.x, b.y }, rr)) {
-                        r.showHp = true;
-                        r.hp -= b.damage;
-                        if (r.hp <= 0) {
-                            r.alive = false;
-                            int gain = GetRandomValue(r.scrapMin, r.scrapMax);
-                            shop.scrapMetal += gain;
-                            rockAssignmentDirty = true;
-                            for (int p = 0; p < 10; ++p) {
-                                Particle particle;
-                                particle.x = r.x;
-                                particle.y = r.y;
-                                float angle = ((float)rand() / RAND_MAX) * 2.0f * PI;
-                                float speed = 60.0f + (float)rand() / RAND_MAX * 100.0f;
-                                particle.vx = cosf(angle) * speed;
-                                particle.vy = sinf(angle) * speed;
-                                particle.maxLife = 0.6f + (float)rand() / RAND_MAX * 0.5f;
-                                particle.life = particle.maxLife;
-                                particle.color = (Color){140, 120, 80, 255}; 
-                                particle.active = true;
-                                particles.push_back(particle);
-                            }
-                        }
-                        b.active = false;
-                        break;
-                    }
-                }
-            }
-        }
-        bullets.erase(std::remove_if(bullets.begin(), bullets.end(), [](const Bullet& b){ return !b.active; }), bullets.end());
-
-        for (auto &p : particles) {
-            if (p.active) {
-                p.x += p.vx * dt;
-                p.y += p.vy * dt;
-                p.vy += 300.0f * dt; 
-                p.vx *= 0.98f; 
-                p.life -= dt;
-                if (p.life <= 0.0f) {
-                    p.active = false;
-                }
-            }
-        }
-        particles.erase(std::remove_if(particles.begin(), particles.end(), [](const Particle& p){ return !p.active; }), particles.end());
-
+        frameZone.next(PZ_WORLD_RENDER);
         BeginDrawing();
         ClearBackground((Color){10, 10, 40, 255});
         
         BeginMode2D(camera);
         
-        DrawRectangleGradientV(-2000, -2000, (int)MAP_WIDTH + 4000, (int)MAP_HEIGHT + 4000, (Color){10, 10, 40, 255}, (Color){40, 20, 80, 255});
-        
-        for (int i = 0; i < 300; i++) {
-            int x = (i * 137 + 200) % (int)(MAP_WIDTH + 1000) - 500;
-            int y = (i * 181 + 300) % (int)(MAP_HEIGHT + 1000) - 500;
-            Color starColor = (Color){255, 255, 255, (unsigned char)(80 + (i * 13) % 120)};
-            DrawCircle(x, y, ((i % 3) + 1) * 0.7f, starColor);
-        }
-        
-                for (int i = 0; i < 4; ++i) {
-            int x = (i * 89 + 100) % (int)(MAP_WIDTH + 800) - 400;
-            int y = (i * 73 + 150) % (int)(MAP_HEIGHT + 800) - 400;
-            Color cloudColor;
-            if (i % 3 == 0) cloudColor = (Color){80, 30, 120, 25};
-            else if (i % 3 == 1) cloudColor = (Color){30, 80, 120, 20};
-            else cloudColor = (Color){120, 30, 80, 18};
-            DrawCircle(x, y, 80 + (i % 60), cloudColor);
-        }
+        // Everything in world space is culled against what the camera shows,
+        // padded so HP bars and labels hanging off a sprite still draw.
+        const Rectangle view = cameraView(camera, GetScreenWidth(), GetScreenHeight());
+        const Rectangle padded{ view.x - 24.0f, view.y - 24.0f, view.width + 48.0f, view.height + 48.0f };
+
+        drawBackground(background, view);
         
-                rockAssignmentDirty = true;
         DrawRectangleLines(0, 0, (int)MAP_WIDTH, (int)MAP_HEIGHT, DARKGRAY);
         
-        DrawRectangle((int)playerShip.x - playerShip.width/2, (int)playerShip.y - playerShip.height/2, playerShip.width, playerShip.height, DARKBLUE);
-        DrawRectangleLines((int)playerShip.x - playerShip.width/2, (int)playerShip.y - playerShip.height/2, playerShip.width, playerShip.height, BLUE);
-        {
+        if (inView(padded, playerShip.x - playerShip.width/2, playerShip.y - playerShip.height/2, (float)playerShip.width, (float)playerShip.height + 12)) {
+            DrawRectangle((int)playerShip.x - playerShip.width/2, (int)playerShip.y - playerShip.height/2, playerShip.width, playerShip.height, DARKBLUE);
+            DrawRectangleLines((int)playerShip.x - playerShip.width/2, (int)playerShip.y - playerShip.height/2, playerShip.width, playerShip.height, BLUE);
             float pct = (float)playerShip.hp / (float)playerShip.maxHp;
             int barW = playerShip.width;
             int barH = 6;
@@ -1352,20 +1172,72 @@ int main() {
             Color col = (pct < 0.3f) ? RED : (pct < 0.6f ? YELLOW : GREEN);
             DrawRectangle(bx, by, (int)lroundf(barW * ClampVal(pct, 0.0f, 1.0f)), barH, col);
             DrawRectangleLines(bx, by, barW, barH, WHITE);
+            DrawText("SHIP", (int)playerShip.x - 20, (int)playerShip.y - 10, 16, SKYBLUE);
         }
-        DrawText("SHIP", (int)playerShip.x - 20, (int)playerShip.y - 10, 16, SKYBLUE);
         
-    for (const auto &u : units) {
-            Rectangle src{0,0,(float)u.texture.width,(float)u.texture.height};
-            Rectangle dst{(float)u.x,(float)u.y,(float)u.width,(float)u.height};
-            DrawTexturePro(u.texture, src, dst, Vector2{0,0}, 0.0f, WHITE);
+        for (const auto &r : rocks) {
+            if (!inView(padded, (float)(r.x - r.width/2), (float)(r.y - r.height/2), (float)r.width, (float)r.height)) continue;
+            float pct = (r.maxHp > 0) ? (float)r.hp / (float)r.maxHp : 0.0f;
+            Color baseCol = (Color){90, 80, 60, 255};
+            float darkFactor = ClampVal(pct, 0.0f, 1.0f); 
+            Color dynCol;
+            dynCol.r = (unsigned char)(baseCol.r * (0.25f + 0.75f * darkFactor));
+            dynCol.g = (unsigned char)(baseCol.g * (0.25f + 0.75f * darkFactor));
+            dynCol.b = (unsigned char)(baseCol.b * (0.25f + 0.75f * darkFactor));
+            dynCol.a = 255;
+            DrawRectangle(r.x - r.width/2, r.y - r.height/2, r.width, r.height, dynCol);
+            Color outlineCol = (Color){(unsigned char)ClampVal<int>(140 * darkFactor + 20*(1-darkFactor),0,255), (unsigned char)ClampVal<int>(120 * darkFactor + 20*(1-darkFactor),0,255), (unsigned char)ClampVal<int>(90 * darkFactor + 15*(1-darkFactor),0,255), 255};
+            DrawRectangleLines(r.x - r.width/2, r.y - r.height/2, r.width, r.height, outlineCol);
+            if (r.showHp) {
+                const int barW = r.width;
+                const int barH = 3;
+                int bx = r.x - barW/2;
+                int by = r.y - r.height/2 - 5;
+                DrawRectangle(bx, by, barW, barH, DARKGRAY);
+                DrawRectangle(bx, by, (int)lroundf(barW * ClampVal(pct, 0.0f, 1.0f)), barH, BROWN);
+                DrawRectangleLines(bx, by, barW, barH, BLACK);
+            }
+        }
+
+        // All sprites back to back from the atlas, then everything drawn over them.
+        for (const auto &u : units) {
+            float ux = roundf(LerpVal(u.prevFx, u.fx, alpha)), uy = roundf(LerpVal(u.prevFy, u.fy, alpha));
+            if (!inView(view, ux, uy, (float)u.width, (float)u.height)) continue;
+            Rectangle dst{ ux, uy, (float)u.width, (float)u.height };
+            DrawTexturePro(atlas.texture, atlas[SPRITE_UNIT], dst, Vector2{0,0}, 0.0f, WHITE);
+        }
+        visibleEnemies.clear();
+        for (int i = 0; i < enemies.size(); ++i) {
+            float ex = LerpVal(enemies.prevX[i], enemies.x[i], alpha);
+            float ey = LerpVal(enemies.prevY[i], enemies.y[i], alpha);
+            Rectangle dst{ ex - ENEMY_SIZE/2, ey - ENEMY_SIZE/2, (float)ENEMY_SIZE, (float)ENEMY_SIZE };
+            if (!inView(padded, dst.x, dst.y, dst.width, dst.height)) continue;
+            visibleEnemies.push_back(i);
+            if (!inView(view, dst.x, dst.y, dst.width, dst.height)) continue;
+            DrawTexturePro(atlas.texture, atlas[SPRITE_ALIEN], dst, Vector2{0,0}, 0.0f, WHITE);
+        }
+
+        for (const auto &b : bullets) {
+            float bx = LerpVal(b.prevX, b.x, alpha), by = LerpVal(b.prevY, b.y, alpha);
+            if (!circleInView(view, bx, by, 5.5f)) continue;
+            Color bulletColor = YELLOW;
+            if (b.unitIndex >= 0 && b.unitIndex < (int)units.size()) bulletColor = unitTypeColor(units[b.unitIndex].type);
+            DrawCircle((int)bx, (int)by, 5.5f, bulletColor);
+        }
+        
+        drawParticles(particles, alpha, atlas, view);
+
+        for (const auto &u : units) {
+            int ux = (int)lroundf(LerpVal(u.prevFx, u.fx, alpha));
+            int uy = (int)lroundf(LerpVal(u.prevFy, u.fy, alpha));
+            if (!inView(padded, (float)ux, (float)uy, (float)u.width, (float)u.height)) continue;
             
             if (u.showHp) {
                 float pct = (u.maxHp > 0) ? (float)u.hp / (float)u.maxHp : 0.0f;
                 const int barW = u.width;
                 const int barH = 4;
-                int barX = u.x;
-                int barY = u.y - barH - 2;
+                int barX = ux;
+                int barY = uy - barH - 2;
                 DrawRectangle(barX, barY, barW, barH, BLACK);
                 
                 Color healthColor = GREEN;
@@ -1385,73 +1257,24 @@ int main() {
                 case UNIT_HEAVY: roleText = "HEAVY"; roleColor = RED; break;
                 case UNIT_ROCKET: roleText = "ROCKET"; roleColor = YELLOW; break;
                 case UNIT_HEALER: roleText = "MEDIC"; roleColor = GREEN; break;
+                case UNIT_TYPE_COUNT: break;
             }
             int textWidth = MeasureText(roleText, 8);
-            DrawText(roleText, u.x + (u.width - textWidth) / 2, u.y + u.height + 2, 8, roleColor);
-        }
-        for (const auto &b : bullets) if (b.active) {
-            Color bulletColor = YELLOW; 
-            if (b.unitIndex >= 0 && b.unitIndex < 6) {
-                switch (b.unitIndex) {
-                    case 0: bulletColor = WHITE; break;  
-                    case 1: bulletColor = YELLOW; break;    
-                    case 2: bulletColor = BLUE; break;     
-                    case 3: bulletColor = RED; break;      
-                    case 4: bulletColor = ORANGE; break;   
-                    case 5: bulletColor = GREEN; break;    
-                }
-            }
-            DrawCircle((int)b.x, (int)b.y, 5.5f, bulletColor);
-        }
-        
-        for (const auto &p : particles) {
-            if (p.active) {
-                float alpha = p.life / p.maxLife;
-                Color fadeColor = p.color;
-                fadeColor.a = (unsigned char)(alpha * 255);
-                float size = 2.0f + (1.0f - alpha) * 1.0f; 
-                DrawCircle((int)p.x, (int)p.y, size, fadeColor);
-            }
-        }
-        
-        for (const auto &r : rocks) {
-            if (!r.alive) continue;
-            float pct = (r.maxHp > 0) ? (float)r.hp / (float)r.maxHp : 0.0f;
-            Color baseCol = (Color){90, 80, 60, 255};
-            float darkFactor = ClampVal(pct, 0.0f, 1.0f); 
-            Color dynCol;
-            dynCol.r = (unsigned char)(baseCol.r * (0.25f + 0.75f * darkFactor));
-            dynCol.g = (unsigned char)(baseCol.g * (0.25f + 0.75f * darkFactor));
-            dynCol.b = (unsigned char)(baseCol.b * (0.25f + 0.75f * darkFactor));
-            dynCol.a = 255;
-            DrawRectangle(r.x - r.width/2, r.y - r.height/2, r.width, r.height, dynCol);
-            Color outlineCol = (Color){(unsigned char)ClampVal<int>(140 * darkFactor + 20*(1-darkFactor),0,255), (unsigned char)ClampVal<int>(120 * darkFactor + 20*(1-darkFactor),0,255), (unsigned char)ClampVal<int>(90 * darkFactor + 15*(1-darkFactor),0,255), 255};
-            DrawRectangleLines(r.x - r.width/2, r.y - r.height/2, r.width, r.height, outlineCol);
-            if (r.showHp) {
-                const int barW = r.width;
-                const int barH = 3;
-                int bx = r.x - barW/2;
-                int by = r.y - r.height/2 - 5;
-                DrawRectangle(bx, by, barW, barH, DARKGRAY);
-                DrawRectangle(bx, by, (int)lroundf(barW * ClampVal(pct, 0.0f, 1.0f)), barH, BROWN);
-                DrawRectangleLines(bx, by, barW, barH, BLACK);
-            }
+            DrawText(roleText, ux + (u.width - textWidth) / 2, uy + u.height + 2, 8, roleColor);
         }
 
-        for (const auto &e : enemies) {
-            if (!e.alive) continue;
-            Rectangle src{ 0, 0, (float)alienTex.width, (float)alienTex.height };
-            Rectangle dst{ (float)(e.x - e.width/2), (float)(e.y - e.height/2), (float)e.width, (float)e.height };
-            DrawTexturePro(alienTex, src, dst, Vector2{0,0}, 0.0f, WHITE);
-            if (e.type == ENEMY_SIEGE) {
-                DrawRectangleLines((int)dst.x, (int)dst.y, (int)dst.width, (int)dst.height, ORANGE);
+        for (int i : visibleEnemies) {
+            float ex = LerpVal(enemies.prevX[i], enemies.x[i], alpha);
+            float ey = LerpVal(enemies.prevY[i], enemies.y[i], alpha);
+            if (enemies.type[i] == ENEMY_SIEGE) {
+                DrawRectangleLines((int)(ex - ENEMY_SIZE/2), (int)(ey - ENEMY_SIZE/2), ENEMY_SIZE, ENEMY_SIZE, ORANGE);
             }
-            if (e.showHp) {
-                float pct = (e.maxHp > 0) ? (float)e.hp / (float)e.maxHp : 0.0f;
-                const int barW = e.width;
+            if (enemies.showHp[i]) {
+                float pct = (enemies.maxHp[i] > 0) ? (float)enemies.hp[i] / (float)enemies.maxHp[i] : 0.0f;
+                const int barW = ENEMY_SIZE;
                 const int barH = 4;
-                int bx = e.x - barW/2;
-                int by = e.y - e.height/2 - 6;
+                int bx = (int)ex - barW/2;
+                int by = (int)ey - ENEMY_SIZE/2 - 6;
                 DrawRectangle(bx, by, barW, barH, DARKGRAY);
                 DrawRectangle(bx, by, (int)lroundf(barW * pct), barH, LIME);
                 DrawRectangleLines(bx, by, barW, barH, BLACK);
@@ -1471,57 +1294,44 @@ int main() {
             for (const auto &u : units) { if (u.selected) { anySelected = true; break; } }
             if (anySelected) {
                 Vector2 wMouse = GetScreenToWorld2D(GetMousePosition(), camera);
-                int hoverIdx = -1;
-                int hoverRock = -1;
-                for (int i = (int)enemies.size()-1; i >= 0; --i) {
-                    const auto &e = enemies[i];
-                    if (!e.alive) continue;
-                    Rectangle er{ (float)(e.x - e.width/2), (float)(e.y - e.height/2), (float)e.width, (float)e.height };
-                    if (CheckCollisionPointRec(wMouse, er)) { hoverIdx = i; break; }
-                }
-                if (hoverIdx == -1) {
-                    for (int i = (int)rocks.size()-1; i >= 0; --i) {
-                        const auto &r = rocks[i];
-                        if (!r.alive) continue;
-                        Rectangle rr{ (float)(r.x - r.width/2), (float)(r.y - r.height/2), (float)r.width, (float)r.height };
-                        if (CheckCollisionPointRec(wMouse, rr)) { hoverRock = i; break; }
-                    }
-                }
-                for (int i = 0; i < (int)enemies.size(); ++i) {
-                    const auto &e = enemies[i];
-                    if (!e.alive) continue;
-                    float r = (float)(std::max(e.width, e.height)/2 + 6);
+                int hoverIdx = enemyAt(game, wMouse);
+                int hoverRock = hoverIdx == -1 ? rockAt(game, wMouse) : -1;
+                for (int i : visibleEnemies) {
+                    float r = (float)(ENEMY_SIZE/2 + 6);
                     Color c = (i == hoverIdx) ? ORANGE : SKYBLUE;
-                    DrawCircleLines(e.x, e.y, r, c);
+                    DrawCircleLines((int)LerpVal(enemies.prevX[i], enemies.x[i], alpha), (int)LerpVal(enemies.prevY[i], enemies.y[i], alpha), r, c);
                 }
-                for (int i = 0; i < (int)rocks.size(); ++i) {
+                for (int i = 0; i < rocks.size(); ++i) {
                     const auto &r = rocks[i];
-                    if (!r.alive) continue;
                     float rr = (float)(std::max(r.width, r.height)/2 + 6);
+                    if (!circleInView(view, (float)r.x, (float)r.y, rr)) continue;
                     Color c = (i == hoverRock) ? GOLD : BROWN;
                     DrawCircleLines(r.x, r.y, rr, c);
                 }
             }
         }
         for (const auto &u : units) if (u.selected) {
-            int cx = u.x + u.width/2, cy = u.y + u.height/2; int r = (std::max(u.width,u.height)/2)+6;
+            int cx = (int)lroundf(LerpVal(u.prevFx, u.fx, alpha)) + u.width/2;
+            int cy = (int)lroundf(LerpVal(u.prevFy, u.fy, alpha)) + u.height/2;
+            int r = (std::max(u.width,u.height)/2)+6;
+            if (!circleInView(view, (float)cx, (float)cy, (float)r)) continue;
             DrawCircleLines(cx, cy, (float)r, SKYBLUE);
         }
         {
             Color ring = Fade(RED, 0.55f);
-            for (int i = 0; i < (int)units.size(); ++i) {
-                if (units[i].selected && unitAreaAttack[i]) {
-                    if (unitAreaRadius[i] > 0.0f) {
-                        DrawCircleLines((int)unitAreaCenter[i].x, (int)unitAreaCenter[i].y, unitAreaRadius[i], ring);
-                        DrawCircle((int)unitAreaCenter[i].x, (int)unitAreaCenter[i].y, 2.5f, ring);
-                    } else if (unitAreaRect[i].width > 0 && unitAreaRect[i].height > 0) {
-                        DrawRectangleLinesEx(unitAreaRect[i], 1.5f, ring);
-                    }
-                }
+            // Once per order, however many selected units share it.
+            std::vector<bool> drawn(game.areaOrders.size(), false);
+            for (const Unit &u : units) {
+                if (!u.selected || !u.areaAttacking() || drawn[u.areaOrder]) continue;
+                drawn[u.areaOrder] = true;
+                const Rectangle &ar = game.areaOrders[u.areaOrder].rect;
+                if (ar.width <= 0 || ar.height <= 0 || !inView(view, ar.x, ar.y, ar.width, ar.height)) continue;
+                DrawRectangleLinesEx(ar, 1.5f, ring);
             }
         }
         EndMode2D();
 
+        frameZone.next(PZ_HUD_RENDER);
         if (inIntermission && playerShip.hp > 0 && !playerShip.isComplete) {
             DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), Fade(BLACK, 0.35f));
             int panelW = 520, panelH = 180;
@@ -1547,8 +1357,9 @@ int main() {
             const char* label = "Start Next Wave (Enter)";
             int lw = MeasureText(label, 20);
             DrawText(label, (int)(btn.x + btn.width/2 - lw/2), (int)(btn.y + btn.height/2 - 10), 20, RAYWHITE);
-            if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && hov) {
-                startNextWave();
+            if (!replaying && IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && hov) {
+                Command c; c.type = CMD_NEXT_WAVE;
+                issue(c);
             }
         }
 
@@ -1566,35 +1377,45 @@ int main() {
         }
 
         {
+            // One slot per non-empty control group: key, size, pooled hp, and the
+            // type color when the group is a single type.
             const int slot = 40;
             const int pad = 8;
-            int baseX = pad;
-            int baseY = SCREEN_HEIGHT - pad - slot;
-            for (int i = 0; i < (int)units.size(); ++i) {
-                int x = baseX + i * (slot + pad);
-                int y = baseY;
-                Rectangle src{0,0,(float)units[i].texture.width,(float)units[i].texture.height};
+            int x = pad;
+            int y = SCREEN_HEIGHT - pad - slot;
+            for (int g = 0; g < CONTROL_GROUP_COUNT; ++g) {
+                const std::vector<int> &group = controlGroups[g];
+                int count = 0, selected = 0, hp = 0, maxHp = 0;
+                int type = -1;
+                for (int i : group) {
+                    if (i >= (int)units.size()) continue;
+                    const Unit &u = units[i];
+                    count++;
+                    if (u.selected) selected++;
+                    hp += std::max(u.hp, 0); maxHp += u.maxHp;
+                    type = (type == -1 || type == u.type) ? u.type : UNIT_TYPE_COUNT;
+                }
+                if (count == 0) continue;
                 Rectangle dst{(float)x,(float)y,(float)slot,(float)slot};
-                DrawRectangleLines(x-1, y-1, slot+2, slot+2, units[i].selected?YELLOW:LIGHTGRAY);
-                DrawTexturePro(units[i].texture, src, dst, Vector2{0,0}, 0.0f, WHITE);
-                const char* label = TextFormat("%d", i+1);
+                Color frame = selected == count ? YELLOW : (selected > 0 ? GOLD : LIGHTGRAY);
+                DrawRectangleLines(x-1, y-1, slot+2, slot+2, frame);
+                DrawTexturePro(atlas.texture, atlas[SPRITE_UNIT], dst, Vector2{0,0}, 0.0f, WHITE);
                 DrawRectangle(x, y, 14, 14, Fade(BLACK, 0.5f));
-                DrawText(label, x+3, y+1, 12, RAYWHITE);
-                
-                Color unitColor = WHITE; 
-                switch (i) {
-                    case 0: unitColor = WHITE; break;   
-                    case 1: unitColor = YELLOW; break;   
-                    case 2: unitColor = BLUE; break;     
-                    case 3: unitColor = RED; break;       
-                    case 4: unitColor = ORANGE; break;    
-                    case 5: unitColor = GREEN; break;     
+                DrawText(TextFormat("%d", g+1), x+3, y+1, 12, RAYWHITE);
+                if (count > 1) {
+                    const char *n = TextFormat("x%d", count);
+                    DrawText(n, x + slot - MeasureText(n, 10) - 2, y + 2, 10, RAYWHITE);
                 }
-                
-                int circleX = x + slot - 8; 
+                float frac = maxHp > 0 ? (float)hp / (float)maxHp : 0.0f;
+                DrawRectangle(x, y + slot + 2, slot, 3, Fade(BLACK, 0.7f));
+                DrawRectangle(x, y + slot + 2, (int)(slot * frac), 3, frac > 0.5f ? GREEN : (frac > 0.25f ? ORANGE : RED));
+
+                Color typeColor = type < UNIT_TYPE_COUNT ? unitTypeColor((UnitType)type) : LIGHTGRAY;
+                int circleX = x + slot - 8;
                 int circleY = y + slot - 8;
-                DrawCircle(circleX, circleY, 6, Fade(BLACK, 0.7f)); 
-                DrawCircle(circleX, circleY, 5, unitColor);
+                DrawCircle(circleX, circleY, 6, Fade(BLACK, 0.7f));
+                DrawCircle(circleX, circleY, 5, typeColor);
+                x += slot + pad;
             }
         }
         
@@ -1607,9 +1428,19 @@ int main() {
             
             const char* statusText;
             Color statusColor;
-            if (isPaused) {
+            if (isPaused && game.tick < rewind.newestTick()) {
+                statusText = TextFormat("REWOUND -%.2fs", (rewind.newestTick() - game.tick) * stepper.tickDt);
+                statusColor = SKYBLUE;
+            } else if (isPaused) {
                 statusText = "PAUSED";
                 statusColor = RED;
+            } else if (timeScale >= TIME_SCALE_MAX) {
+                statusText = TextFormat("FAST MAX (x%.0f)", effectiveSpeed);
+                statusColor = GOLD;
+            } else if (timeScale > 3.0f) {
+                // Short of the target means the sim cannot keep up with it.
+                statusText = TextFormat("FAST x%.0f (x%.0f)", timeScale, effectiveSpeed);
+                statusColor = LIME;
             } else if (timeScale > 1.0f) {
                 statusText = TextFormat("FAST x%.1f", timeScale);
                 statusColor = GREEN;
@@ -1623,8 +1454,12 @@ int main() {
             
             DrawText("TIME CONTROL", uiX, uiY, 12, LIGHTGRAY);
             DrawText(statusText, uiX, uiY + 15, 16, statusColor);
-            DrawText("SPACE: Pause", uiX, uiY + 35, 10, LIGHTGRAY);
-            DrawText("+/-: Speed  R: Reset", uiX, uiY + 47, 10, LIGHTGRAY);
+            DrawText(rewindEnabled ? "SPACE: Pause  , .: Step back/fwd" : "SPACE: Pause", uiX, uiY + 35, 10, LIGHTGRAY);
+            DrawText("+/-: Speed  F: Fast-fwd  R: Reset", uiX, uiY + 47, 10, LIGHTGRAY);
+            if (replaying) {
+                bool done = replayCursor.finished(game);
+                DrawText(done ? "REPLAY FINISHED" : TextFormat("REPLAY %u/%u", game.tick, replay.endTick), uiX, uiY + 59, 10, done ? GOLD : SKYBLUE);
+            }
         }
         
         {
@@ -1692,7 +1527,7 @@ int main() {
             DrawText(label, (int)(btnBack.x + btnBack.width/2 - lw/2), (int)(btnBack.y + btnBack.height/2 - 11), 22, RAYWHITE);
 
             if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && hov) {
-                gameState = STATE_MENU;
+                leaveGame();
             }
         }
 
@@ -1716,15 +1551,37 @@ int main() {
             DrawText(label, (int)(btnBack.x + btnBack.width/2 - lw/2), (int)(btnBack.y + btnBack.height/2 - 11), 22, RAYWHITE);
 
             if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && hov) {
-                gameState = STATE_MENU;
+                leaveGame();
+            }
+        }
+
+        frameZone.stop();
+        if (gProfiler.enabled) gProfiler.endFrame();
+        if (showProfiler) {
+            const int px = 12, py = 110, rowH = 14;
+            int rows = PZ_COUNT + 2;
+            DrawRectangle(px - 6, py - 6, 270, rows * rowH + 12, Fade(BLACK, 0.75f));
+            DrawText("ZONE            AVG ms   PEAK ms", px, py, 10, LIGHTGRAY);
+            for (int z = 0; z < PZ_COUNT; ++z) {
+                bool nested = z > PZ_SIM && z < PZ_WORLD_RENDER;
+                float avg = gProfiler.averageMs(z);
+                Color c = avg > 4.0f ? RED : (avg > 1.0f ? YELLOW : RAYWHITE);
+                DrawText(profileZoneName(z), px + (nested ? 10 : 0), py + (z + 1) * rowH, 10, c);
+                DrawText(TextFormat("%7.3f", avg), px + 120, py + (z + 1) * rowH, 10, c);
+                DrawText(TextFormat("%7.3f", gProfiler.peakMs(z)), px + 190, py + (z + 1) * rowH, 10, c);
             }
+            const char *cap = gProfiler.capturing ? TextFormat("F4: capturing, %d events", (int)gProfiler.events.size())
+                                                  : "F4: start trace capture";
+            DrawText(cap, px, py + (PZ_COUNT + 1) * rowH, 10, gProfiler.capturing ? ORANGE : GRAY);
         }
 
         EndDrawing();
     }
 
-    UnloadTexture(unitTex);
-    UnloadTexture(alienTex);
+    finishCapture();
+    stopRecording();
+    unloadBackground(background);
+    unloadSpriteAtlas(atlas);
     CloseWindow();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "game.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+void refreshRockGrid(Game &game) {
+    if (!game.rockGridDirty) return;
+    const EntityPool<Rock> &rocks = game.rocks;
+    game.rockGrid.clear();
+    for (int ri = 0; ri < rocks.size(); ++ri) {
+        const Rock &r = rocks[ri];
+        game.rockGrid.add(ri, r.bounds());
+    }
+    game.rockGrid.build();
+    game.rockGridDirty = false;
+}
+
+static inline float unitCenterX(const Unit &u) { return u.fx + u.width/2.0f; }
+static inline float unitCenterY(const Unit &u) { return u.fy + u.height/2.0f; }
+
+static inline float rockDist2(const Rock &r, float x, float y) {
+    float dx = (float)r.x - x, dy = (float)r.y - y;
+    return dx*dx + dy*dy;
+}
+
+// Nearest rock to (x, y), optionally only among rocks nobody holds. Grows a
+// box on the rock grid until the best hit is provably the nearest, then falls
+// back to a scan once the box is a good part of the map. Ties go to the lower index.
+static int nearestRock(const Game &game, float x, float y, bool freeOnly) {
+    const EntityPool<Rock> &rocks = game.rocks;
+    const std::vector<int> &holders = game.rockAssign.holders;
+    int best = -1;
+    float bestD2 = FLT_MAX;
+    auto consider = [&](int ri) {
+        const Rock &r = rocks[ri];
+        if (freeOnly && holders[rocks.slots.slotOf[ri]] > 0) return;
+        float d2 = rockDist2(r, x, y);
+        if (d2 < bestD2 || (d2 == bestD2 && ri < best)) { bestD2 = d2; best = ri; }
+    };
+    for (float radius = 256.0f; radius <= 1024.0f; radius *= 2.0f) {
+        game.rockGrid.queryRect(Rectangle{ x - radius, y - radius, 2*radius, 2*radius }, consider);
+        // Anything closer than radius sits inside the box we just searched.
+        if (best >= 0 && bestD2 <= radius * radius) return best;
+    }
+    for (int ri = 0; ri < rocks.size(); ++ri) consider(ri);
+    return best;
+}
+
+// Minimum-cost assignment of rows to columns (rows <= cols): the shortest
+// augmenting path form of the Hungarian algorithm, O(rows^2 * cols). Writes the
+// chosen column for every row.
+static void solveAssignment(int rows, int cols, const std::vector<double> &cost, std::vector<int> &rowCol) {
+    const double INF = 1e300;
+    std::vector<double> u(rows + 1, 0.0), v(cols + 1, 0.0), minv(cols + 1);
+    std::vector<int> p(cols + 1, 0), way(cols + 1, 0);
+    std::vector<char> used(cols + 1);
+    for (int i = 1; i <= rows; ++i) {
+        p[0] = i;
+        int j0 = 0;
+        std::fill(minv.begin(), minv.end(), INF);
+        std::fill(used.begin(), used.end(), 0);
+        do {
+            used[j0] = 1;
+            int i0 = p[j0], j1 = 0;
+            double delta = INF;
+            for (int j = 1; j <= cols; ++j) {
+                if (used[j]) continue;
+                double cur = cost[(size_t)(i0 - 1) * cols + (j - 1)] - u[i0] - v[j];
+                if (cur < minv[j]) { minv[j] = cur; way[j] = j0; }
+                if (minv[j] < delta) { delta = minv[j]; j1 = j; }
+            }
+            for (int j = 0; j <= cols; ++j) {
+                if (used[j]) { u[p[j]] += delta; v[j] -= delta; }
+                else minv[j] -= delta;
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+        do {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0);
+    }
+    rowCol.assign(rows, -1);
+    for (int j = 1; j <= cols; ++j) if (p[j]) rowCol[p[j] - 1] = j - 1;
+}
+
+// Every miner gets its own rock when there are enough, chosen to minimise the
+// total squared walking distance. With more miners than rocks each rock gets
+// one miner that way and the rest share their nearest rock.
+static void solveRocks(Game &game) {
+    RockAssignments &ra = game.rockAssign;
+    const std::vector<Unit> &units = game.units;
+    const EntityPool<Rock> &rocks = game.rocks;
+    ra.unitRock.assign(units.size(), EntityId{});
+    ra.holders.assign(rocks.slots.slotCount(), 0);
+    ra.dirty = false;
+
+    std::vector<int> miners;
+    for (int ui = 0; ui < (int)units.size(); ++ui) if (!UNIT_TRAITS[units[ui].type].heals) miners.push_back(ui);
+    int live = rocks.size();
+    if (miners.empty() || live == 0) return;
+
+    bool byUnit = (int)miners.size() <= live;
+    int rows = byUnit ? (int)miners.size() : live;
+    int cols = byUnit ? live : (int)miners.size();
+    std::vector<double> cost((size_t)rows * cols);
+    for (int a = 0; a < rows; ++a) {
+        for (int b = 0; b < cols; ++b) {
+            const Unit &u = units[byUnit ? miners[a] : miners[b]];
+            const Rock &r = rocks[byUnit ? b : a];
+            cost[(size_t)a * cols + b] = rockDist2(r, unitCenterX(u), unitCenterY(u));
+        }
+    }
+    std::vector<int> rowCol;
+    solveAssignment(rows, cols, cost, rowCol);
+    auto hold = [&](int ui, int ri) {
+        ra.unitRock[ui] = rocks.idAt(ri);
+        ra.holders[rocks.slots.slotOf[ri]]++;
+    };
+    for (int a = 0; a < rows; ++a) hold(byUnit ? miners[a] : miners[rowCol[a]], byUnit ? rowCol[a] : a);
+    for (int ui : miners) {
+        if (ra.unitRock[ui].valid()) continue;
+        int ri = nearestRock(game, unitCenterX(units[ui]), unitCenterY(units[ui]), false);
+        if (ri >= 0) hold(ui, ri);
+    }
+}
+
+int assignedRock(Game &game, int unit) {
+    RockAssignments &ra = game.rockAssign;
+    if (unit < 0 || unit >= (int)game.units.size() || UNIT_TRAITS[game.units[unit].type].heals) return -1;
+    refreshRockGrid(game);
+    const EntityPool<Rock> &rocks = game.rocks;
+    if (ra.dirty || ra.unitRock.size() != game.units.size() || (int)ra.holders.size() != rocks.slots.slotCount()) solveRocks(game);
+
+    EntityId id = ra.unitRock[unit];
+    int ri = rocks.find(id);
+    if (ri >= 0 && rocks[ri].alive) return ri;
+    if (ra.exhausted) return -1;
+
+    // The unit's rock died: move it to the nearest rock nobody else is on, or
+    // share the nearest one if every rock is taken.
+    if (id.valid()) ra.holders[id.slot()]--;
+    const Unit &u = game.units[unit];
+    ri = nearestRock(game, unitCenterX(u), unitCenterY(u), true);
+    if (ri < 0) ri = nearestRock(game, unitCenterX(u), unitCenterY(u), false);
+    if (ri < 0) ra.exhausted = true;
+    ra.unitRock[unit] = ri >= 0 ? rocks.idAt(ri) : EntityId{};
+    if (ri >= 0) ra.holders[rocks.slots.slotOf[ri]]++;
+    return ri;
+}
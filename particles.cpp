@@ -0,0 +1,112 @@
+#include "particles.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLE_KERNEL_SSE2 1
+#endif
+
+static const EmitterPreset presets[PFX_PRESET_COUNT] = {
+    // PFX_ENEMY_DEATH: red spray, one spoke per particle
+    { 12, true, 0.25f, 80.0f, 200.0f, 0.8f, 1.2f, 3,
+      { Color{180, 20, 20, 255}, Color{220, 40, 40, 255}, Color{160, 10, 10, 255} } },
+    // PFX_ROCK_BREAK: dust in random directions
+    { 10, false, 0.0f, 60.0f, 160.0f, 0.6f, 1.1f, 1,
+      { Color{140, 120, 80, 255}, Color{140, 120, 80, 255}, Color{140, 120, 80, 255} } },
+};
+
+const EmitterPreset &emitterPreset(ParticlePreset preset) { return presets[preset]; }
+
+// Unit directions around the circle, so a burst never calls cosf/sinf.
+const int DIR_STEPS = 256;
+
+struct DirTable {
+    float c[DIR_STEPS], s[DIR_STEPS];
+    DirTable() {
+        for (int i = 0; i < DIR_STEPS; ++i) {
+            float a = (float)i / DIR_STEPS * 6.28318530718f;
+            c[i] = cosf(a); s[i] = sinf(a);
+        }
+    }
+};
+
+static const DirTable dirs;
+
+void ParticlePool::init(int cap) {
+    if (cap < 4) cap = 4;
+    capacity = cap;
+    // Padded to whole SSE lanes so the kernel never needs a scalar tail.
+    int padded = (cap + 3) & ~3;
+    x.assign(padded, 0.0f); y.assign(padded, 0.0f);
+    prevX.assign(padded, 0.0f); prevY.assign(padded, 0.0f);
+    vx.assign(padded, 0.0f); vy.assign(padded, 0.0f);
+    life.assign(padded, 0.0f); invMaxLife.assign(padded, 0.0f);
+    color.assign(padded, Color{0, 0, 0, 0});
+    clear();
+}
+
+void ParticlePool::emit(ParticlePreset preset, float px, float py, Rng &rng) {
+    if (capacity == 0) return;
+    const EmitterPreset &p = presets[preset];
+    const float jitterSteps = p.angleJitter / 6.28318530718f * DIR_STEPS;
+    for (int k = 0; k < p.count; ++k) {
+        int slot;
+        if (count < capacity) slot = count++;
+        else { slot = recycle; recycle = (recycle + 1) % capacity; }
+
+        int dir = p.evenSpread ? k * DIR_STEPS / p.count + (int)lroundf((rng.unit() * 2.0f - 1.0f) * jitterSteps)
+                               : (int)(rng.next() >> 24);
+        dir &= DIR_STEPS - 1;
+        float speed = rng.range(p.speedMin, p.speedMax);
+        float maxLife = rng.range(p.lifeMin, p.lifeMax);
+
+        x[slot] = px; y[slot] = py;
+        prevX[slot] = px; prevY[slot] = py;
+        vx[slot] = dirs.c[dir] * speed;
+        vy[slot] = dirs.s[dir] * speed;
+        life[slot] = maxLife;
+        invMaxLife[slot] = 1.0f / maxLife;
+        color[slot] = p.colorCount > 1 ? p.colors[rng.range(0, p.colorCount - 1)] : p.colors[0];
+    }
+}
+
+void ParticlePool::update(float dt) {
+    const float gravity = PARTICLE_GRAVITY * dt;
+#ifdef PARTICLE_KERNEL_SSE2
+    const __m128 vdt = _mm_set1_ps(dt), vg = _mm_set1_ps(gravity), vdrag = _mm_set1_ps(PARTICLE_DRAG);
+    for (int i = 0; i < count; i += 4) {
+        __m128 px = _mm_loadu_ps(&x[i]), py = _mm_loadu_ps(&y[i]);
+        __m128 pvx = _mm_loadu_ps(&vx[i]), pvy = _mm_loadu_ps(&vy[i]);
+        _mm_storeu_ps(&prevX[i], px);
+        _mm_storeu_ps(&prevY[i], py);
+        _mm_storeu_ps(&x[i], _mm_add_ps(px, _mm_mul_ps(pvx, vdt)));
+        _mm_storeu_ps(&y[i], _mm_add_ps(py, _mm_mul_ps(pvy, vdt)));
+        _mm_storeu_ps(&vy[i], _mm_add_ps(pvy, vg));
+        _mm_storeu_ps(&vx[i], _mm_mul_ps(pvx, vdrag));
+        _mm_storeu_ps(&life[i], _mm_sub_ps(_mm_loadu_ps(&life[i]), vdt));
+    }
+#else
+    for (int i = 0; i < count; ++i) {
+        prevX[i] = x[i]; prevY[i] = y[i];
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        vy[i] += gravity;
+        vx[i] *= PARTICLE_DRAG;
+        life[i] -= dt;
+    }
+#endif
+
+    // Stable compaction: every particle is copied to the write cursor, which only
+    // advances past live ones. No branch on life, and spawn order is kept.
+    int w = 0;
+    for (int i = 0; i < count; ++i) {
+        x[w] = x[i]; y[w] = y[i];
+        prevX[w] = prevX[i]; prevY[w] = prevY[i];
+        vx[w] = vx[i]; vy[w] = vy[i];
+        life[w] = life[i]; invMaxLife[w] = invMaxLife[i];
+        color[w] = color[i];
+        w += life[i] > 0.0f;
+    }
+    count = w;
+    if (recycle >= count) recycle = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <raylib.h>
+#include <vector>
+#include "rng.h"
+
+enum ParticlePreset {
+    PFX_ENEMY_DEATH = 0,
+    PFX_ROCK_BREAK,
+    PFX_PRESET_COUNT
+};
+
+// What one burst looks like. Replaces the hand-written spawn loops.
+struct EmitterPreset {
+    int count;
+    bool evenSpread;        // one spoke per particle plus jitter, else fully random directions
+    float angleJitter;      // radians either side of the spoke
+    float speedMin, speedMax;
+    float lifeMin, lifeMax;
+    int colorCount;
+    Color colors[3];
+};
+
+const EmitterPreset &emitterPreset(ParticlePreset preset);
+
+const int DEFAULT_PARTICLE_CAPACITY = 4096;
+const float PARTICLE_GRAVITY = 300.0f;
+const float PARTICLE_DRAG = 0.98f;      // vx multiplier per tick
+
+// Fixed-capacity structure-of-arrays particle pool. Live particles are packed
+// into [0, count) in spawn order; a full pool recycles slots round-robin instead
+// of growing, so a mass wave clear costs the same as a busy frame. Cosmetic
+// only: nothing in here feeds back into gameplay.
+struct ParticlePool {
+    std::vector<float> x, y, prevX, prevY, vx, vy;
+    std::vector<float> life, invMaxLife;
+    std::vector<Color> color;
+    int count = 0;
+    int capacity = 0;
+    int recycle = 0;        // next slot to overwrite once full
+
+    // Allocates every array up front; also empties the pool.
+    void init(int capacity);
+    void clear() { count = 0; recycle = 0; }
+    void emit(ParticlePreset preset, float px, float py, Rng &rng);
+    // Integrates every live particle, then packs out the expired ones.
+    void update(float dt);
+};
+
+#endif
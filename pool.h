@@ -0,0 +1,126 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// Stable reference to a pooled entity: slot in the low ENTITY_SLOT_BITS, the
+// slot's generation when the handle was made in the rest. Once the entity dies
+// its slot's generation moves on and the handle stops resolving, even after the
+// slot is reused. The default (0) never resolves.
+struct EntityId {
+    uint32_t bits = 0;
+
+    bool valid() const { return bits != 0; }
+    int slot() const;
+    bool operator==(EntityId o) const { return bits == o.bits; }
+    bool operator!=(EntityId o) const { return bits != o.bits; }
+};
+
+const int ENTITY_SLOT_BITS = 20;
+const uint32_t ENTITY_SLOT_MASK = (1u << ENTITY_SLOT_BITS) - 1;
+const uint32_t ENTITY_MAX_GENERATION = (1u << (32 - ENTITY_SLOT_BITS)) - 1;
+
+inline int EntityId::slot() const { return (int)(bits & ENTITY_SLOT_MASK); }
+
+// Handle bookkeeping for storage that keeps its live entries packed at
+// [0, size). Slots come from a LIFO free list, so spawning never searches.
+// Entries die in place (the owner flags them) and compact() squeezes them out
+// in one stable pass, keeping the survivors in spawn order.
+struct SlotTable {
+    std::vector<uint16_t> generation;   // per slot, 1..ENTITY_MAX_GENERATION
+    std::vector<int> denseOf;           // per slot, index into the storage or -1 when free
+    std::vector<int> slotOf;            // per storage index
+    std::vector<int> freeSlots;
+
+    int slotCount() const { return (int)generation.size(); }
+
+    // Handle for the entry the owner just appended at index slotOf.size().
+    EntityId insert() {
+        int slot;
+        if (!freeSlots.empty()) { slot = freeSlots.back(); freeSlots.pop_back(); }
+        else { slot = slotCount(); generation.push_back(1); denseOf.push_back(-1); }
+        denseOf[slot] = (int)slotOf.size();
+        slotOf.push_back(slot);
+        return EntityId{ (uint32_t)generation[slot] << ENTITY_SLOT_BITS | (uint32_t)slot };
+    }
+
+    // Storage index of id, or -1 if it is stale or was never valid.
+    int find(EntityId id) const {
+        int slot = id.slot();
+        if (!id.valid() || slot >= slotCount()) return -1;
+        if (generation[slot] != id.bits >> ENTITY_SLOT_BITS) return -1;
+        return denseOf[slot];
+    }
+
+    EntityId idAt(int index) const {
+        int slot = slotOf[index];
+        return EntityId{ (uint32_t)generation[slot] << ENTITY_SLOT_BITS | (uint32_t)slot };
+    }
+
+    // Keeps the entries [0, count) for which dead(i) is false, in order, calling
+    // move(from, to) for each one that shifts down. Returns the new count; the
+    // owner truncates its storage to it.
+    template <typename Dead, typename Move>
+    int compact(int count, Dead dead, Move move) {
+        int w = 0;
+        for (int r = 0; r < count; ++r) {
+            if (dead(r)) { release(slotOf[r]); continue; }
+            if (w != r) { move(r, w); slotOf[w] = slotOf[r]; denseOf[slotOf[w]] = w; }
+            w++;
+        }
+        slotOf.resize(w);
+        return w;
+    }
+
+    // Every handle goes stale; slots are handed out again lowest first.
+    void clear() {
+        for (int s = 0; s < slotCount(); ++s) if (denseOf[s] >= 0) bump(s);
+        freeSlots.clear();
+        for (int s = slotCount() - 1; s >= 0; --s) freeSlots.push_back(s);
+        slotOf.clear();
+    }
+
+    void reserve(int n) { generation.reserve(n); denseOf.reserve(n); slotOf.reserve(n); }
+
+private:
+    void bump(int slot) {
+        generation[slot] = (uint16_t)(generation[slot] % ENTITY_MAX_GENERATION + 1);
+        denseOf[slot] = -1;
+    }
+    void release(int slot) { bump(slot); freeSlots.push_back(slot); }
+};
+
+// Array-of-structs storage on a SlotTable. Indexing and range-for see only the
+// packed entries, so loops run over live entities (plus any flagged dead since
+// the last compact).
+template <typename T>
+struct EntityPool {
+    std::vector<T> items;
+    SlotTable slots;
+
+    int size() const { return (int)items.size(); }
+    bool empty() const { return items.empty(); }
+    T &operator[](int i) { return items[i]; }
+    const T &operator[](int i) const { return items[i]; }
+    typename std::vector<T>::iterator begin() { return items.begin(); }
+    typename std::vector<T>::iterator end() { return items.end(); }
+    typename std::vector<T>::const_iterator begin() const { return items.begin(); }
+    typename std::vector<T>::const_iterator end() const { return items.end(); }
+
+    EntityId add(const T &v) { items.push_back(v); return slots.insert(); }
+    int find(EntityId id) const { return slots.find(id); }
+    EntityId idAt(int i) const { return slots.idAt(i); }
+
+    template <typename Dead>
+    void compact(Dead dead) {
+        int n = slots.compact(size(), [&](int i) { return dead(items[i]); },
+                              [&](int from, int to) { items[to] = std::move(items[from]); });
+        items.erase(items.begin() + n, items.end());
+    }
+    void clear() { items.clear(); slots.clear(); }
+    void reserve(int n) { items.reserve(n); slots.reserve(n); }
+};
+
+#endif
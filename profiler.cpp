@@ -0,0 +1,71 @@
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+Profiler gProfiler;
+
+static const std::chrono::steady_clock::time_point profilerEpoch = std::chrono::steady_clock::now();
+
+uint64_t profilerNowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profilerEpoch).count();
+}
+
+const char *profileZoneName(int zone) {
+    static const char *names[PZ_COUNT] = {
+        "input", "sim", "intermission", "unit_ai", "healers", "enemy_ai",
+        "crowd", "bullets", "particles", "world_render", "hud_render"
+    };
+    return (zone >= 0 && zone < PZ_COUNT) ? names[zone] : "?";
+}
+
+void Profiler::endFrame() {
+    for (int z = 0; z < PZ_COUNT; ++z) {
+        historyMs[z][historyPos] = (float)(frameNs[z] / 1e6);
+        frameNs[z] = 0;
+    }
+    historyPos = (historyPos + 1) % PROFILE_HISTORY;
+    if (historyCount < PROFILE_HISTORY) historyCount++;
+}
+
+float Profiler::averageMs(int zone) const {
+    if (historyCount == 0) return 0.0f;
+    float sum = 0.0f;
+    for (int i = 0; i < historyCount; ++i) sum += historyMs[zone][i];
+    return sum / (float)historyCount;
+}
+
+float Profiler::peakMs(int zone) const {
+    float peak = 0.0f;
+    for (int i = 0; i < historyCount; ++i) if (historyMs[zone][i] > peak) peak = historyMs[zone][i];
+    return peak;
+}
+
+void Profiler::startCapture() {
+    events.clear();
+    droppedEvents = 0;
+    capturing = true;
+    enabled = true;
+}
+
+bool Profiler::writeTrace(const char *path) const {
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"game\"}}");
+    for (const TraceEvent &e : events) {
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                profileZoneName(e.zone), e.startNs / 1000.0, e.durNs / 1000.0);
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+void StartupTimeline::print() const {
+    std::vector<StartupStep> sorted = steps;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const StartupStep &a, const StartupStep &b) { return a.startNs < b.startNs; });
+    printf("%-20s %9s %9s %9s\n", "startup (ms)", "start", "end", "length");
+    for (const StartupStep &s : sorted) {
+        printf("%-20s %9.2f %9.2f %9.2f\n", s.name, s.startNs / 1e6, s.endNs / 1e6, (s.endNs - s.startNs) / 1e6);
+    }
+}
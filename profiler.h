@@ -0,0 +1,125 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum ProfileZone {
+    PZ_INPUT = 0,
+    PZ_SIM,             // all ticks run this frame; the zones below nest inside it
+    PZ_INTERMISSION,
+    PZ_UNIT_AI,
+    PZ_HEALERS,
+    PZ_ENEMY_AI,        // includes the aliens' separation pass
+    PZ_CROWD,           // the units' separation pass
+    PZ_BULLETS,
+    PZ_PARTICLES,
+    PZ_WORLD_RENDER,
+    PZ_HUD_RENDER,
+    PZ_COUNT
+};
+
+const int PROFILE_HISTORY = 120;   // frames in the rolling window
+
+struct TraceEvent {
+    uint8_t zone;
+    uint64_t startNs;
+    uint64_t durNs;
+};
+
+// Per-zone frame timings plus an optional event capture for chrome://tracing.
+// When neither the overlay nor a capture wants data, every zone costs one
+// predictable branch.
+struct Profiler {
+    bool enabled = false;
+    bool capturing = false;
+
+    uint64_t frameNs[PZ_COUNT] = {};
+    float historyMs[PZ_COUNT][PROFILE_HISTORY] = {};
+    int historyPos = 0;
+    int historyCount = 0;
+
+    uint64_t totalNs[PZ_COUNT] = {};
+    uint64_t totalCalls[PZ_COUNT] = {};
+
+    std::vector<TraceEvent> events;
+    size_t maxEvents = 4000000;
+    size_t droppedEvents = 0;
+
+    void record(int zone, uint64_t startNs, uint64_t endNs) {
+        uint64_t dur = endNs - startNs;
+        frameNs[zone] += dur;
+        totalNs[zone] += dur;
+        totalCalls[zone]++;
+        if (capturing) {
+            if (events.size() < maxEvents) events.push_back(TraceEvent{ (uint8_t)zone, startNs, dur });
+            else droppedEvents++;
+        }
+    }
+
+    // Closes the current frame: pushes per-zone totals into the rolling window.
+    void endFrame();
+    float averageMs(int zone) const;
+    float peakMs(int zone) const;
+
+    void startCapture();
+    void stopCapture() { capturing = false; }
+    // Writes the captured events as Chrome trace-event JSON.
+    bool writeTrace(const char *path) const;
+};
+
+extern Profiler gProfiler;
+
+// Steps from launch to the first frame on screen, printed once that frame is
+// up so a slower startup shows which step grew. Times are profilerNowNs(),
+// which counts from launch. Steps can overlap: the sprites decode on a worker
+// while the window opens.
+struct StartupStep {
+    const char *name;
+    uint64_t startNs, endNs;
+};
+
+struct StartupTimeline {
+    std::vector<StartupStep> steps;
+
+    void add(const char *name, uint64_t startNs, uint64_t endNs) { steps.push_back(StartupStep{ name, startNs, endNs }); }
+    // One line per step, by start time: start, end and length in ms.
+    void print() const;
+};
+
+uint64_t profilerNowNs();
+const char *profileZoneName(int zone);
+
+#ifndef PROFILER_DISABLED
+// Times from construction (or the last next()) to destruction (or the next
+// next()). next() lets one scope walk through consecutive phases of a function.
+struct ProfileScope {
+    int zone = -1;
+    uint64_t start = 0;
+
+    explicit ProfileScope(ProfileZone z) { if (gProfiler.enabled) { zone = z; start = profilerNowNs(); } }
+    ~ProfileScope() { if (zone >= 0) gProfiler.record(zone, start, profilerNowNs()); }
+    void next(ProfileZone z) {
+        if (zone < 0 && !gProfiler.enabled) return;
+        uint64_t now = profilerNowNs();
+        if (zone >= 0) gProfiler.record(zone, start, now);
+        zone = gProfiler.enabled ? (int)z : -1;
+        start = now;
+    }
+    void stop() {
+        if (zone >= 0) gProfiler.record(zone, start, profilerNowNs());
+        zone = -1;
+    }
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
+#else
+struct ProfileScope {
+    explicit ProfileScope(ProfileZone) {}
+    void next(ProfileZone) {}
+    void stop() {}
+};
+#endif
+
+#endif
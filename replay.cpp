@@ -0,0 +1,154 @@
+#include "replay.h"
+#include <cstdio>
+#include <cstring>
+
+static const char REPLAY_MAGIC[4] = { 'S', 'C', 'R', 'P' };
+// 2 made CMD_ATTACK's arg an EntityId instead of an enemy index. Version 1
+// files still load, but not with attack orders: an old index would never
+// find its enemy, and the replay would quietly play another game. 3 added
+// armySize and 4 archetypesHash; older files load with the default army and
+// no hash.
+static const uint64_t REPLAY_VERSION = 4;
+static const uint64_t FLAG_INVULNERABLE = 1;
+
+static void putVarint(std::vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) { out.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+    out.push_back((uint8_t)v);
+}
+
+static void putSigned(std::vector<uint8_t> &out, int64_t v) {
+    putVarint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+struct Reader {
+    const uint8_t *p, *end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) { ok = false; return 0; }
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+    int64_t svarint() {
+        uint64_t v = varint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+};
+
+static bool hasUnits(CommandType t) {
+    return t == CMD_SELECT || t == CMD_MOVE || t == CMD_ATTACK || t == CMD_AREA_ATTACK;
+}
+
+bool saveRecording(const char *path, const Recording &rec) {
+    std::vector<uint8_t> out(REPLAY_MAGIC, REPLAY_MAGIC + 4);
+    putVarint(out, REPLAY_VERSION);
+    putVarint(out, rec.seed);
+    putVarint(out, (uint64_t)rec.difficulty);
+    putVarint(out, (uint64_t)rec.tickRate);
+    putVarint(out, rec.invulnerable ? FLAG_INVULNERABLE : 0);
+    putVarint(out, (uint64_t)rec.armySize);
+    putVarint(out, rec.archetypesHash);
+    putVarint(out, rec.endTick);
+    putVarint(out, rec.commands.size());
+
+    uint32_t lastTick = 0;
+    for (const Command &c : rec.commands) {
+        putVarint(out, c.tick - lastTick);
+        lastTick = c.tick;
+        out.push_back((uint8_t)c.type);
+        if (hasUnits(c.type)) {
+            putVarint(out, c.units.size());
+            int prev = 0;
+            for (int u : c.units) { putSigned(out, u - prev); prev = u; }
+        }
+        switch (c.type) {
+            case CMD_MOVE: putSigned(out, c.x); putSigned(out, c.y); break;
+            case CMD_AREA_ATTACK: putSigned(out, c.x); putSigned(out, c.y); putVarint(out, (uint64_t)c.w); putVarint(out, (uint64_t)c.h); break;
+            case CMD_ATTACK: case CMD_UPGRADE: case CMD_TIME_SCALE: putVarint(out, (uint32_t)c.arg); break;
+            default: break;
+        }
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    return fclose(f) == 0 && ok;
+}
+
+bool loadRecording(const char *path, Recording &rec, std::string &error) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { error = "cannot open file"; return false; }
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    if (data.size() < 4 || memcmp(data.data(), REPLAY_MAGIC, 4) != 0) { error = "not a replay file"; return false; }
+    Reader r{ data.data() + 4, data.data() + data.size() };
+    uint64_t version = r.varint();
+    if (version < 1 || version > REPLAY_VERSION) { error = "unsupported replay version"; return false; }
+    rec = Recording{};
+    rec.seed = r.varint();
+    uint64_t diff = r.varint();
+    rec.tickRate = (int)r.varint();
+    rec.invulnerable = (r.varint() & FLAG_INVULNERABLE) != 0;
+    uint64_t army = version >= 3 ? r.varint() : UNIT_COUNT;
+    rec.archetypesHash = version >= 4 ? r.varint() : 0;
+    rec.endTick = (uint32_t)r.varint();
+    uint64_t count = r.varint();
+    if (!r.ok || diff > DIFF_HARD || rec.tickRate < 10 || rec.tickRate > 1000 || army < 1 || army > MAX_ARMY_SIZE ||
+        count > data.size()) {
+        error = "corrupt header";
+        return false;
+    }
+    rec.difficulty = (Difficulty)diff;
+    rec.armySize = (int)army;
+
+    rec.commands.resize((size_t)count);
+    uint32_t tick = 0;
+    for (Command &c : rec.commands) {
+        tick += (uint32_t)r.varint();
+        c.tick = tick;
+        if (r.p >= r.end) { r.ok = false; break; }
+        uint8_t type = *r.p++;
+        if (type >= CMD_TYPE_COUNT) { r.ok = false; break; }
+        c.type = (CommandType)type;
+        if (hasUnits(c.type)) {
+            uint64_t units = r.varint();
+            if (units > (uint64_t)(r.end - r.p)) { r.ok = false; break; }
+            c.units.resize((size_t)units);
+            int prev = 0;
+            for (int &u : c.units) { u = prev + (int)r.svarint(); prev = u; }
+        }
+        switch (c.type) {
+            case CMD_MOVE: c.x = (int)r.svarint(); c.y = (int)r.svarint(); break;
+            case CMD_AREA_ATTACK: c.x = (int)r.svarint(); c.y = (int)r.svarint(); c.w = (int)r.varint(); c.h = (int)r.varint(); break;
+            case CMD_ATTACK: case CMD_UPGRADE: case CMD_TIME_SCALE: c.arg = (int)(uint32_t)r.varint(); break;
+            default: break;
+        }
+        if (!r.ok) break;
+        if (c.type == CMD_ATTACK && version < 2) {
+            error = "attack orders in a version 1 replay are enemy indices, which this build cannot play back";
+            return false;
+        }
+    }
+    if (!r.ok) { error = "truncated or corrupt command stream"; return false; }
+    return true;
+}
+
+int ReplayCursor::applyDue(Game &game) {
+    int timeScale = 0;
+    while (next < rec->commands.size() && rec->commands[next].tick <= game.tick) {
+        const Command &c = rec->commands[next++];
+        if (c.type == CMD_TIME_SCALE) timeScale = c.arg;
+        else applyCommand(game, c);
+    }
+    return timeScale;
+}
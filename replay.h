@@ -0,0 +1,41 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "game.h"
+
+// A recorded session: everything needed to rebuild the run from startNewGame
+// plus the player's commands in tick order.
+struct Recording {
+    uint64_t seed = 0;
+    Difficulty difficulty = DIFF_NORMAL;
+    int tickRate = SIM_TICK_RATE;
+    bool invulnerable = false;
+    int armySize = UNIT_COUNT;
+    uint64_t archetypesHash = 0;   // of the stats it ran with; 0 if not recorded
+    uint32_t endTick = 0;          // game.tick when recording stopped
+    std::vector<Command> commands;
+};
+
+// File layout, all integers LEB128 varints (zigzag for signed values):
+//   "SCRP" version seed difficulty tickRate flags armySize archetypesHash endTick commandCount
+//   per command: tickDelta type payload
+// where tickDelta is relative to the previous command and unit lists are a
+// count followed by zigzag deltas between consecutive indices.
+bool saveRecording(const char *path, const Recording &rec);
+bool loadRecording(const char *path, Recording &rec, std::string &error);
+
+// Feeds a recording back one tick at a time.
+struct ReplayCursor {
+    const Recording *rec = nullptr;
+    size_t next = 0;
+
+    // Applies every command stamped with the game's current tick. Returns the
+    // last CMD_TIME_SCALE value seen, or 0 if there was none.
+    int applyDue(Game &game);
+    bool finished(const Game &game) const { return game.tick >= rec->endTick; }
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "rewind.h"
+#include <string>
+#include "snapshot.h"
+
+size_t RewindBuffer::Keyframe::bytes() const {
+    size_t n = sizeof(Keyframe) + data.capacity() + commands.capacity() * sizeof(Command);
+    for (const Command &c : commands) n += c.units.capacity() * sizeof(int);
+    return n;
+}
+
+void RewindBuffer::reset(const Game &game) {
+    frames.clear();
+    used = 0;
+    sinceWhole = 0;
+    head = game.tick;
+    take(game);
+}
+
+void RewindBuffer::take(const Game &game) {
+    writeSnapshot(game, scratch);
+    frames.emplace_back();
+    Keyframe &k = frames.back();
+    k.tick = game.tick;
+    k.whole = frames.size() == 1 || sinceWhole + 1 >= anchorEvery;
+    if (k.whole) {
+        k.data = scratch;
+        sinceWhole = 0;
+    } else {
+        diffSnapshots(latest, scratch, k.data);
+        k.data.shrink_to_fit();
+        sinceWhole++;
+    }
+    latest.swap(scratch);
+    used += k.bytes();
+    evict();
+}
+
+void RewindBuffer::command(const Game &game, const Command &c) {
+    if (frames.empty()) return;
+    dropAhead(game.tick);
+    Keyframe &k = frames.back();
+    used -= k.bytes();
+    k.commands.push_back(c);
+    used += k.bytes();
+}
+
+void RewindBuffer::afterTick(const Game &game) {
+    if (frames.empty()) return;
+    dropAhead(game.tick - 1);
+    head = game.tick;
+    if (game.tick - frames.back().tick >= (uint32_t)keyframeInterval) take(game);
+}
+
+// Forgets everything from tick on: later keyframes, and commands at or after
+// tick, which were not applied this time round.
+void RewindBuffer::dropAhead(uint32_t tick) {
+    if (tick >= head) return;
+    head = tick;
+    bool popped = false;
+    while (frames.size() > 1 && frames.back().tick > tick) {
+        used -= frames.back().bytes();
+        frames.pop_back();
+        popped = true;
+    }
+    Keyframe &k = frames.back();
+    used -= k.bytes();
+    while (!k.commands.empty() && k.commands.back().tick >= tick) k.commands.pop_back();
+    used += k.bytes();
+    if (popped) {
+        rebuild(frames.size() - 1, latest);
+        recount();
+    }
+}
+
+// The snapshot keyframe index was taken from, from the whole one before it.
+void RewindBuffer::rebuild(size_t index, std::vector<char> &out) const {
+    size_t i = index;
+    while (!frames[i].whole) --i;
+    out = frames[i].data;
+    std::vector<char> next;
+    for (++i; i <= index; ++i) {
+        applySnapshotDelta(out, frames[i].data, next);
+        out.swap(next);
+    }
+}
+
+void RewindBuffer::evict() {
+    while (frames.size() > 1 && bytes() > budgetBytes) {
+        // The new oldest keyframe has nothing left to be a delta from.
+        Keyframe &next = frames[1];
+        if (!next.whole) {
+            used -= next.bytes();
+            std::vector<char> whole;
+            rebuild(1, whole);
+            next.data.swap(whole);
+            next.whole = true;
+            used += next.bytes();
+        }
+        used -= frames.front().bytes();
+        frames.pop_front();
+        recount();
+    }
+}
+
+void RewindBuffer::recount() {
+    sinceWhole = 0;
+    for (size_t i = frames.size() - 1; !frames[i].whole; --i) sinceWhole++;
+}
+
+bool RewindBuffer::seek(Game &game, uint32_t tick, float dt) {
+    if (frames.empty() || tick < oldestTick() || tick > head) return false;
+    size_t index = frames.size() - 1;
+    while (frames[index].tick > tick) --index;
+    const Keyframe &k = frames[index];
+    std::vector<char> state;
+    rebuild(index, state);
+    std::string error;
+    if (!readSnapshot(state.data(), state.size(), game, error)) return false;
+    size_t next = 0;
+    while (game.tick < tick) {
+        while (next < k.commands.size() && k.commands[next].tick <= game.tick) applyCommand(game, k.commands[next++]);
+        updateGame(game, dt);
+    }
+    return true;
+}
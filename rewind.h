@@ -0,0 +1,64 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "game.h"
+
+// The last few minutes of a game, for scrubbing back to the tick where
+// something went wrong. Every keyframeInterval ticks the whole state is kept
+// as an in-memory snapshot (snapshot.h), stored as the words that changed
+// since the keyframe before it, with every anchorEvery'th one kept whole; the
+// commands applied in between are kept with it. Seeking restores the keyframe
+// at or before the target and steps the simulation forward to it, which gives
+// the exact state since stepping is deterministic, so a seek costs at most one
+// keyframe interval of ticks on top of rebuilding the keyframe. The oldest
+// keyframes go once the whole buffer passes budgetBytes.
+struct RewindBuffer {
+    size_t budgetBytes = 64u << 20;
+    int keyframeInterval = 60;      // ticks; bounds the stepping a seek does
+    int anchorEvery = 16;           // bounds the deltas a seek applies
+
+    // Starts over from the game as it is now, e.g. just after startNewGame.
+    void reset(const Game &game);
+    // Call with each command just before applyCommand, and after each tick.
+    // Either one first drops whatever was ahead of the game, so playing on
+    // from a seek replaces the old future.
+    void command(const Game &game, const Command &c);
+    void afterTick(const Game &game);
+
+    // Puts the game at tick, stepping dt per tick. Fails, leaving the game
+    // alone, outside [oldestTick(), newestTick()].
+    bool seek(Game &game, uint32_t tick, float dt);
+
+    bool empty() const { return frames.empty(); }
+    uint32_t oldestTick() const { return frames.empty() ? 0 : frames.front().tick; }
+    uint32_t newestTick() const { return head; }
+    size_t bytes() const { return used + latest.capacity() + scratch.capacity(); }
+    int keyframes() const { return (int)frames.size(); }
+
+private:
+    struct Keyframe {
+        uint32_t tick;
+        bool whole;                     // data is a snapshot, else a delta from the keyframe before
+        std::vector<char> data;
+        std::vector<Command> commands;  // applied from tick up to the next keyframe, in order
+        size_t bytes() const;
+    };
+    std::deque<Keyframe> frames;
+    std::vector<char> latest;   // the newest keyframe whole, to diff the next one against
+    std::vector<char> scratch;
+    uint32_t head = 0;          // furthest tick recorded
+    size_t used = 0;
+    int sinceWhole = 0;
+
+    void take(const Game &game);
+    void dropAhead(uint32_t tick);
+    void rebuild(size_t index, std::vector<char> &out) const;
+    void evict();
+    void recount();
+};
+
+#endif
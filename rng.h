@@ -0,0 +1,51 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// PCG32 (XSH-RR). Each subsystem owns its own stream, so how many numbers one of
+// them draws never shifts what another one sees. Same seed, same sequence, on
+// every platform.
+struct Rng {
+    uint64_t state = 0x853c49e6748fea9bULL;
+    uint64_t inc = 0xda3e39cb94b95bdbULL;
+
+    void seed(uint64_t seed, uint64_t stream) {
+        state = 0u;
+        inc = (stream << 1u) | 1u;
+        next();
+        state += seed;
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = (uint32_t)(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+    }
+
+    // Uniform int in [lo, hi], inclusive like GetRandomValue.
+    int range(int lo, int hi) {
+        if (hi <= lo) return lo;
+        uint32_t span = (uint32_t)(hi - lo) + 1u;
+        uint32_t threshold = (0u - span) % span;
+        for (;;) {
+            uint32_t r = next();
+            if (r >= threshold) return lo + (int)(r % span);
+        }
+    }
+
+    // Uniform float in [0, 1).
+    float unit() { return (float)(next() >> 8) * (1.0f / 16777216.0f); }
+    float range(float lo, float hi) { return lo + (hi - lo) * unit(); }
+};
+
+enum RngStream {
+    RNG_SPAWN = 1,      // wave composition and placement, rocks
+    RNG_LOOT = 2,       // scrap drops
+    RNG_PARTICLES = 3   // cosmetic only, never feeds back into gameplay
+};
+
+#endif
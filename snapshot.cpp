@@ -0,0 +1,397 @@
+#include "snapshot.h"
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <type_traits>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char SNAPSHOT_MAGIC[4] = { 'S', 'C', 'S', 'N' };
+static const uint32_t SNAPSHOT_VERSION = 3;
+static const uint64_t SNAPSHOT_ALIGN = 16;
+
+struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint32_t reserved;
+    uint64_t fileSize;
+};
+
+struct SnapshotSection {
+    uint32_t elemSize;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t offset;
+};
+
+// Everything that is not an array, in one section.
+struct SnapshotScalars {
+    uint64_t seed;
+    Rng spawnRng, lootRng, particleRng;
+    Archetypes archetypes;
+    Ship playerShip;
+    UpgradeShop shop;
+    int32_t difficulty, currentWave, enemiesAlive, armySize;
+    int32_t unitTypeStart[UNIT_TYPE_COUNT + 1];
+    int32_t crowdPhase;
+    uint32_t tick;
+    float intermissionTime;
+    uint8_t inIntermission, shipInvulnerable, rockAssignDirty, rockAssignExhausted;
+};
+static_assert(std::is_trivially_copyable<SnapshotScalars>::value, "snapshot scalars are copied as bytes");
+
+// An area order without its target list, which goes in a section of its own.
+struct SnapshotAreaOrder {
+    Rectangle rect;
+    int32_t users;
+    uint32_t firstTarget, targetCount;
+};
+
+static bool littleEndian() {
+    uint16_t probe = 1;
+    uint8_t low;
+    memcpy(&low, &probe, 1);
+    return low == 1;
+}
+
+// The per-enemy columns of an EnemyStore; every one is as long as x.
+template <typename S, typename Visit>
+static void visitEnemyColumns(S &es, Visit &&v) {
+    v(es.x); v(es.y); v(es.moveSpeed); v(es.timeSinceLastAttack); v(es.attackCooldown); v(es.attackRange);
+    v(es.detectionRange); v(es.shipDetectionRange); v(es.avoidUnitsRange);
+    v(es.crowdRadius); v(es.crowdWeight); v(es.crowdPushX); v(es.crowdPushY); v(es.crowdBlock);
+    v(es.alive); v(es.type); v(es.hp); v(es.maxHp); v(es.showHp); v(es.attackDamage); v(es.prevX); v(es.prevY);
+}
+
+template <typename T, typename Visit>
+static void visitSlots(T &slots, Visit &&v) {
+    v(slots.generation); v(slots.denseOf); v(slots.slotOf); v(slots.freeSlots);
+}
+
+// Every array in a snapshot, in file order; the saver and the loader both walk
+// this list, so they cannot disagree on it. G is Game or const Game.
+template <typename G, typename Visit>
+static void visitArrays(G &game, Visit &&v) {
+    v(game.units);
+    visitEnemyColumns(game.enemies, v);
+    visitSlots(game.enemies.slots, v);
+    v(game.bullets.items);
+    visitSlots(game.bullets.slots, v);
+    v(game.rocks.items);
+    visitSlots(game.rocks.slots, v);
+    v(game.rockAssign.unitRock); v(game.rockAssign.holders);
+    v(game.claims.count); v(game.claims.unitClaim);
+}
+
+void writeSnapshot(const Game &game, std::vector<char> &out) {
+    SnapshotScalars s;
+    memset((void *)&s, 0, sizeof(s));   // padding too, so equal states write equal files
+    s.seed = game.seed;
+    s.spawnRng = game.spawnRng; s.lootRng = game.lootRng; s.particleRng = game.particleRng;
+    s.archetypes = game.archetypes;
+    s.playerShip = game.playerShip;
+    s.shop = game.shop;
+    s.difficulty = game.difficulty; s.currentWave = game.currentWave; s.enemiesAlive = game.enemiesAlive;
+    s.armySize = game.armySize;
+    for (int t = 0; t <= UNIT_TYPE_COUNT; ++t) s.unitTypeStart[t] = game.unitTypeStart[t];
+    s.crowdPhase = game.enemies.crowdPhase;
+    s.tick = game.tick;
+    s.intermissionTime = game.intermissionTime;
+    s.inIntermission = game.inIntermission; s.shipInvulnerable = game.shipInvulnerable;
+    s.rockAssignDirty = game.rockAssign.dirty; s.rockAssignExhausted = game.rockAssign.exhausted;
+
+    std::vector<SnapshotAreaOrder> orders;
+    std::vector<EntityId> targets;
+    for (const AreaOrder &o : game.areaOrders) {
+        orders.push_back(SnapshotAreaOrder{ o.rect, o.users, (uint32_t)targets.size(), (uint32_t)o.targets.size() });
+        targets.insert(targets.end(), o.targets.begin(), o.targets.end());
+    }
+
+    // Where each section's bytes come from, in file order.
+    struct Chunk { const void *data; uint32_t elemSize; uint64_t count; };
+    std::vector<Chunk> chunks;
+    chunks.push_back(Chunk{ &s, (uint32_t)sizeof(s), 1 });
+    visitArrays(game, [&](const auto &vec) {
+        typedef typename std::decay<decltype(vec)>::type::value_type T;
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot arrays are copied as bytes");
+        chunks.push_back(Chunk{ vec.data(), (uint32_t)sizeof(T), vec.size() });
+    });
+    chunks.push_back(Chunk{ orders.data(), (uint32_t)sizeof(SnapshotAreaOrder), orders.size() });
+    chunks.push_back(Chunk{ targets.data(), (uint32_t)sizeof(EntityId), targets.size() });
+
+    auto align = [](uint64_t n) { return (n + SNAPSHOT_ALIGN - 1) & ~(SNAPSHOT_ALIGN - 1); };
+    std::vector<SnapshotSection> table(chunks.size());
+    uint64_t at = align(sizeof(SnapshotHeader) + sizeof(SnapshotSection) * table.size());
+    for (size_t k = 0; k < chunks.size(); ++k) {
+        table[k] = SnapshotSection{ chunks[k].elemSize, 0, chunks[k].count, at };
+        at = align(at + chunks[k].elemSize * chunks[k].count);
+    }
+    SnapshotHeader h;
+    memcpy(h.magic, SNAPSHOT_MAGIC, 4);
+    h.version = SNAPSHOT_VERSION;
+    h.sectionCount = (uint32_t)table.size();
+    h.reserved = 0;
+    h.fileSize = at;
+
+    out.assign((size_t)at, 0);
+    memcpy(out.data(), &h, sizeof(h));
+    memcpy(out.data() + sizeof(h), table.data(), sizeof(SnapshotSection) * table.size());
+    for (size_t k = 0; k < chunks.size(); ++k) {
+        if (chunks[k].count) memcpy(out.data() + table[k].offset, chunks[k].data, (size_t)(chunks[k].elemSize * chunks[k].count));
+    }
+}
+
+bool saveSnapshot(const char *path, const Game &game, std::string &error) {
+    if (!littleEndian()) { error = "snapshots are little-endian only"; return false; }
+    // One buffer, one write.
+    std::vector<char> out;
+    writeSnapshot(game, out);
+    FILE *f = fopen(path, "wb");
+    if (!f) { error = "cannot open file"; return false; }
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    if (fclose(f) != 0 || !ok) { error = "write failed"; return false; }
+    return true;
+}
+
+// The file's bytes, mapped where the platform allows and read in otherwise.
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+    std::vector<char> copy;
+#if !defined(_WIN32)
+    void *map = nullptr;
+    ~MappedFile() { if (map) munmap(map, size); }
+#endif
+
+    bool open(const char *path) {
+#if !defined(_WIN32)
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) { ::close(fd); return false; }
+        size = (size_t)st.st_size;
+        map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) { map = nullptr; return false; }
+        data = (const char *)map;
+        return true;
+#else
+        FILE *f = fopen(path, "rb");
+        if (!f) return false;
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) copy.insert(copy.end(), buf, buf + n);
+        fclose(f);
+        data = copy.data(); size = copy.size();
+        return size > 0;
+#endif
+    }
+};
+
+bool loadSnapshot(const char *path, Game &game, std::string &error) {
+    if (!littleEndian()) { error = "snapshots are little-endian only"; return false; }
+    MappedFile file;
+    if (!file.open(path)) { error = "cannot open file"; return false; }
+    return readSnapshot(file.data, file.size, game, error);
+}
+
+bool readSnapshot(const char *data, size_t size, Game &game, std::string &error) {
+    if (!littleEndian()) { error = "snapshots are little-endian only"; return false; }
+    SnapshotHeader h;
+    if (size < sizeof(h)) { error = "not a snapshot file"; return false; }
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, SNAPSHOT_MAGIC, 4) != 0) { error = "not a snapshot file"; return false; }
+    if (h.version != SNAPSHOT_VERSION) { error = "unsupported snapshot version"; return false; }
+    if (h.fileSize != size || h.sectionCount > 256 ||
+        sizeof(h) + sizeof(SnapshotSection) * (size_t)h.sectionCount > size) {
+        error = "truncated or corrupt header";
+        return false;
+    }
+    const SnapshotSection *table = (const SnapshotSection *)(data + sizeof(h));
+    for (uint32_t k = 0; k < h.sectionCount; ++k) {
+        const SnapshotSection &sec = table[k];
+        if (sec.offset % SNAPSHOT_ALIGN || sec.offset > size || sec.elemSize == 0 ||
+            sec.count > (size - sec.offset) / sec.elemSize) {
+            error = "section " + std::to_string(k) + " runs past the end of the file";
+            return false;
+        }
+    }
+
+    // Walks the sections in the order visitArrays lists them, checking each
+    // element size before anything is copied.
+    uint32_t next = 0;
+    bool ok = true;
+    auto take = [&](uint32_t elemSize, const char *&at, uint64_t &count) {
+        if (!ok) return;
+        if (next >= h.sectionCount || table[next].elemSize != elemSize) {
+            error = "section " + std::to_string(next) + " does not match this build";
+            ok = false;
+            return;
+        }
+        at = data + table[next].offset;
+        count = table[next].count;
+        next++;
+    };
+    const char *at = nullptr;
+    uint64_t count = 0;
+    take(sizeof(SnapshotScalars), at, count);
+    if (ok && count != 1) { error = "bad scalar section"; ok = false; }
+    if (!ok) return false;
+    SnapshotScalars s;
+    memcpy(&s, at, sizeof(s));
+    if (s.difficulty < DIFF_CASUAL || s.difficulty > DIFF_HARD) { error = "bad difficulty"; return false; }
+
+    // First pass: match every array to its section and note how long it is,
+    // without touching the game, so a bad file leaves it as it was.
+    std::map<const void *, uint64_t> counts;
+    std::vector<const char *> starts;
+    visitArrays(game, [&](auto &vec) {
+        typedef typename std::decay<decltype(vec)>::type::value_type T;
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot arrays are copied as bytes");
+        take(sizeof(T), at, count);
+        counts[&vec] = count;
+        starts.push_back(at);
+    });
+    const char *ordersAt = nullptr, *targetsAt = nullptr;
+    uint64_t orderCount = 0, targetCount = 0;
+    take(sizeof(SnapshotAreaOrder), ordersAt, orderCount);
+    take(sizeof(EntityId), targetsAt, targetCount);
+    if (ok && next != h.sectionCount) { error = "extra sections"; ok = false; }
+    if (!ok) return false;
+
+    // Sizes the arrays have to agree on; anything past this came from saveSnapshot.
+    auto countOf = [&](const auto &vec) { return counts[&vec]; };
+    uint64_t enemies = countOf(game.enemies.x), units = countOf(game.units);
+    bool sized = s.unitTypeStart[0] == 0 && s.unitTypeStart[UNIT_TYPE_COUNT] == (int64_t)units &&
+                 countOf(game.enemies.slots.slotOf) == enemies &&
+                 countOf(game.bullets.slots.slotOf) == countOf(game.bullets.items) &&
+                 countOf(game.rocks.slots.slotOf) == countOf(game.rocks.items) &&
+                 countOf(game.rockAssign.unitRock) == units && countOf(game.claims.unitClaim) == units;
+    visitEnemyColumns(game.enemies, [&](const auto &vec) { sized = sized && countOf(vec) == enemies; });
+    const SnapshotAreaOrder *orders = (const SnapshotAreaOrder *)ordersAt;
+    for (uint64_t k = 0; k < orderCount; ++k) sized = sized && (uint64_t)orders[k].firstTarget + orders[k].targetCount <= targetCount;
+    if (!sized) { error = "array sizes do not match"; return false; }
+
+    // Second pass: copy.
+    size_t k = 0;
+    visitArrays(game, [&](auto &vec) {
+        typedef typename std::decay<decltype(vec)>::type::value_type T;
+        const T *from = (const T *)starts[k++];
+        vec.assign(from, from + counts[&vec]);
+    });
+    const EntityId *targets = (const EntityId *)targetsAt;
+    game.areaOrders.resize((size_t)orderCount);
+    for (uint64_t o = 0; o < orderCount; ++o) {
+        AreaOrder &ao = game.areaOrders[o];
+        ao.rect = orders[o].rect;
+        ao.users = orders[o].users;
+        ao.targets.assign(targets + orders[o].firstTarget, targets + orders[o].firstTarget + orders[o].targetCount);
+    }
+
+    game.seed = s.seed;
+    game.spawnRng = s.spawnRng; game.lootRng = s.lootRng; game.particleRng = s.particleRng;
+    game.archetypes = s.archetypes;
+    game.playerShip = s.playerShip;
+    game.shop = s.shop;
+    game.difficulty = (Difficulty)s.difficulty;
+    game.currentWave = s.currentWave; game.enemiesAlive = s.enemiesAlive;
+    game.armySize = s.armySize;
+    for (int t = 0; t <= UNIT_TYPE_COUNT; ++t) game.unitTypeStart[t] = s.unitTypeStart[t];
+    game.enemies.crowdPhase = s.crowdPhase;
+    game.tick = s.tick;
+    game.intermissionTime = s.intermissionTime;
+    game.inIntermission = s.inIntermission != 0; game.shipInvulnerable = s.shipInvulnerable != 0;
+    game.rockAssign.dirty = s.rockAssignDirty != 0; game.rockAssign.exhausted = s.rockAssignExhausted != 0;
+    resetDerivedState(game);
+    return true;
+}
+
+// A delta is the size of `to`, its header and section table as they are, then
+// for each of its sections a list of runs over 4 byte words: a shift, how
+// many words match `from` that many words further on, and how many follow as
+// literals. The shift is there because a tick that kills aliens moves every
+// one after them down, which would otherwise turn whole columns of stats that
+// never change into literals. Sections are padded to 16 bytes, so rounding
+// one up to whole words stays inside the buffer.
+static const int DELTA_MIN_MATCH = 3;       // words; a run header costs three
+static const int DELTA_MAX_SHIFT = 16;      // how far ahead to look for the match after a gap
+
+static void putWords(std::vector<char> &out, const void *p, size_t words) {
+    const char *c = (const char *)p;
+    out.insert(out.end(), c, c + words * 4);
+}
+
+void diffSnapshots(const std::vector<char> &from, const std::vector<char> &to, std::vector<char> &delta) {
+    const SnapshotHeader *toH = (const SnapshotHeader *)to.data(), *fromH = (const SnapshotHeader *)from.data();
+    const SnapshotSection *toT = (const SnapshotSection *)(to.data() + sizeof(SnapshotHeader));
+    const SnapshotSection *fromT = (const SnapshotSection *)(from.data() + sizeof(SnapshotHeader));
+    uint32_t head = (uint32_t)(sizeof(SnapshotHeader) + sizeof(SnapshotSection) * toH->sectionCount);
+    uint64_t size = to.size();
+    delta.clear();
+    putWords(delta, &size, 2);
+    putWords(delta, &head, 1);
+    delta.insert(delta.end(), to.data(), to.data() + head);
+    for (uint32_t k = 0; k < toH->sectionCount; ++k) {
+        const char *t = to.data() + toT[k].offset, *f = nullptr;
+        size_t words = (toT[k].elemSize * toT[k].count + 3) / 4, fromWords = 0;
+        if (k < fromH->sectionCount) {
+            f = from.data() + fromT[k].offset;
+            fromWords = (fromT[k].elemSize * fromT[k].count + 3) / 4;
+        }
+        // Words from w on that match from shift words further on, up to limit.
+        auto matching = [&](size_t w, size_t shift, size_t limit) {
+            size_t n = 0;
+            while (n < limit && w + n < words && w + n + shift < fromWords &&
+                   memcmp(t + (w + n) * 4, f + (w + n + shift) * 4, 4) == 0) ++n;
+            return n;
+        };
+        // Moves shift forward to where a run of matches starts at w, if any.
+        auto resync = [&](size_t w, size_t &shift) {
+            for (size_t s = shift; s <= shift + DELTA_MAX_SHIFT; ++s) {
+                if (matching(w, s, DELTA_MIN_MATCH) == DELTA_MIN_MATCH) { shift = s; return true; }
+            }
+            return false;
+        };
+        size_t w = 0, shift = 0;
+        while (w < words) {
+            size_t match = resync(w, shift) ? matching(w, shift, words) : 0, matchShift = shift;
+            size_t start = w + match, end = start;
+            while (end < words && !resync(end, shift)) ++end;
+            uint32_t run[3] = { (uint32_t)matchShift, (uint32_t)match, (uint32_t)(end - start) };
+            putWords(delta, run, 3);
+            putWords(delta, t + start * 4, end - start);
+            w = end;
+        }
+    }
+}
+
+void applySnapshotDelta(const std::vector<char> &from, const std::vector<char> &delta, std::vector<char> &to) {
+    const char *d = delta.data();
+    uint64_t size;
+    uint32_t head;
+    memcpy(&size, d, 8); d += 8;
+    memcpy(&head, d, 4); d += 4;
+    to.assign((size_t)size, 0);
+    memcpy(to.data(), d, head); d += head;
+    const SnapshotHeader *toH = (const SnapshotHeader *)to.data();
+    const SnapshotSection *toT = (const SnapshotSection *)(to.data() + sizeof(SnapshotHeader));
+    const SnapshotSection *fromT = (const SnapshotSection *)(from.data() + sizeof(SnapshotHeader));
+    for (uint32_t k = 0; k < toH->sectionCount; ++k) {
+        char *t = to.data() + toT[k].offset;
+        size_t words = (toT[k].elemSize * toT[k].count + 3) / 4, w = 0;
+        while (w < words) {
+            uint32_t run[3];
+            memcpy(run, d, 12); d += 12;
+            if (run[1]) memcpy(t + w * 4, from.data() + fromT[k].offset + (w + run[0]) * 4, run[1] * 4);
+            w += run[1];
+            memcpy(t + w * 4, d, run[2] * 4); d += run[2] * 4;
+            w += run[2];
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include "game.h"
+
+// Whole-game snapshots, taken between ticks, for picking a hard late-wave state
+// back up in a benchmark or a bug repro instead of playing up to it.
+//
+// Little-endian and flat: a header, a table of sections and then the sections,
+// each one array copied straight out of the game (units, rocks, bullets, every
+// EnemyStore array, the handle tables) at a 16 byte aligned offset. Loading
+// maps the file and copies each array straight back; the only parsing is
+// checking the table. A section records the size of its element, so a file
+// from a build whose structs differ is refused instead of misread; change the
+// layout on purpose and SNAPSHOT_VERSION goes up.
+//
+// Everything the simulation reads is kept, the RNG streams included, so a
+// loaded game carries on exactly as the saved one would have. Grids, the flow
+// field and other caches are rebuilt on first use, and particles, which are
+// only for show, start out empty.
+bool saveSnapshot(const char *path, const Game &game, std::string &error);
+// Replaces the game's state with the file's. On failure the game is untouched
+// and error says why.
+bool loadSnapshot(const char *path, Game &game, std::string &error);
+
+// The same format in memory, for keeping many states at once (see rewind.h).
+void writeSnapshot(const Game &game, std::vector<char> &out);
+bool readSnapshot(const char *data, size_t size, Game &game, std::string &error);
+// What changed from one in-memory snapshot to the next, as runs of changed
+// words section by section, so columns that hold still (stats, slot tables,
+// rocks) cost next to nothing. applySnapshotDelta rebuilds `to` exactly from
+// `from`; neither checks its input, which must come from writeSnapshot and
+// diffSnapshots in this process.
+void diffSnapshots(const std::vector<char> &from, const std::vector<char> &to, std::vector<char> &delta);
+void applySnapshotDelta(const std::vector<char> &from, const std::vector<char> &delta, std::vector<char> &to);
+
+#endif
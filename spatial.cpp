@@ -0,0 +1,177 @@
+#include "spatial.h"
+#include <algorithm>
+#include <cfloat>
+
+void SpatialGrid::init(float size) {
+    cellSize = size;
+    invCellSize = 1.0f / size;
+    clear();
+}
+
+void SpatialGrid::clear() {
+    pendingIds.clear();
+    pendingRects.clear();
+    pendingCells.clear();
+    bucketItems.clear();
+}
+
+void SpatialGrid::add(int id, Rectangle r) {
+    pendingIds.push_back(id);
+    pendingRects.push_back(r);
+}
+
+void SpatialGrid::build() {
+    int maxId = -1;
+    int entries = 0;
+    pendingCells.resize(pendingRects.size() * 4);
+    for (size_t i = 0; i < pendingRects.size(); ++i) {
+        const Rectangle &r = pendingRects[i];
+        int *c = &pendingCells[i * 4];
+        c[0] = cellOf(r.x); c[1] = cellOf(r.y);
+        c[2] = cellOf(r.x + r.width); c[3] = cellOf(r.y + r.height);
+        maxId = std::max(maxId, pendingIds[i]);
+        entries += (c[2] - c[0] + 1) * (c[3] - c[1] + 1);
+    }
+    if ((int)visitStamp.size() <= maxId) visitStamp.resize(maxId + 1, 0);
+
+    unsigned bucketCount = 64;
+    while (bucketCount < (unsigned)entries * 2) bucketCount <<= 1;
+    bucketMask = bucketCount - 1;
+    bucketStart.assign(bucketCount + 1, 0);
+
+    for (size_t i = 0; i < pendingRects.size(); ++i) {
+        const int *c = &pendingCells[i * 4];
+        for (int cy = c[1]; cy <= c[3]; ++cy)
+            for (int cx = c[0]; cx <= c[2]; ++cx) bucketStart[bucketOf(cx, cy) + 1]++;
+    }
+    for (unsigned b = 0; b < bucketCount; ++b) bucketStart[b + 1] += bucketStart[b];
+
+    bucketItems.resize(entries);
+    cursor.assign(bucketStart.begin(), bucketStart.end() - 1);
+    for (size_t i = 0; i < pendingRects.size(); ++i) {
+        const int *c = &pendingCells[i * 4];
+        for (int cy = c[1]; cy <= c[3]; ++cy)
+            for (int cx = c[0]; cx <= c[2]; ++cx) bucketItems[cursor[bucketOf(cx, cy)]++] = pendingIds[i];
+    }
+}
+
+void SpatialGrid::nextStamp() const {
+    if (++stamp == 0) {
+        std::fill(visitStamp.begin(), visitStamp.end(), 0);
+        stamp = 1;
+    }
+}
+
+// Keeps the grid to a sane number of cells when the points lie along a line far apart.
+static const int POINT_GRID_MAX_SIDE = 512;
+
+void PointGrid::init(float size) {
+    cellSize = size;
+    clear();
+}
+
+void PointGrid::build(const float *xs, const float *ys, int count) {
+    float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+    if (count > 0) {
+        minX = maxX = xs[0]; minY = maxY = ys[0];
+        // Plain selects rather than std::min/max, which -O1 turns into branches.
+        for (int i = 1; i < count; ++i) {
+            float x = xs[i], y = ys[i];
+            minX = x < minX ? x : minX; maxX = x > maxX ? x : maxX;
+            minY = y < minY ? y : minY; maxY = y > maxY ? y : maxY;
+        }
+    }
+    // About one point per cell: a few far-apart points get a few big cells
+    // rather than a field of empty ones to build and walk.
+    cell = std::max(cellSize, sqrtf((maxX - minX) * (maxY - minY) / std::max(count, 1)));
+    while ((maxX - minX) / cell >= POINT_GRID_MAX_SIDE || (maxY - minY) / cell >= POINT_GRID_MAX_SIDE) cell *= 2.0f;
+    invCell = 1.0f / cell;
+    originX = minX; originY = minY;
+    cols = (int)((maxX - minX) * invCell) + 1;
+    rows = (int)((maxY - minY) * invCell) + 1;
+
+    int cells = cols * rows;
+    cellStart.assign(cells + 1, 0);
+    pointCell.resize(count);
+    for (int i = 0; i < count; ++i) {
+        pointCell[i] = rowOf(ys[i]) * cols + colOf(xs[i]);
+        cellStart[pointCell[i]]++;
+    }
+    for (int c = 1; c < cells; ++c) cellStart[c] += cellStart[c - 1];
+    cellStart[cells] = count;
+    px.resize(count + POINT_GRID_PAD); py.resize(count + POINT_GRID_PAD); ids.resize(count);
+    std::fill(px.begin() + count, px.end(), 0.0f);
+    std::fill(py.begin() + count, py.end(), 0.0f);
+    // cellStart now holds each cell's end. Filling backwards from there, the
+    // highest id first, keeps ids ascending inside a cell and leaves cellStart
+    // on each cell's start.
+    for (int i = count - 1; i >= 0; --i) {
+        int k = --cellStart[pointCell[i]];
+        px[k] = xs[i]; py[k] = ys[i]; ids[k] = i;
+    }
+}
+
+template <typename F>
+void PointGrid::forRing(int cx, int cy, int ring, F &&visit) const {
+    if (ring == 0) { visit(cy * cols + cx); return; }
+    int x0 = std::max(0, cx - ring), x1 = std::min(cols - 1, cx + ring);
+    if (cy - ring >= 0) for (int x = x0; x <= x1; ++x) visit((cy - ring) * cols + x);
+    if (cy + ring < rows) for (int x = x0; x <= x1; ++x) visit((cy + ring) * cols + x);
+    int y0 = std::max(0, cy - ring + 1), y1 = std::min(rows - 1, cy + ring - 1);
+    if (cx - ring >= 0) for (int y = y0; y <= y1; ++y) visit(y * cols + cx - ring);
+    if (cx + ring < cols) for (int y = y0; y <= y1; ++y) visit(y * cols + cx + ring);
+}
+
+float PointGrid::outsideDistance(float x, float y, int cx, int cy, int ring) const {
+    float d = FLT_MAX;
+    if (cx - ring > 0) d = std::min(d, x - (originX + (cx - ring) * cell));
+    if (cx + ring < cols - 1) d = std::min(d, originX + (cx + ring + 1) * cell - x);
+    if (cy - ring > 0) d = std::min(d, y - (originY + (cy - ring) * cell));
+    if (cy + ring < rows - 1) d = std::min(d, originY + (cy + ring + 1) * cell - y);
+    return std::max(d, 0.0f);
+}
+
+// Walks rings of cells outward from the query's cell and stops once
+// everything left is provably farther than the best so far.
+int PointGrid::nearest(float x, float y, float maxR, float *outD2) const {
+    if (ids.empty()) return -1;
+    int cx = colOf(x), cy = rowOf(y);
+    int rings = std::max(std::max(cx, cols - 1 - cx), std::max(cy, rows - 1 - cy));
+    float best = maxR * maxR;
+    int bestId = -1;
+    auto consider = [&](int id, float d2) {
+        if (d2 < best || (d2 == best && (bestId < 0 || id < bestId))) { best = d2; bestId = id; }
+    };
+    for (int ring = 0; ring <= rings; ++ring) {
+        if (ring > 0) {
+            float out = outsideDistance(x, y, cx, cy, ring - 1);
+            if (out == FLT_MAX || out * out > best) break;
+        }
+        forRing(cx, cy, ring, [&](int c) { scanCell(c, x, y, best, consider); });
+    }
+    if (outD2) *outD2 = best;
+    return bestId;
+}
+
+bool segmentHitsRect(Vector2 a, Vector2 b, Rectangle r, float &t) {
+    float tMin = 0.0f, tMax = 1.0f;
+    float d[2] = { b.x - a.x, b.y - a.y };
+    float p[2] = { a.x, a.y };
+    float lo[2] = { r.x, r.y };
+    float hi[2] = { r.x + r.width, r.y + r.height };
+    for (int axis = 0; axis < 2; ++axis) {
+        if (fabsf(d[axis]) < 1e-6f) {
+            if (p[axis] < lo[axis] || p[axis] >= hi[axis]) return false;
+            continue;
+        }
+        float inv = 1.0f / d[axis];
+        float t0 = (lo[axis] - p[axis]) * inv;
+        float t1 = (hi[axis] - p[axis]) * inv;
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > tMin) tMin = t0;
+        if (t1 < tMax) tMax = t1;
+        if (tMin > tMax) return false;
+    }
+    t = tMin;
+    return true;
+}
@@ -0,0 +1,167 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <raylib.h>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SPATIAL_SSE2 1
+#endif
+
+// Uniform spatial hash over axis-aligned boxes. Items are added with an id of the
+// caller's choosing (usually an index into its own vector) and bucketed into every
+// cell their box overlaps. build() packs the buckets into one flat array sized to
+// the item count, so rebuilding every tick is O(items) no matter how big the map is.
+struct SpatialGrid {
+    float cellSize = 64.0f;
+    float invCellSize = 1.0f / 64.0f;
+
+    std::vector<int> bucketStart;  // bucketCount + 1 offsets into bucketItems
+    std::vector<int> bucketItems;  // item ids grouped by bucket
+    unsigned bucketMask = 0;
+    std::vector<int> pendingIds;
+    std::vector<Rectangle> pendingRects;
+    std::vector<int> pendingCells; // x0, y0, x1, y1 per pending item
+    std::vector<int> cursor;
+    mutable std::vector<unsigned> visitStamp;
+    mutable unsigned stamp = 0;
+
+    void init(float cellSize);
+    void clear();
+    void add(int id, Rectangle r);
+    void build();
+    bool empty() const { return bucketItems.empty(); }
+
+    int cellOf(float v) const {
+        float c = v * invCellSize;
+        int i = (int)c;
+        return i - (c < (float)i);
+    }
+    unsigned bucketOf(int cx, int cy) const {
+        return ((unsigned)cx * 73856093u ^ (unsigned)cy * 19349663u) & bucketMask;
+    }
+
+    // Calls visit(id) once for every item hashed into a cell the segment's bounds
+    // touch. Segments are one tick of bullet travel, so those cells are few.
+    template <typename F>
+    void querySegment(Vector2 a, Vector2 b, F &&visit) const {
+        if (bucketItems.empty()) return;
+        int x0 = cellOf(fminf(a.x, b.x)), x1 = cellOf(fmaxf(a.x, b.x));
+        int y0 = cellOf(fminf(a.y, b.y)), y1 = cellOf(fmaxf(a.y, b.y));
+        nextStamp();
+        for (int cy = y0; cy <= y1; ++cy) {
+            for (int cx = x0; cx <= x1; ++cx) {
+                unsigned bucket = bucketOf(cx, cy);
+                for (int k = bucketStart[bucket]; k < bucketStart[bucket + 1]; ++k) {
+                    int id = bucketItems[k];
+                    if (visitStamp[id] == stamp) continue;
+                    visitStamp[id] = stamp;
+                    visit(id);
+                }
+            }
+        }
+    }
+
+    // Calls visit(id) once for every item hashed into a cell overlapping r.
+    template <typename F>
+    void queryRect(Rectangle r, F &&visit) const {
+        querySegment(Vector2{ r.x, r.y }, Vector2{ r.x + r.width, r.y + r.height }, visit);
+    }
+
+private:
+    void nextStamp() const;
+};
+
+// Zeros after the packed points, so a read 4 wide may start at any of them.
+const int POINT_GRID_PAD = 3;
+
+// Uniform grid over points for radius, nearest and box queries. build()
+// counting-sorts the points by cell, so each cell's points sit back to back in
+// px/py and a leaf scan tests four squared distances per SSE2 step. The grid
+// spans the points' bounding box and queries may start anywhere. Ids are
+// indices into the arrays given to build().
+struct PointGrid {
+    float cellSize = 64.0f;         // smallest cell, as asked for in init(); sparse points get bigger ones
+    float cell = 64.0f, invCell = 1.0f / 64.0f;
+    float originX = 0.0f, originY = 0.0f;
+    int cols = 0, rows = 0;
+
+    std::vector<int> cellStart;     // cols * rows + 1 offsets into the packed arrays
+    std::vector<float> px, py;      // packed by cell, then POINT_GRID_PAD zeros
+    std::vector<int> ids;           // packed by cell, ascending within a cell
+    std::vector<int> pointCell;     // build scratch
+
+    void init(float cellSize);
+    void build(const float *xs, const float *ys, int count);
+    void clear() { build(nullptr, nullptr, 0); }
+    int size() const { return (int)ids.size(); }
+
+    // Calls visit(id, d2) for every point within r of (x, y), in no set order.
+    template <typename F>
+    void queryRadius(float x, float y, float r, F &&visit) const {
+        if (ids.empty()) return;
+        int x0 = colOf(x - r), x1 = colOf(x + r), y0 = rowOf(y - r), y1 = rowOf(y + r);
+        for (int cy = y0; cy <= y1; ++cy)
+            for (int cx = x0; cx <= x1; ++cx) scanCell(cy * cols + cx, x, y, r * r, visit);
+    }
+
+    // Calls visit(id) for every point inside r, edges included, in no set order.
+    template <typename F>
+    void queryRect(Rectangle r, F &&visit) const {
+        if (ids.empty()) return;
+        float x1 = r.x + r.width, y1 = r.y + r.height;
+        for (int cy = rowOf(r.y); cy <= rowOf(y1); ++cy) {
+            for (int cx = colOf(r.x); cx <= colOf(x1); ++cx) {
+                int c = cy * cols + cx;
+                for (int k = cellStart[c]; k < cellStart[c + 1]; ++k)
+                    if (px[k] >= r.x && px[k] <= x1 && py[k] >= r.y && py[k] <= y1) visit(ids[k]);
+            }
+        }
+    }
+
+    // Nearest point no farther than maxR, or -1. Equal distances go to the
+    // lower id, so the answer matches a linear scan with a strict <.
+    int nearest(float x, float y, float maxR, float *outD2 = nullptr) const;
+
+    // Clamped to the grid; truncation is enough since below 0 clamps anyway.
+    int colOf(float x) const { float c = (x - originX) * invCell; return c < 0.0f ? 0 : (c >= (float)cols ? cols - 1 : (int)c); }
+    int rowOf(float y) const { float c = (y - originY) * invCell; return c < 0.0f ? 0 : (c >= (float)rows ? rows - 1 : (int)c); }
+
+private:
+    // visit(id, d2) for the points of cell c within sqrt(r2) of (x, y).
+    template <typename F>
+    void scanCell(int c, float x, float y, float r2, F &&visit) const {
+        int k = cellStart[c], end = cellStart[c + 1];
+#ifdef SPATIAL_SSE2
+        __m128 qx = _mm_set1_ps(x), qy = _mm_set1_ps(y), lim = _mm_set1_ps(r2);
+        for (; k + 4 <= end; k += 4) {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(&px[k]), qx), dy = _mm_sub_ps(_mm_loadu_ps(&py[k]), qy);
+            __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            int mask = _mm_movemask_ps(_mm_cmple_ps(d2, lim));
+            if (!mask) continue;
+            float lane[4];
+            _mm_storeu_ps(lane, d2);
+            for (int l = 0; l < 4; ++l) if (mask & (1 << l)) visit(ids[k + l], lane[l]);
+        }
+#endif
+        for (; k < end; ++k) {
+            float dx = px[k] - x, dy = py[k] - y, d2 = dx*dx + dy*dy;
+            if (d2 <= r2) visit(ids[k], d2);
+        }
+    }
+
+    // Visits the cells at Chebyshev distance ring from (cx, cy), clipped to the grid.
+    template <typename F>
+    void forRing(int cx, int cy, int ring, F &&visit) const;
+    // Lower bound on the distance from (x, y) to any point outside the square of
+    // cells within ring of (cx, cy); infinite once that square covers the grid.
+    float outsideDistance(float x, float y, int cx, int cy, int ring) const;
+};
+
+// Slab test of segment a->b against r. On a hit, t is the entry fraction along
+// the segment in [0, 1] (0 when a already lies inside r).
+bool segmentHitsRect(Vector2 a, Vector2 b, Rectangle r, float &t);
+
+#endif
@@ -0,0 +1,99 @@
+#include "game.h"
+#include <algorithm>
+#include <cfloat>
+
+void refreshEnemyPoints(Game &game) {
+    if (!game.enemyPointsDirty) return;
+    game.enemyPoints.build(game.enemies.x.data(), game.enemies.y.data(), game.enemies.size());
+    game.enemyPointsDirty = false;
+}
+
+void refreshUnitPoints(Game &game) {
+    if (!game.unitPointsDirty) return;
+    const std::vector<Unit> &units = game.units;
+    game.unitCX.resize(units.size());
+    game.unitCY.resize(units.size());
+    for (int j = 0; j < (int)units.size(); ++j) {
+        game.unitCX[j] = units[j].fx + units[j].width/2.0f;
+        game.unitCY[j] = units[j].fy + units[j].height/2.0f;
+    }
+    game.unitPoints.build(game.unitCX.data(), game.unitCY.data(), (int)units.size());
+    game.unitPointsDirty = false;
+}
+
+static void syncClaim(Game &game, int unit) {
+    TargetClaims &tc = game.claims;
+    const Unit &u = game.units[unit];
+    int want = (u.areaAttacking() && u.attacking) ? u.target.slot() : -1;
+    int &have = tc.unitClaim[unit];
+    if (want == have) return;
+    if (have >= 0) tc.count[have]--;
+    if (want >= 0) {
+        if (want >= (int)tc.count.size()) tc.count.resize(game.enemies.slots.slotCount(), 0);
+        tc.count[want]++;
+    }
+    have = want;
+}
+
+void setUnitTarget(Game &game, int unit, EntityId enemy) {
+    game.units[unit].attacking = enemy.valid();
+    game.units[unit].target = enemy;
+    syncClaim(game, unit);
+}
+
+static void dropAreaOrder(Game &game, int unit) {
+    Unit &u = game.units[unit];
+    if (!u.areaAttacking()) return;
+    AreaOrder &o = game.areaOrders[u.areaOrder];
+    if (--o.users == 0) o.targets.clear();
+    u.areaOrder = -1;
+}
+
+void clearUnitOrders(Game &game, int unit) {
+    dropAreaOrder(game, unit);
+    setUnitTarget(game, unit, EntityId{});
+}
+
+void giveAreaOrder(Game &game, const std::vector<int> &idx, Rectangle rect, const std::vector<EntityId> &captured) {
+    for (int i : idx) clearUnitOrders(game, i);
+    std::vector<AreaOrder> &orders = game.areaOrders;
+    int slot = 0;
+    while (slot < (int)orders.size() && orders[slot].users > 0) slot++;
+    if (slot == (int)orders.size()) orders.emplace_back();
+    AreaOrder &o = orders[slot];
+    o.rect = rect;
+    o.targets = captured;
+    o.users = (int)idx.size();
+    for (int i : idx) game.units[i].areaOrder = slot;
+}
+
+EntityId pickAreaTarget(Game &game, int unit) {
+    const EnemyStore &enemies = game.enemies;
+    const Unit &u = game.units[unit];
+    if (!u.areaAttacking()) return EntityId{};
+    std::vector<EntityId> &list = game.areaOrders[u.areaOrder].targets;
+    list.erase(std::remove_if(list.begin(), list.end(), [&](EntityId id){ return enemies.find(id) < 0; }), list.end());
+
+    float ucx = u.fx + u.width/2.0f, ucy = u.fy + u.height/2.0f;
+    // A unit's own claim never blocks it.
+    int own = game.claims.unitClaim[unit];
+    EntityId bestFree, bestAny;
+    float bestFreeD2 = FLT_MAX, bestAnyD2 = FLT_MAX;
+    for (EntityId id : list) {
+        int t = enemies.find(id);
+        float dx = enemies.x[t] - ucx, dy = enemies.y[t] - ucy;
+        float d2 = dx*dx + dy*dy;
+        if (d2 < bestAnyD2) { bestAnyD2 = d2; bestAny = id; }
+        bool free = id.slot() == own ? game.claims.count[own] <= 1 : !game.claims.claimed(id);
+        if (free && d2 < bestFreeD2) { bestFreeD2 = d2; bestFree = id; }
+    }
+    return bestFree.valid() ? bestFree : bestAny;
+}
+
+void distributeTargets(Game &game, const std::vector<int> &idx) {
+    for (int i : idx) {
+        if (UNIT_TRAITS[game.units[i].type].heals) continue;
+        EntityId t = pickAreaTarget(game, i);
+        if (t.valid()) setUnitTarget(game, i, t);
+    }
+}